@@ -689,35 +689,18 @@ accounts_user_deleted_cb (GDBusConnection *connection,
     }
 }
 
-static CommonSession *
-load_session (CommonUserList *user_list, const gchar *path)
+static void
+add_session (CommonUserList *user_list, const gchar *path, GVariant *interfaces, gboolean emit_changed)
 {
     CommonUserListPrivate *priv = GET_LIST_PRIVATE (user_list);
 
-    g_autoptr(GError) error = NULL;
-    g_autoptr(GVariant) result = g_dbus_connection_call_sync (priv->bus,
-                                                              "org.freedesktop.DisplayManager",
-                                                              path,
-                                                              "org.freedesktop.DBus.Properties",
-                                                              "Get",
-                                                              g_variant_new ("(ss)", "org.freedesktop.DisplayManager.Session", "UserName"),
-                                                              G_VARIANT_TYPE ("(v)"),
-                                                              G_DBUS_CALL_FLAGS_NONE,
-                                                              -1,
-                                                              NULL,
-                                                              &error);
-    if (error)
-        g_warning ("Error getting UserName from org.freedesktop.DisplayManager.Session: %s", error->message);
-    if (!result)
-        return NULL;
-
-    g_autoptr(GVariant) username = NULL;
-    g_variant_get (result, "(v)", &username);
-    if (!g_variant_is_of_type (username, G_VARIANT_TYPE_STRING))
-        return NULL;
+    g_autoptr(GVariant) properties = g_variant_lookup_value (interfaces, "org.freedesktop.DisplayManager.Session", G_VARIANT_TYPE ("a{sv}"));
+    if (!properties)
+        return;
 
     const gchar *name;
-    g_variant_get (username, "&s", &name);
+    if (!g_variant_lookup (properties, "UserName", "&s", &name))
+        return;
 
     g_debug ("Loaded session %s (%s)", path, name);
     CommonSession *session = g_object_new (common_session_get_type (), NULL);
@@ -725,57 +708,60 @@ load_session (CommonUserList *user_list, const gchar *path)
     session->path = g_strdup (path);
     priv->sessions = g_list_append (priv->sessions, session);
 
-    return session;
+    if (!emit_changed)
+        return;
+
+    CommonUser *user = get_user_by_name (user_list, session->username);
+    if (user)
+        g_signal_emit (user, user_signals[CHANGED], 0);
 }
 
 static void
-session_added_cb (GDBusConnection *connection,
-                  const gchar *sender_name,
-                  const gchar *object_path,
-                  const gchar *interface_name,
-                  const gchar *signal_name,
-                  GVariant *parameters,
-                  gpointer data)
+interfaces_added_cb (GDBusConnection *connection,
+                     const gchar *sender_name,
+                     const gchar *object_path,
+                     const gchar *interface_name,
+                     const gchar *signal_name,
+                     GVariant *parameters,
+                     gpointer data)
 {
     CommonUserList *user_list = data;
 
-    if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(o)")))
+    if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(oa{sa{sv}})")))
     {
-        g_warning ("Got DisplayManager signal SessionAdded with unknown parameters %s", g_variant_get_type_string (parameters));
+        g_warning ("Got DisplayManager signal InterfacesAdded with unknown parameters %s", g_variant_get_type_string (parameters));
         return;
     }
 
     const gchar *path;
-    g_variant_get (parameters, "(&o)", &path);
-    CommonSession *session = load_session (user_list, path);
-    if (!session)
-        return;
-
-    CommonUser *user = get_user_by_name (user_list, session->username);
-    if (user)
-        g_signal_emit (user, user_signals[CHANGED], 0);
+    g_autoptr(GVariant) interfaces = NULL;
+    g_variant_get (parameters, "(&o@a{sa{sv}})", &path, &interfaces);
+    add_session (user_list, path, interfaces, TRUE);
 }
 
 static void
-session_removed_cb (GDBusConnection *connection,
-                    const gchar *sender_name,
-                    const gchar *object_path,
-                    const gchar *interface_name,
-                    const gchar *signal_name,
-                    GVariant *parameters,
-                    gpointer data)
+interfaces_removed_cb (GDBusConnection *connection,
+                       const gchar *sender_name,
+                       const gchar *object_path,
+                       const gchar *interface_name,
+                       const gchar *signal_name,
+                       GVariant *parameters,
+                       gpointer data)
 {
     CommonUserList *user_list = data;
     CommonUserListPrivate *priv = GET_LIST_PRIVATE (user_list);
 
-    if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(o)")))
+    if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(oas)")))
     {
-        g_warning ("Got DisplayManager signal SessionRemoved with unknown parameters %s", g_variant_get_type_string (parameters));
+        g_warning ("Got DisplayManager signal InterfacesRemoved with unknown parameters %s", g_variant_get_type_string (parameters));
         return;
     }
 
     const gchar *path;
-    g_variant_get (parameters, "(&o)", &path);
+    g_autofree const gchar **interfaces = NULL;
+    g_variant_get (parameters, "(&o^a&s)", &path, &interfaces);
+    if (!g_strv_contains (interfaces, "org.freedesktop.DisplayManager.Session"))
+        return;
 
     for (GList *link = priv->sessions; link; link = link->next)
     {
@@ -800,57 +786,50 @@ load_sessions (CommonUserList *user_list)
 
     priv->session_added_signal = g_dbus_connection_signal_subscribe (priv->bus,
                                                                      "org.freedesktop.DisplayManager",
-                                                                     "org.freedesktop.DisplayManager",
-                                                                     "SessionAdded",
+                                                                     "org.freedesktop.DBus.ObjectManager",
+                                                                     "InterfacesAdded",
                                                                      "/org/freedesktop/DisplayManager",
                                                                      NULL,
                                                                      G_DBUS_SIGNAL_FLAGS_NONE,
-                                                                     session_added_cb,
+                                                                     interfaces_added_cb,
                                                                      user_list,
                                                                      NULL);
     priv->session_removed_signal = g_dbus_connection_signal_subscribe (priv->bus,
                                                                        "org.freedesktop.DisplayManager",
-                                                                       "org.freedesktop.DisplayManager",
-                                                                       "SessionRemoved",
+                                                                       "org.freedesktop.DBus.ObjectManager",
+                                                                       "InterfacesRemoved",
                                                                        "/org/freedesktop/DisplayManager",
                                                                        NULL,
                                                                        G_DBUS_SIGNAL_FLAGS_NONE,
-                                                                       session_removed_cb,
+                                                                       interfaces_removed_cb,
                                                                        user_list,
                                                                        NULL);
 
+    /* Get all the sessions and their users in one call */
     g_autoptr(GError) error = NULL;
     g_autoptr(GVariant) result = g_dbus_connection_call_sync (priv->bus,
                                                               "org.freedesktop.DisplayManager",
                                                               "/org/freedesktop/DisplayManager",
-                                                              "org.freedesktop.DBus.Properties",
-                                                              "Get",
-                                                              g_variant_new ("(ss)", "org.freedesktop.DisplayManager", "Sessions"),
-                                                              G_VARIANT_TYPE ("(v)"),
+                                                              "org.freedesktop.DBus.ObjectManager",
+                                                              "GetManagedObjects",
+                                                              NULL,
+                                                              G_VARIANT_TYPE ("(a{oa{sa{sv}}})"),
                                                               G_DBUS_CALL_FLAGS_NONE,
                                                               -1,
                                                               NULL,
                                                               &error);
     if (error)
         g_warning ("Error getting session list from org.freedesktop.DisplayManager: %s", error->message);
-    if (result)
-    {
-        if (g_variant_is_of_type (result, G_VARIANT_TYPE ("(v)")))
-        {
-            g_autoptr(GVariant) value = NULL;
-            g_variant_get (result, "(v)", &value);
-
-            g_debug ("Loading sessions from org.freedesktop.DisplayManager");
-            GVariantIter *iter;
-            g_variant_get (value, "ao", &iter);
-            const gchar *path;
-            while (g_variant_iter_loop (iter, "&o", &path))
-                load_session (user_list, path);
-            g_variant_iter_free (iter);
-        }
-        else
-            g_warning ("Unexpected type from org.freedesktop.DisplayManager.Sessions: %s", g_variant_get_type_string (result));
-    }
+    if (!result)
+        return;
+
+    g_debug ("Loading sessions from org.freedesktop.DisplayManager");
+    g_autoptr(GVariantIter) iter = NULL;
+    g_variant_get (result, "(a{oa{sa{sv}}})", &iter);
+    const gchar *path;
+    GVariant *interfaces;
+    while (g_variant_iter_loop (iter, "{&o@a{sa{sv}}}", &path, &interfaces))
+        add_session (user_list, path, interfaces, FALSE);
 }
 
 static void
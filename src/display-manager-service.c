@@ -34,6 +34,9 @@ struct DisplayManagerServicePrivate
     /* Handle for display manager D-Bus object */
     guint reg_id;
 
+    /* Handle for the object manager interface on the display manager object */
+    guint object_manager_reg_id;
+
     /* D-Bus interface information */
     GDBusNodeInfo *seat_info;
     GDBusNodeInfo *session_info;
@@ -45,6 +48,20 @@ struct DisplayManagerServicePrivate
     /* Bus entries for seats / session */
     GHashTable *seat_bus_entries;
     GHashTable *session_bus_entries;
+
+    /* Seat and session entries in the order they were added */
+    GQueue seat_entries;
+    GQueue session_entries;
+
+    /* Values of the Seats and Sessions properties, built when first read after a change */
+    GVariant *seats_value;
+    GVariant *sessions_value;
+
+    /* Properties that have changed since PropertiesChanged was last emitted */
+    gboolean seats_changed;
+    gboolean sessions_changed;
+    GList *changed_seat_entries;
+    guint emit_changes_id;
 };
 
 G_DEFINE_TYPE (DisplayManagerService, display_manager_service, G_TYPE_OBJECT)
@@ -55,6 +72,14 @@ typedef struct
     Seat *seat;
     gchar *path;
     guint bus_id;
+    GList link;
+
+    /* Sessions on this seat in the order they were added */
+    GQueue sessions;
+
+    /* Value of the Sessions property, built when first read after a change */
+    GVariant *sessions_value;
+    gboolean sessions_changed;
 } SeatBusEntry;
 typedef struct
 {
@@ -63,6 +88,11 @@ typedef struct
     gchar *path;
     gchar *seat_path;
     guint bus_id;
+    GList link;
+
+    /* Seat this session is on */
+    SeatBusEntry *seat_entry;
+    GList seat_link;
 } SessionBusEntry;
 
 #define LIGHTDM_BUS_NAME "org.freedesktop.DisplayManager"
@@ -83,36 +113,37 @@ seat_bus_entry_new (DisplayManagerService *service, Seat *seat, const gchar *pat
     entry->service = service;
     entry->seat = seat;
     entry->path = g_strdup (path);
+    entry->link.data = entry;
+    g_queue_init (&entry->sessions);
 
     return entry;
 }
 
 static SessionBusEntry *
-session_bus_entry_new (DisplayManagerService *service, Session *session, const gchar *path, const gchar *seat_path)
+session_bus_entry_new (DisplayManagerService *service, Session *session, const gchar *path, SeatBusEntry *seat_entry)
 {
     SessionBusEntry *entry = g_malloc0 (sizeof (SessionBusEntry));
     entry->service = service;
     entry->session = session;
     entry->path = g_strdup (path);
-    entry->seat_path = g_strdup (seat_path);
+    entry->seat_path = g_strdup (seat_entry ? seat_entry->path : NULL);
+    entry->link.data = entry;
+    entry->seat_entry = seat_entry;
+    entry->seat_link.data = entry;
 
     return entry;
 }
 
 static void
-emit_object_value_changed (GDBusConnection *bus, const gchar *path, const gchar *interface_name, const gchar *property_name, GVariant *property_value)
+emit_object_values_changed (GDBusConnection *bus, const gchar *path, const gchar *interface_name, GVariantBuilder *builder)
 {
-    GVariantBuilder builder;
-    g_variant_builder_init (&builder, G_VARIANT_TYPE_ARRAY);
-    g_variant_builder_add (&builder, "{sv}", property_name, property_value);
-
     g_autoptr(GError) error = NULL;
     if (!g_dbus_connection_emit_signal (bus,
                                         NULL,
                                         path,
                                         "org.freedesktop.DBus.Properties",
                                         "PropertiesChanged",
-                                        g_variant_new ("(sa{sv}as)", interface_name, &builder, NULL),
+                                        g_variant_new ("(sa{sv}as)", interface_name, builder, NULL),
                                         &error))
         g_warning ("Failed to emit PropertiesChanged signal: %s", error->message);
 }
@@ -137,6 +168,8 @@ seat_bus_entry_free (gpointer data)
     SeatBusEntry *entry = data;
 
     g_free (entry->path);
+    if (entry->sessions_value)
+        g_variant_unref (entry->sessions_value);
     g_free (entry);
 }
 
@@ -151,40 +184,230 @@ session_bus_entry_free (gpointer data)
 }
 
 static GVariant *
-get_seat_list (DisplayManagerService *service)
+build_path_list (GList *entries, gsize path_offset)
 {
     GVariantBuilder builder;
     g_variant_builder_init (&builder, G_VARIANT_TYPE ("ao"));
+    for (GList *link = entries; link; link = link->next)
+        g_variant_builder_add_value (&builder, g_variant_new_object_path (G_STRUCT_MEMBER (const gchar *, link->data, path_offset)));
+
+    return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+static GVariant *
+get_seat_list (DisplayManagerService *service)
+{
+    if (!service->priv->seats_value)
+        service->priv->seats_value = build_path_list (service->priv->seat_entries.head, G_STRUCT_OFFSET (SeatBusEntry, path));
+
+    return g_variant_ref (service->priv->seats_value);
+}
+
+static GVariant *
+get_session_list (DisplayManagerService *service)
+{
+    if (!service->priv->sessions_value)
+        service->priv->sessions_value = build_path_list (service->priv->session_entries.head, G_STRUCT_OFFSET (SessionBusEntry, path));
+
+    return g_variant_ref (service->priv->sessions_value);
+}
+
+static GVariant *
+get_seat_session_list (SeatBusEntry *entry)
+{
+    if (!entry->sessions_value)
+        entry->sessions_value = build_path_list (entry->sessions.head, G_STRUCT_OFFSET (SessionBusEntry, path));
+
+    return g_variant_ref (entry->sessions_value);
+}
+
+static void
+emit_changes (DisplayManagerService *service)
+{
+    if (service->priv->emit_changes_id)
+        g_source_remove (service->priv->emit_changes_id);
+    service->priv->emit_changes_id = 0;
 
-    GHashTableIter iter;
-    g_hash_table_iter_init (&iter, service->priv->seat_bus_entries);
-    gpointer value;
-    while (g_hash_table_iter_next (&iter, NULL, &value))
+    if (service->priv->seats_changed || service->priv->sessions_changed)
     {
-        SeatBusEntry *entry = value;
-        g_variant_builder_add_value (&builder, g_variant_new_object_path (entry->path));
+        GVariantBuilder builder;
+        g_variant_builder_init (&builder, G_VARIANT_TYPE_ARRAY);
+        if (service->priv->seats_changed)
+        {
+            g_autoptr(GVariant) value = get_seat_list (service);
+            g_variant_builder_add (&builder, "{sv}", "Seats", value);
+        }
+        if (service->priv->sessions_changed)
+        {
+            g_autoptr(GVariant) value = get_session_list (service);
+            g_variant_builder_add (&builder, "{sv}", "Sessions", value);
+        }
+        emit_object_values_changed (service->priv->bus, "/org/freedesktop/DisplayManager", "org.freedesktop.DisplayManager", &builder);
+        service->priv->seats_changed = FALSE;
+        service->priv->sessions_changed = FALSE;
     }
 
+    GList *changed_seat_entries = g_list_reverse (service->priv->changed_seat_entries);
+    service->priv->changed_seat_entries = NULL;
+    for (GList *link = changed_seat_entries; link; link = link->next)
+    {
+        SeatBusEntry *entry = link->data;
+
+        GVariantBuilder builder;
+        g_variant_builder_init (&builder, G_VARIANT_TYPE_ARRAY);
+        g_autoptr(GVariant) value = get_seat_session_list (entry);
+        g_variant_builder_add (&builder, "{sv}", "Sessions", value);
+        emit_object_values_changed (service->priv->bus, entry->path, "org.freedesktop.DisplayManager.Seat", &builder);
+        entry->sessions_changed = FALSE;
+    }
+    g_list_free (changed_seat_entries);
+}
+
+static gboolean
+emit_changes_cb (gpointer user_data)
+{
+    DisplayManagerService *service = user_data;
+
+    service->priv->emit_changes_id = 0;
+    emit_changes (service);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+queue_emit_changes (DisplayManagerService *service)
+{
+    /* Send all the changes from this main loop iteration in one signal per object */
+    if (!service->priv->emit_changes_id)
+        service->priv->emit_changes_id = g_idle_add (emit_changes_cb, service);
+}
+
+static void
+seats_changed (DisplayManagerService *service)
+{
+    g_clear_pointer (&service->priv->seats_value, g_variant_unref);
+    service->priv->seats_changed = TRUE;
+    queue_emit_changes (service);
+}
+
+static void
+sessions_changed (DisplayManagerService *service, SeatBusEntry *seat_entry)
+{
+    g_clear_pointer (&service->priv->sessions_value, g_variant_unref);
+    service->priv->sessions_changed = TRUE;
+
+    if (seat_entry)
+    {
+        g_clear_pointer (&seat_entry->sessions_value, g_variant_unref);
+        if (!seat_entry->sessions_changed)
+        {
+            seat_entry->sessions_changed = TRUE;
+            service->priv->changed_seat_entries = g_list_prepend (service->priv->changed_seat_entries, seat_entry);
+        }
+    }
+
+    queue_emit_changes (service);
+}
+
+static GVariant *
+get_seat_interfaces (SeatBusEntry *entry)
+{
+    GVariantBuilder properties;
+    g_variant_builder_init (&properties, G_VARIANT_TYPE ("a{sv}"));
+    g_variant_builder_add (&properties, "{sv}", "CanSwitch", g_variant_new_boolean (seat_get_can_switch (entry->seat)));
+    g_variant_builder_add (&properties, "{sv}", "HasGuestAccount", g_variant_new_boolean (seat_get_allow_guest (entry->seat)));
+    g_autoptr(GVariant) sessions = get_seat_session_list (entry);
+    g_variant_builder_add (&properties, "{sv}", "Sessions", sessions);
+
+    GVariantBuilder builder;
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{sv}}"));
+    g_variant_builder_add (&builder, "{sa{sv}}", "org.freedesktop.DisplayManager.Seat", &properties);
+
     return g_variant_builder_end (&builder);
 }
 
 static GVariant *
-get_session_list (DisplayManagerService *service, const gchar *seat_path)
+get_session_interfaces (SessionBusEntry *entry)
 {
+    GVariantBuilder properties;
+    g_variant_builder_init (&properties, G_VARIANT_TYPE ("a{sv}"));
+    if (entry->seat_path)
+        g_variant_builder_add (&properties, "{sv}", "Seat", g_variant_new_object_path (entry->seat_path));
+    g_variant_builder_add (&properties, "{sv}", "UserName", g_variant_new_string (session_get_username (entry->session)));
+
     GVariantBuilder builder;
-    g_variant_builder_init (&builder, G_VARIANT_TYPE ("ao"));
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{sv}}"));
+    g_variant_builder_add (&builder, "{sa{sv}}", "org.freedesktop.DisplayManager.Session", &properties);
 
-    GHashTableIter iter;
-    g_hash_table_iter_init (&iter, service->priv->session_bus_entries);
-    gpointer value;
-    while (g_hash_table_iter_next (&iter, NULL, &value))
+    return g_variant_builder_end (&builder);
+}
+
+static void
+emit_interfaces_added (DisplayManagerService *service, const gchar *path, GVariant *interfaces)
+{
+    g_autoptr(GError) error = NULL;
+    if (!g_dbus_connection_emit_signal (service->priv->bus,
+                                        NULL,
+                                        "/org/freedesktop/DisplayManager",
+                                        "org.freedesktop.DBus.ObjectManager",
+                                        "InterfacesAdded",
+                                        g_variant_new ("(o@a{sa{sv}})", path, interfaces),
+                                        &error))
+        g_warning ("Failed to emit InterfacesAdded signal for %s: %s", path, error->message);
+}
+
+static void
+emit_interfaces_removed (DisplayManagerService *service, const gchar *path, const gchar *interface_name)
+{
+    const gchar *interfaces[] = { interface_name, NULL };
+    g_autoptr(GError) error = NULL;
+    if (!g_dbus_connection_emit_signal (service->priv->bus,
+                                        NULL,
+                                        "/org/freedesktop/DisplayManager",
+                                        "org.freedesktop.DBus.ObjectManager",
+                                        "InterfacesRemoved",
+                                        g_variant_new ("(o^as)", path, interfaces),
+                                        &error))
+        g_warning ("Failed to emit InterfacesRemoved signal for %s: %s", path, error->message);
+}
+
+static void
+handle_object_manager_call (GDBusConnection       *connection,
+                            const gchar           *sender,
+                            const gchar           *object_path,
+                            const gchar           *interface_name,
+                            const gchar           *method_name,
+                            GVariant              *parameters,
+                            GDBusMethodInvocation *invocation,
+                            gpointer               user_data)
+{
+    DisplayManagerService *service = user_data;
+
+    if (g_strcmp0 (method_name, "GetManagedObjects") == 0)
     {
-        SessionBusEntry *entry = value;
-        if (seat_path == NULL || g_strcmp0 (entry->seat_path, seat_path) == 0)
-            g_variant_builder_add_value (&builder, g_variant_new_object_path (entry->path));
-    }
+        if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("()")))
+        {
+            g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS, "Invalid arguments");
+            return;
+        }
 
-    return g_variant_builder_end (&builder);
+        /* Every seat and session with all their properties, so clients only need one call */
+        GVariantBuilder builder;
+        g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{oa{sa{sv}}}"));
+        for (GList *link = service->priv->seat_entries.head; link; link = link->next)
+        {
+            SeatBusEntry *entry = link->data;
+            g_variant_builder_add (&builder, "{o@a{sa{sv}}}", entry->path, get_seat_interfaces (entry));
+        }
+        for (GList *link = service->priv->session_entries.head; link; link = link->next)
+        {
+            SessionBusEntry *entry = link->data;
+            g_variant_builder_add (&builder, "{o@a{sa{sv}}}", entry->path, get_session_interfaces (entry));
+        }
+        g_dbus_method_invocation_return_value (invocation, g_variant_new ("(a{oa{sa{sv}}})", &builder));
+    }
+    else
+        g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD, "Unknown method");
 }
 
 static GVariant *
@@ -201,7 +424,7 @@ handle_display_manager_get_property (GDBusConnection       *connection,
     if (g_strcmp0 (property_name, "Seats") == 0)
         return get_seat_list (service);
     else if (g_strcmp0 (property_name, "Sessions") == 0)
-        return get_session_list (service, NULL);
+        return get_session_list (service);
 
     return NULL;
 }
@@ -262,7 +485,7 @@ handle_seat_get_property (GDBusConnection       *connection,
     if (g_strcmp0 (property_name, "HasGuestAccount") == 0)
         return g_variant_new_boolean (seat_get_allow_guest (entry->seat));
     else if (g_strcmp0 (property_name, "Sessions") == 0)
-        return get_session_list (entry->service, entry->path);
+        return get_seat_session_list (entry);
 
     return NULL;
 }
@@ -409,8 +632,10 @@ running_user_session_cb (Seat *seat, Session *session, DisplayManagerService *se
     session_set_env (session, "XDG_SESSION_PATH", path);
     g_object_set_data_full (G_OBJECT (session), "XDG_SESSION_PATH", g_steal_pointer (&path), g_free);
 
-    SessionBusEntry *session_entry = session_bus_entry_new (service, session, g_object_get_data (G_OBJECT (session), "XDG_SESSION_PATH"), seat_entry ? seat_entry->path : NULL);
+    SessionBusEntry *session_entry = session_bus_entry_new (service, session, g_object_get_data (G_OBJECT (session), "XDG_SESSION_PATH"), seat_entry);
     g_hash_table_insert (service->priv->session_bus_entries, g_object_ref (session), session_entry);
+    g_queue_push_tail_link (&service->priv->session_entries, &session_entry->link);
+    g_queue_push_tail_link (&seat_entry->sessions, &session_entry->seat_link);
 
     g_debug ("Registering session with bus path %s", session_entry->path);
 
@@ -429,10 +654,9 @@ running_user_session_cb (Seat *seat, Session *session, DisplayManagerService *se
     if (session_entry->bus_id == 0)
         g_warning ("Failed to register user session: %s", error->message);
 
-    emit_object_value_changed (service->priv->bus, "/org/freedesktop/DisplayManager", "org.freedesktop.DisplayManager", "Sessions", get_session_list (service, NULL));
+    sessions_changed (service, seat_entry);
+    emit_interfaces_added (service, session_entry->path, get_session_interfaces (session_entry));
     emit_object_signal (service->priv->bus, "/org/freedesktop/DisplayManager", "SessionAdded", session_entry->path);
-
-    emit_object_value_changed (service->priv->bus, seat_entry->path, "org.freedesktop.DisplayManager.Seat", "Sessions", get_session_list (service, session_entry->seat_path));
     emit_object_signal (service->priv->bus, seat_entry->path, "SessionAdded", session_entry->path);
 }
 
@@ -442,22 +666,20 @@ session_removed_cb (Seat *seat, Session *session, DisplayManagerService *service
     g_signal_handlers_disconnect_matched (session, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, seat);
 
     SessionBusEntry *entry = g_hash_table_lookup (service->priv->session_bus_entries, session);
-    g_autofree gchar *seat_path = NULL;
-    if (entry)
-    {
-        g_dbus_connection_unregister_object (service->priv->bus, entry->bus_id);
-        emit_object_signal (service->priv->bus, "/org/freedesktop/DisplayManager", "SessionRemoved", entry->path);
-        emit_object_signal (service->priv->bus, entry->seat_path, "SessionRemoved", entry->path);
-        seat_path = g_strdup (entry->seat_path);
-    }
+    if (!entry)
+        return;
 
-    g_hash_table_remove (service->priv->session_bus_entries, session);
+    g_dbus_connection_unregister_object (service->priv->bus, entry->bus_id);
+    emit_interfaces_removed (service, entry->path, "org.freedesktop.DisplayManager.Session");
+    emit_object_signal (service->priv->bus, "/org/freedesktop/DisplayManager", "SessionRemoved", entry->path);
+    emit_object_signal (service->priv->bus, entry->seat_path, "SessionRemoved", entry->path);
 
-    if (seat_path)
-    {
-        emit_object_value_changed (service->priv->bus, "/org/freedesktop/DisplayManager", "org.freedesktop.DisplayManager", "Sessions", get_session_list (service, NULL));
-        emit_object_value_changed (service->priv->bus, seat_path, "org.freedesktop.DisplayManager.Seat", "Sessions", get_session_list (service, seat_path));
-    }
+    g_queue_unlink (&service->priv->session_entries, &entry->link);
+    if (entry->seat_entry)
+        g_queue_unlink (&entry->seat_entry->sessions, &entry->seat_link);
+    sessions_changed (service, entry->seat_entry);
+
+    g_hash_table_remove (service->priv->session_bus_entries, session);
 }
 
 static void
@@ -468,6 +690,7 @@ seat_added_cb (DisplayManager *display_manager, Seat *seat, DisplayManagerServic
 
     SeatBusEntry *entry = seat_bus_entry_new (service, seat, path);
     g_hash_table_insert (service->priv->seat_bus_entries, g_object_ref (seat), entry);
+    g_queue_push_tail_link (&service->priv->seat_entries, &entry->link);
 
     g_debug ("Registering seat with bus path %s", entry->path);
 
@@ -486,7 +709,8 @@ seat_added_cb (DisplayManager *display_manager, Seat *seat, DisplayManagerServic
     if (entry->bus_id == 0)
         g_warning ("Failed to register seat: %s", error->message);
 
-    emit_object_value_changed (service->priv->bus, "/org/freedesktop/DisplayManager", "org.freedesktop.DisplayManager", "Seats", get_seat_list (service));
+    seats_changed (service);
+    emit_interfaces_added (service, entry->path, get_seat_interfaces (entry));
     emit_object_signal (service->priv->bus, "/org/freedesktop/DisplayManager", "SeatAdded", entry->path);
 
     g_signal_connect (seat, SEAT_SIGNAL_RUNNING_USER_SESSION, G_CALLBACK (running_user_session_cb), service);
@@ -497,15 +721,25 @@ static void
 seat_removed_cb (DisplayManager *display_manager, Seat *seat, DisplayManagerService *service)
 {
     SeatBusEntry *entry = g_hash_table_lookup (service->priv->seat_bus_entries, seat);
-    if (entry)
+    if (!entry)
+        return;
+
+    g_dbus_connection_unregister_object (service->priv->bus, entry->bus_id);
+    emit_interfaces_removed (service, entry->path, "org.freedesktop.DisplayManager.Seat");
+    emit_object_signal (service->priv->bus, "/org/freedesktop/DisplayManager", "SeatRemoved", entry->path);
+
+    /* Any sessions left no longer have a seat to be listed on */
+    while (entry->sessions.head)
     {
-        g_dbus_connection_unregister_object (service->priv->bus, entry->bus_id);
-        emit_object_signal (service->priv->bus, "/org/freedesktop/DisplayManager", "SeatRemoved", entry->path);
+        SessionBusEntry *session_entry = entry->sessions.head->data;
+        g_queue_unlink (&entry->sessions, &session_entry->seat_link);
+        session_entry->seat_entry = NULL;
     }
+    service->priv->changed_seat_entries = g_list_remove (service->priv->changed_seat_entries, entry);
+    g_queue_unlink (&service->priv->seat_entries, &entry->link);
+    seats_changed (service);
 
     g_hash_table_remove (service->priv->seat_bus_entries, seat);
-
-    emit_object_value_changed (service->priv->bus, "/org/freedesktop/DisplayManager", "org.freedesktop.DisplayManager", "Seats", get_seat_list (service));
 }
 
 static void
@@ -546,6 +780,19 @@ bus_acquired_cb (GDBusConnection *connection,
         "      <arg name='session' type='o'/>"
         "    </signal>"
         "  </interface>"
+        "  <interface name='org.freedesktop.DBus.ObjectManager'>"
+        "    <method name='GetManagedObjects'>"
+        "      <arg name='objects' direction='out' type='a{oa{sa{sv}}}'/>"
+        "    </method>"
+        "    <signal name='InterfacesAdded'>"
+        "      <arg name='object' type='o'/>"
+        "      <arg name='interfaces' type='a{sa{sv}}'/>"
+        "    </signal>"
+        "    <signal name='InterfacesRemoved'>"
+        "      <arg name='object' type='o'/>"
+        "      <arg name='interfaces' type='as'/>"
+        "    </signal>"
+        "  </interface>"
         "</node>";
     GDBusNodeInfo *display_manager_info = g_dbus_node_info_new_for_xml (display_manager_interface, NULL);
     g_assert (display_manager_info != NULL);
@@ -601,6 +848,21 @@ bus_acquired_cb (GDBusConnection *connection,
                                                                &error);
     if (service->priv->reg_id == 0)
         g_warning ("Failed to register display manager: %s", error->message);
+    g_clear_error (&error);
+
+    static const GDBusInterfaceVTable object_manager_vtable =
+    {
+        handle_object_manager_call,
+        NULL
+    };
+    service->priv->object_manager_reg_id = g_dbus_connection_register_object (connection,
+                                                                              "/org/freedesktop/DisplayManager",
+                                                                              display_manager_info->interfaces[1],
+                                                                              &object_manager_vtable,
+                                                                              service, NULL,
+                                                                              &error);
+    if (service->priv->object_manager_reg_id == 0)
+        g_warning ("Failed to register object manager: %s", error->message);
     g_dbus_node_info_unref (display_manager_info);
 
     /* Add objects for existing seats and listen to new ones */
@@ -609,6 +871,9 @@ bus_acquired_cb (GDBusConnection *connection,
     for (GList *link = display_manager_get_seats (service->priv->manager); link; link = link->next)
         seat_added_cb (service->priv->manager, (Seat *) link->data, service);
 
+    /* Announce the existing seats before anyone can see the bus name */
+    emit_changes (service);
+
     g_signal_emit (service, signals[READY], 0);
 }
 
@@ -649,6 +914,8 @@ display_manager_service_init (DisplayManagerService *service)
     service->priv = G_TYPE_INSTANCE_GET_PRIVATE (service, DISPLAY_MANAGER_SERVICE_TYPE, DisplayManagerServicePrivate);
     service->priv->seat_bus_entries = g_hash_table_new_full (g_direct_hash, g_direct_equal, g_object_unref, seat_bus_entry_free);
     service->priv->session_bus_entries = g_hash_table_new_full (g_direct_hash, g_direct_equal, g_object_unref, session_bus_entry_free);
+    g_queue_init (&service->priv->seat_entries);
+    g_queue_init (&service->priv->session_entries);
 }
 
 static void
@@ -656,7 +923,10 @@ display_manager_service_finalize (GObject *object)
 {
     DisplayManagerService *self = DISPLAY_MANAGER_SERVICE (object);
 
+    if (self->priv->emit_changes_id)
+        g_source_remove (self->priv->emit_changes_id);
     g_dbus_connection_unregister_object (self->priv->bus, self->priv->reg_id);
+    g_dbus_connection_unregister_object (self->priv->bus, self->priv->object_manager_reg_id);
     g_bus_unown_name (self->priv->bus_id);
     if (self->priv->seat_info)
         g_dbus_node_info_unref (self->priv->seat_info);
@@ -664,6 +934,9 @@ display_manager_service_finalize (GObject *object)
         g_dbus_node_info_unref (self->priv->session_info);
     g_hash_table_unref (self->priv->seat_bus_entries);
     g_hash_table_unref (self->priv->session_bus_entries);
+    g_list_free (self->priv->changed_seat_entries);
+    g_clear_pointer (&self->priv->seats_value, g_variant_unref);
+    g_clear_pointer (&self->priv->sessions_value, g_variant_unref);
     g_object_unref (self->priv->bus);
     g_clear_object (&self->priv->manager);
 
@@ -115,11 +115,9 @@ display_manager_add_seat (DisplayManager *manager, Seat *seat)
     return TRUE;
 }
 
-void
-display_manager_start (DisplayManager *manager)
+static void
+plymouth_status_cb (gpointer data)
 {
-    g_return_if_fail (manager != NULL);
-
     /* Disable Plymouth if no X servers are replacing it */
     if (plymouth_get_is_active ())
     {
@@ -128,6 +126,15 @@ display_manager_start (DisplayManager *manager)
     }
 }
 
+void
+display_manager_start (DisplayManager *manager)
+{
+    g_return_if_fail (manager != NULL);
+
+    /* Waiters are called in order, so seats started before this get the chance to replace Plymouth */
+    plymouth_wait_for_status (FALSE, plymouth_status_cb, NULL);
+}
+
 void
 display_manager_stop (DisplayManager *manager)
 {
@@ -152,6 +159,13 @@ display_manager_stop (DisplayManager *manager)
     check_stopped (manager);
 }
 
+gboolean
+display_manager_get_is_stopping (DisplayManager *manager)
+{
+    g_return_val_if_fail (manager != NULL, FALSE);
+    return manager->priv->stopping;
+}
+
 static void
 display_manager_init (DisplayManager *manager)
 {
@@ -12,13 +12,26 @@
 #include <config.h>
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include <glib.h>
 #include <glib/gi18n.h>
 #include <gio/gio.h>
 
+#define DISPLAY_MANAGER_PATH "/org/freedesktop/DisplayManager"
+#define SEAT_INTERFACE "org.freedesktop.DisplayManager.Seat"
+#define SESSION_INTERFACE "org.freedesktop.DisplayManager.Session"
+
 static GBusType bus_type = G_BUS_TYPE_SYSTEM;
 static GDBusProxy *dm_proxy, *seat_proxy = NULL;
 
+/* TRUE if output should be JSON instead of text */
+static gboolean json_output = FALSE;
+
+/* TRUE if reading commands from stdin */
+static gboolean batch_mode = FALSE;
+
 static gint xephyr_display_number;
 static GPid xephyr_pid;
 
@@ -30,6 +43,142 @@ usage (void)
     g_printerr ("\n");
 }
 
+static void
+append_json_string (GString *text, const gchar *value)
+{
+    g_string_append_c (text, '"');
+    for (const gchar *c = value; *c; c++)
+    {
+        switch (*c)
+        {
+        case '"':
+            g_string_append (text, "\\\"");
+            break;
+        case '\\':
+            g_string_append (text, "\\\\");
+            break;
+        case '\n':
+            g_string_append (text, "\\n");
+            break;
+        case '\r':
+            g_string_append (text, "\\r");
+            break;
+        case '\t':
+            g_string_append (text, "\\t");
+            break;
+        default:
+            if ((guchar) *c < 0x20)
+                g_string_append_printf (text, "\\u%04x", (guchar) *c);
+            else
+                g_string_append_c (text, *c);
+            break;
+        }
+    }
+    g_string_append_c (text, '"');
+}
+
+static void
+append_json_value (GString *text, GVariant *value)
+{
+    switch (g_variant_classify (value))
+    {
+    case G_VARIANT_CLASS_BOOLEAN:
+        g_string_append (text, g_variant_get_boolean (value) ? "true" : "false");
+        break;
+    case G_VARIANT_CLASS_BYTE:
+        g_string_append_printf (text, "%u", g_variant_get_byte (value));
+        break;
+    case G_VARIANT_CLASS_INT16:
+        g_string_append_printf (text, "%d", g_variant_get_int16 (value));
+        break;
+    case G_VARIANT_CLASS_UINT16:
+        g_string_append_printf (text, "%u", g_variant_get_uint16 (value));
+        break;
+    case G_VARIANT_CLASS_INT32:
+        g_string_append_printf (text, "%d", g_variant_get_int32 (value));
+        break;
+    case G_VARIANT_CLASS_UINT32:
+        g_string_append_printf (text, "%u", g_variant_get_uint32 (value));
+        break;
+    case G_VARIANT_CLASS_INT64:
+        g_string_append_printf (text, "%" G_GINT64_FORMAT, g_variant_get_int64 (value));
+        break;
+    case G_VARIANT_CLASS_UINT64:
+        g_string_append_printf (text, "%" G_GUINT64_FORMAT, g_variant_get_uint64 (value));
+        break;
+    case G_VARIANT_CLASS_DOUBLE:
+    {
+        gchar buffer[G_ASCII_DTOSTR_BUF_SIZE];
+        g_string_append (text, g_ascii_dtostr (buffer, sizeof (buffer), g_variant_get_double (value)));
+        break;
+    }
+    case G_VARIANT_CLASS_STRING:
+    case G_VARIANT_CLASS_OBJECT_PATH:
+    case G_VARIANT_CLASS_SIGNATURE:
+        append_json_string (text, g_variant_get_string (value, NULL));
+        break;
+    case G_VARIANT_CLASS_VARIANT:
+    {
+        g_autoptr(GVariant) child = g_variant_get_variant (value);
+        append_json_value (text, child);
+        break;
+    }
+    case G_VARIANT_CLASS_MAYBE:
+    {
+        g_autoptr(GVariant) child = g_variant_get_maybe (value);
+        if (child)
+            append_json_value (text, child);
+        else
+            g_string_append (text, "null");
+        break;
+    }
+    case G_VARIANT_CLASS_ARRAY:
+    case G_VARIANT_CLASS_TUPLE:
+    case G_VARIANT_CLASS_DICT_ENTRY:
+    {
+        /* Dictionaries with string keys are objects, everything else is an array */
+        gboolean is_object = g_variant_is_of_type (value, G_VARIANT_TYPE ("a{s*}"));
+        g_string_append_c (text, is_object ? '{' : '[');
+        gsize n_children = g_variant_n_children (value);
+        for (gsize i = 0; i < n_children; i++)
+        {
+            g_autoptr(GVariant) child = g_variant_get_child_value (value, i);
+            if (i != 0)
+                g_string_append_c (text, ',');
+            if (is_object)
+            {
+                g_autoptr(GVariant) key = g_variant_get_child_value (child, 0);
+                g_autoptr(GVariant) child_value = g_variant_get_child_value (child, 1);
+                append_json_string (text, g_variant_get_string (key, NULL));
+                g_string_append_c (text, ':');
+                append_json_value (text, child_value);
+            }
+            else
+                append_json_value (text, child);
+        }
+        g_string_append_c (text, is_object ? '}' : ']');
+        break;
+    }
+    default:
+        g_string_append (text, "null");
+        break;
+    }
+}
+
+static void
+print_path (const gchar *path)
+{
+    if (json_output)
+    {
+        g_autoptr(GString) text = g_string_new ("{\"path\":");
+        append_json_string (text, path);
+        g_string_append (text, "}");
+        g_print ("%s\n", text->str);
+    }
+    else
+        g_print ("%s\n", path);
+}
+
 static void
 xephyr_setup_cb (gpointer user_data)
 {
@@ -62,7 +211,7 @@ xephyr_signal_cb (int signum)
 
     const gchar *path = NULL;
     g_variant_get (result, "(&o)", &path);
-    g_print ("%s\n", path);
+    print_path (path);
 
     exit (EXIT_SUCCESS);
 }
@@ -76,126 +225,183 @@ get_seat_proxy (void)
     if (!g_getenv ("XDG_SEAT_PATH"))
     {
         g_printerr ("Not running inside a display manager, XDG_SEAT_PATH not defined\n");
-        exit (EXIT_FAILURE);
+        return NULL;
     }
 
+    /* Only used to call methods, so don't spend round trips fetching properties */
     g_autoptr(GError) error = NULL;
-    seat_proxy = g_dbus_proxy_new_for_bus_sync (bus_type,
-                                                G_DBUS_PROXY_FLAGS_NONE,
-                                                NULL,
-                                                "org.freedesktop.DisplayManager",
-                                                g_getenv ("XDG_SEAT_PATH"),
-                                                "org.freedesktop.DisplayManager.Seat",
-                                                NULL,
-                                                &error);
+    seat_proxy = g_dbus_proxy_new_sync (g_dbus_proxy_get_connection (dm_proxy),
+                                        G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES | G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+                                        NULL,
+                                        "org.freedesktop.DisplayManager",
+                                        g_getenv ("XDG_SEAT_PATH"),
+                                        SEAT_INTERFACE,
+                                        NULL,
+                                        &error);
     if (!seat_proxy)
-    {
         g_printerr ("Unable to contact display manager: %s\n", error->message);
-        exit (EXIT_FAILURE);
-    }
 
     return seat_proxy;
 }
 
-int
-main (int argc, char **argv)
+static const gchar *
+get_object_name (const gchar *path)
 {
-#if !defined(GLIB_VERSION_2_36)
-    g_type_init ();
-#endif
+    if (g_str_has_prefix (path, DISPLAY_MANAGER_PATH "/"))
+        return path + strlen (DISPLAY_MANAGER_PATH "/");
+    else
+        return path;
+}
 
-    gint arg_index;
-    for (arg_index = 1; arg_index < argc; arg_index++)
+static void
+append_object (GString *text, const gchar *path, GVariant *properties, const gchar *hidden_property, const gchar *indent)
+{
+    if (json_output)
     {
-        gchar *arg = argv[arg_index];
-
-        if (!g_str_has_prefix (arg, "-"))
-            break;
+        g_string_append (text, "{\"name\":");
+        append_json_string (text, get_object_name (path));
+        g_string_append (text, ",\"path\":");
+        append_json_string (text, path);
+    }
+    else
+        g_string_append_printf (text, "%s%s\n", indent, get_object_name (path));
+
+    GVariantIter iter;
+    const gchar *name;
+    GVariant *value;
+    g_variant_iter_init (&iter, properties);
+    while (g_variant_iter_loop (&iter, "{&sv}", &name, &value))
+    {
+        if (strcmp (name, hidden_property) == 0)
+            continue;
 
-        if (strcmp (arg, "-h") == 0 || strcmp (arg, "--help") == 0)
-        {
-            g_printerr ("Usage:\n"
-                        "  dm-tool [OPTION...] COMMAND [ARGS...] - Display Manager tool\n"
-                        "\n"
-                        "Options:\n"
-                        "  -h, --help        Show help options\n"
-                        "  -v, --version     Show release version\n"
-                        "  --session-bus     Use session D-Bus\n"
-                        "\n"
-                        "Commands:\n"
-                        "  switch-to-greeter                                    Switch to the greeter\n"
-                        "  switch-to-user USERNAME [SESSION]                    Switch to a user session\n"
-                        "  switch-to-guest [SESSION]                            Switch to a guest session\n"
-                        "  lock                                                 Lock the current seat\n"
-                        "  list-seats                                           List the active seats\n"
-                        "  add-nested-seat [--fullscreen|--screen DIMENSIONS]   Start a nested display\n"
-                        "  add-local-x-seat DISPLAY_NUMBER                      Add a local X seat\n"
-                        "  add-seat TYPE [NAME=VALUE...]                        Add a dynamic seat\n");
-            return EXIT_SUCCESS;
-        }
-        else if (strcmp (arg, "-v") == 0 || strcmp (arg, "--version") == 0)
+        if (json_output)
         {
-            /* NOTE: Is not translated so can be easily parsed */
-            g_printerr ("lightdm %s\n", VERSION);
-            return EXIT_SUCCESS;
+            g_string_append_c (text, ',');
+            append_json_string (text, name);
+            g_string_append_c (text, ':');
+            append_json_value (text, value);
         }
-        else if (strcmp (arg, "--session-bus") == 0)
-            bus_type = G_BUS_TYPE_SESSION;
         else
         {
-            g_printerr ("Unknown option %s\n", arg);
-            usage ();
-            return EXIT_FAILURE;
+            g_autofree gchar *value_text = g_variant_print (value, FALSE);
+            g_string_append_printf (text, "%s  %s=%s\n", indent, name, value_text);
         }
     }
+}
 
-    if (arg_index >= argc)
+static gboolean
+list_seats (void)
+{
+    /* Get every seat and session with their properties in a single call */
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GVariant) result = g_dbus_connection_call_sync (g_dbus_proxy_get_connection (dm_proxy),
+                                                              "org.freedesktop.DisplayManager",
+                                                              DISPLAY_MANAGER_PATH,
+                                                              "org.freedesktop.DBus.ObjectManager",
+                                                              "GetManagedObjects",
+                                                              NULL,
+                                                              G_VARIANT_TYPE ("(a{oa{sa{sv}}})"),
+                                                              G_DBUS_CALL_FLAGS_NONE,
+                                                              -1,
+                                                              NULL,
+                                                              &error);
+    if (!result)
     {
-        g_printerr ("Missing command\n");
-        usage ();
-        return EXIT_FAILURE;
+        g_printerr ("Unable to contact display manager: %s\n", error->message);
+        return FALSE;
+    }
+    g_autoptr(GVariant) objects = g_variant_get_child_value (result, 0);
+
+    /* Index the sessions so they can be listed under the seat they are on */
+    g_autoptr(GHashTable) sessions = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) g_variant_unref);
+    GVariantIter iter;
+    const gchar *path;
+    GVariant *interfaces;
+    g_variant_iter_init (&iter, objects);
+    while (g_variant_iter_loop (&iter, "{&o@a{sa{sv}}}", &path, &interfaces))
+    {
+        GVariant *properties = g_variant_lookup_value (interfaces, SESSION_INTERFACE, G_VARIANT_TYPE ("a{sv}"));
+        if (properties)
+            g_hash_table_insert (sessions, (gpointer) path, properties);
     }
 
-    g_autoptr(GError) error = NULL;
-    dm_proxy = g_dbus_proxy_new_for_bus_sync (bus_type,
-                                              G_DBUS_PROXY_FLAGS_NONE,
-                                              NULL,
-                                              "org.freedesktop.DisplayManager",
-                                              "/org/freedesktop/DisplayManager",
-                                              "org.freedesktop.DisplayManager",
-                                              NULL,
-                                              &error);
-    if (!dm_proxy)
+    g_autoptr(GString) text = g_string_new (json_output ? "{\"seats\":[" : "");
+    gboolean first_seat = TRUE;
+    g_variant_iter_init (&iter, objects);
+    while (g_variant_iter_loop (&iter, "{&o@a{sa{sv}}}", &path, &interfaces))
     {
-        g_printerr ("Unable to contact display manager: %s\n", error->message);
-        return EXIT_FAILURE;
+        g_autoptr(GVariant) properties = g_variant_lookup_value (interfaces, SEAT_INTERFACE, G_VARIANT_TYPE ("a{sv}"));
+        if (!properties)
+            continue;
+
+        if (json_output && !first_seat)
+            g_string_append_c (text, ',');
+        first_seat = FALSE;
+        append_object (text, path, properties, "Sessions", "");
+
+        if (json_output)
+            g_string_append (text, ",\"sessions\":[");
+        g_autoptr(GVariant) session_paths = g_variant_lookup_value (properties, "Sessions", G_VARIANT_TYPE ("ao"));
+        gboolean first_session = TRUE;
+        gsize n_sessions = session_paths ? g_variant_n_children (session_paths) : 0;
+        for (gsize i = 0; i < n_sessions; i++)
+        {
+            const gchar *session_path;
+            g_variant_get_child (session_paths, i, "&o", &session_path);
+            GVariant *session_properties = g_hash_table_lookup (sessions, session_path);
+            if (!session_properties)
+                continue;
+
+            if (json_output && !first_session)
+                g_string_append_c (text, ',');
+            first_session = FALSE;
+            append_object (text, session_path, session_properties, "Seat", "  ");
+            if (json_output)
+                g_string_append_c (text, '}');
+        }
+        if (json_output)
+            g_string_append (text, "]}");
     }
+    if (json_output)
+        g_string_append (text, "]}\n");
+
+    g_print ("%s", text->str);
+
+    return TRUE;
+}
+
+static gboolean
+run_command (const gchar *command, gint n_options, gchar **options)
+{
+    g_autoptr(GError) error = NULL;
 
-    const gchar *command = argv[arg_index];
-    arg_index++;
-    gint n_options = argc - arg_index;
-    gchar **options = argv + arg_index;
     if (strcmp (command, "switch-to-greeter") == 0)
     {
         if (n_options != 0)
         {
             g_printerr ("Usage switch-to-greeter\n");
             usage ();
-            return EXIT_FAILURE;
+            return FALSE;
         }
 
-        if (!g_dbus_proxy_call_sync (get_seat_proxy (),
-                                     "SwitchToGreeter",
-                                     g_variant_new ("()"),
-                                     G_DBUS_CALL_FLAGS_NONE,
-                                     -1,
-                                     NULL,
-                                     &error))
+        GDBusProxy *proxy = get_seat_proxy ();
+        if (!proxy)
+            return FALSE;
+
+        g_autoptr(GVariant) result = g_dbus_proxy_call_sync (proxy,
+                                                             "SwitchToGreeter",
+                                                             g_variant_new ("()"),
+                                                             G_DBUS_CALL_FLAGS_NONE,
+                                                             -1,
+                                                             NULL,
+                                                             &error);
+        if (!result)
         {
             g_printerr ("Unable to switch to greeter: %s\n", error->message);
-            return EXIT_FAILURE;
+            return FALSE;
         }
-        return EXIT_SUCCESS;
+        return TRUE;
     }
     else if (strcmp (command, "switch-to-user") == 0)
     {
@@ -203,7 +409,7 @@ main (int argc, char **argv)
         {
             g_printerr ("Usage switch-to-user USERNAME [SESSION]\n");
             usage ();
-            return EXIT_FAILURE;
+            return FALSE;
         }
 
         const gchar *username = options[0];
@@ -211,18 +417,23 @@ main (int argc, char **argv)
         if (n_options == 2)
             session = options[1];
 
-        if (!g_dbus_proxy_call_sync (get_seat_proxy (),
-                                     "SwitchToUser",
-                                     g_variant_new ("(ss)", username, session),
-                                     G_DBUS_CALL_FLAGS_NONE,
-                                     -1,
-                                     NULL,
-                                     &error))
+        GDBusProxy *proxy = get_seat_proxy ();
+        if (!proxy)
+            return FALSE;
+
+        g_autoptr(GVariant) result = g_dbus_proxy_call_sync (proxy,
+                                                             "SwitchToUser",
+                                                             g_variant_new ("(ss)", username, session),
+                                                             G_DBUS_CALL_FLAGS_NONE,
+                                                             -1,
+                                                             NULL,
+                                                             &error);
+        if (!result)
         {
             g_printerr ("Unable to switch to user %s: %s\n", username, error->message);
-            return EXIT_FAILURE;
+            return FALSE;
         }
-        return EXIT_SUCCESS;
+        return TRUE;
     }
     else if (strcmp (command, "switch-to-guest") == 0)
     {
@@ -230,25 +441,30 @@ main (int argc, char **argv)
         {
             g_printerr ("Usage switch-to-guest [SESSION]\n");
             usage ();
-            return EXIT_FAILURE;
+            return FALSE;
         }
 
         const gchar *session = "";
         if (n_options == 1)
             session = options[0];
 
-        if (!g_dbus_proxy_call_sync (get_seat_proxy (),
-                                     "SwitchToGuest",
-                                     g_variant_new ("(s)", session),
-                                     G_DBUS_CALL_FLAGS_NONE,
-                                     -1,
-                                     NULL,
-                                     &error))
+        GDBusProxy *proxy = get_seat_proxy ();
+        if (!proxy)
+            return FALSE;
+
+        g_autoptr(GVariant) result = g_dbus_proxy_call_sync (proxy,
+                                                             "SwitchToGuest",
+                                                             g_variant_new ("(s)", session),
+                                                             G_DBUS_CALL_FLAGS_NONE,
+                                                             -1,
+                                                             NULL,
+                                                             &error);
+        if (!result)
         {
             g_printerr ("Unable to switch to guest: %s\n", error->message);
-            return EXIT_FAILURE;
+            return FALSE;
         }
-        return EXIT_SUCCESS;
+        return TRUE;
     }
     else if (strcmp (command, "lock") == 0)
     {
@@ -256,116 +472,52 @@ main (int argc, char **argv)
         {
             g_printerr ("Usage lock\n");
             usage ();
-            return EXIT_FAILURE;
+            return FALSE;
         }
 
-        if (!g_dbus_proxy_call_sync (get_seat_proxy (),
-                                     "Lock",
-                                     g_variant_new ("()"),
-                                     G_DBUS_CALL_FLAGS_NONE,
-                                     -1,
-                                     NULL,
-                                     &error))
+        GDBusProxy *proxy = get_seat_proxy ();
+        if (!proxy)
+            return FALSE;
+
+        g_autoptr(GVariant) result = g_dbus_proxy_call_sync (proxy,
+                                                             "Lock",
+                                                             g_variant_new ("()"),
+                                                             G_DBUS_CALL_FLAGS_NONE,
+                                                             -1,
+                                                             NULL,
+                                                             &error);
+        if (!result)
         {
             g_printerr ("Unable to lock seat: %s\n", error->message);
-            return EXIT_FAILURE;
+            return FALSE;
         }
-        return EXIT_SUCCESS;
+        return TRUE;
     }
     else if (strcmp (command, "list-seats") == 0)
     {
-        if (!g_dbus_proxy_get_name_owner (dm_proxy))
-        {
-            g_printerr ("Unable to contact display manager\n");
-            return EXIT_FAILURE;
-        }
-        g_autoptr(GVariant) seats = g_dbus_proxy_get_cached_property (dm_proxy, "Seats");
-
-        g_autoptr(GVariantIter) seat_iter = NULL;
-        g_variant_get (seats, "ao", &seat_iter);
-        gchar *seat_path;
-        while (g_variant_iter_loop (seat_iter, "&o", &seat_path))
+        if (n_options != 0)
         {
-            gchar *seat_name;
-            g_autoptr(GDBusProxy) proxy = NULL;
-
-            if (g_str_has_prefix (seat_path, "/org/freedesktop/DisplayManager/"))
-                seat_name = seat_path + strlen ("/org/freedesktop/DisplayManager/");
-            else
-                seat_name = seat_path;
-
-            proxy = g_dbus_proxy_new_sync (g_dbus_proxy_get_connection (dm_proxy),
-                                           G_DBUS_PROXY_FLAGS_NONE,
-                                           NULL,
-                                           "org.freedesktop.DisplayManager",
-                                           seat_path,
-                                           "org.freedesktop.DisplayManager.Seat",
-                                           NULL,
-                                           NULL);
-            if (!proxy || !g_dbus_proxy_get_name_owner (proxy))
-                continue;
-
-            g_print ("%s\n", seat_name);
-            g_auto(GStrv) property_names = g_dbus_proxy_get_cached_property_names (proxy);
-            for (int i = 0; property_names[i]; i++)
-            {
-                if (strcmp (property_names[i], "Sessions") == 0)
-                    continue;
-
-                g_autoptr(GVariant) value = g_dbus_proxy_get_cached_property (proxy, property_names[i]);
-                g_print ("  %s=%s\n", property_names[i], g_variant_print (value, FALSE));
-            }
-
-            g_autoptr(GVariant) sessions = g_dbus_proxy_get_cached_property (proxy, "Sessions");
-            if (!sessions)
-                continue;
-
-            g_autoptr(GVariantIter) session_iter = NULL;
-            g_variant_get (sessions, "ao", &session_iter);
-            const gchar *session_path;
-            while (g_variant_iter_loop (session_iter, "&o", &session_path))
-            {
-                const gchar *session_name;
-                if (g_str_has_prefix (session_path, "/org/freedesktop/DisplayManager/"))
-                    session_name = session_path + strlen ("/org/freedesktop/DisplayManager/");
-                else
-                    session_name = session_path;
-
-                g_autoptr(GDBusProxy) session_proxy = g_dbus_proxy_new_sync (g_dbus_proxy_get_connection (dm_proxy),
-                                                                             G_DBUS_PROXY_FLAGS_NONE,
-                                                                             NULL,
-                                                                             "org.freedesktop.DisplayManager",
-                                                                             session_path,
-                                                                             "org.freedesktop.DisplayManager.Session",
-                                                                             NULL,
-                                                                             NULL);
-                if (!session_proxy || !g_dbus_proxy_get_name_owner (session_proxy))
-                    continue;
-
-                g_print ("  %s\n", session_name);
-                g_auto(GStrv) property_names = g_dbus_proxy_get_cached_property_names (session_proxy);
-                for (int i = 0; property_names[i]; i++)
-                {
-                    if (strcmp (property_names[i], "Seat") == 0)
-                        continue;
-
-                    g_autoptr(GVariant) value = g_dbus_proxy_get_cached_property (session_proxy, property_names[i]);
-                    g_print ("    %s=%s\n", property_names[i], g_variant_print (value, FALSE));
-                }
-            }
-            g_variant_iter_free (session_iter);
+            g_printerr ("Usage list-seats\n");
+            usage ();
+            return FALSE;
         }
-        g_variant_iter_free (seat_iter);
 
-        return EXIT_SUCCESS;
+        return list_seats ();
     }
     else if (strcmp (command, "add-nested-seat") == 0)
     {
+        /* Xephyr reports it is ready with a signal, which ends the process */
+        if (batch_mode)
+        {
+            g_printerr ("add-nested-seat can't be used in batch mode\n");
+            return FALSE;
+        }
+
         const gchar *path = g_find_program_in_path ("Xephyr");
         if (!path)
         {
             g_printerr ("Unable to find Xephyr, please install it\n");
-            return EXIT_FAILURE;
+            return FALSE;
         }
 
         const gchar *dimensions = NULL;
@@ -384,7 +536,7 @@ main (int argc, char **argv)
             {
                 g_printerr ("Usage add-nested-seat [--fullscreen|--screen DIMENSIONS]\n");
                 usage ();
-                return EXIT_FAILURE;
+                return FALSE;
             }
         }
 
@@ -431,6 +583,7 @@ main (int argc, char **argv)
         /* Block until ready */
         g_autoptr(GMainLoop) loop = g_main_loop_new (NULL, FALSE);
         g_main_loop_run (loop);
+        return TRUE;
     }
     else if (strcmp (command, "add-local-x-seat") == 0)
     {
@@ -438,7 +591,7 @@ main (int argc, char **argv)
         {
             g_printerr ("Usage add-seat DISPLAY_NUMBER\n");
             usage ();
-            return EXIT_FAILURE;
+            return FALSE;
         }
 
         gint display_number = atoi (options[0]);
@@ -452,20 +605,20 @@ main (int argc, char **argv)
         if (!result)
         {
             g_printerr ("Unable to add local X seat: %s\n", error->message);
-            return EXIT_FAILURE;
+            return FALSE;
         }
 
         if (!g_variant_is_of_type (result, G_VARIANT_TYPE ("(o)")))
         {
             g_printerr ("Unexpected response to AddLocalXSeat: %s\n", g_variant_get_type_string (result));
-            return EXIT_FAILURE;
+            return FALSE;
         }
 
         const gchar *path;
         g_variant_get (result, "(&o)", &path);
-        g_print ("%s\n", path);
+        print_path (path);
 
-        return EXIT_SUCCESS;
+        return TRUE;
     }
     else if (strcmp (command, "add-seat") == 0)
     {
@@ -473,7 +626,7 @@ main (int argc, char **argv)
         {
             g_printerr ("Usage add-seat TYPE [NAME=VALUE...]\n");
             usage ();
-            return EXIT_FAILURE;
+            return FALSE;
         }
 
         const gchar *type = options[0];
@@ -505,23 +658,164 @@ main (int argc, char **argv)
         if (!result)
         {
             g_printerr ("Unable to add seat: %s\n", error->message);
-            return EXIT_FAILURE;
+            return FALSE;
         }
 
         if (!g_variant_is_of_type (result, G_VARIANT_TYPE ("(o)")))
         {
             g_printerr ("Unexpected response to AddSeat: %s\n", g_variant_get_type_string (result));
-            return EXIT_FAILURE;
+            return FALSE;
         }
 
         const gchar *path;
         g_variant_get (result, "(&o)", &path);
-        g_print ("%s\n", path);
+        print_path (path);
 
-        return EXIT_SUCCESS;
+        return TRUE;
     }
 
     g_printerr ("Unknown command %s\n", command);
     usage ();
-    return EXIT_FAILURE;
+    return FALSE;
+}
+
+static gboolean
+run_batch (void)
+{
+    /* Read one command per line and run them all over the same connection */
+    g_autoptr(GIOChannel) channel = g_io_channel_unix_new (STDIN_FILENO);
+    g_io_channel_set_encoding (channel, NULL, NULL);
+
+    gboolean result = TRUE;
+    while (TRUE)
+    {
+        g_autoptr(GError) error = NULL;
+        g_autofree gchar *line = NULL;
+        GIOStatus status = g_io_channel_read_line (channel, &line, NULL, NULL, &error);
+        if (status == G_IO_STATUS_EOF)
+            break;
+        if (status != G_IO_STATUS_NORMAL)
+        {
+            g_printerr ("Error reading commands: %s\n", error ? error->message : "Unknown error");
+            return FALSE;
+        }
+
+        g_strstrip (line);
+        if (line[0] == '\0' || line[0] == '#')
+            continue;
+
+        gint n_args;
+        g_auto(GStrv) args = NULL;
+        if (!g_shell_parse_argv (line, &n_args, &args, &error))
+        {
+            g_printerr ("Invalid command %s: %s\n", line, error->message);
+            result = FALSE;
+            continue;
+        }
+
+        if (!run_command (args[0], n_args - 1, args + 1))
+            result = FALSE;
+
+        /* Let whatever is reading the output see each result as it completes */
+        fflush (stdout);
+    }
+
+    return result;
+}
+
+int
+main (int argc, char **argv)
+{
+#if !defined(GLIB_VERSION_2_36)
+    g_type_init ();
+#endif
+
+    gint arg_index;
+    for (arg_index = 1; arg_index < argc; arg_index++)
+    {
+        gchar *arg = argv[arg_index];
+
+        if (!g_str_has_prefix (arg, "-"))
+            break;
+
+        if (strcmp (arg, "-h") == 0 || strcmp (arg, "--help") == 0)
+        {
+            g_printerr ("Usage:\n"
+                        "  dm-tool [OPTION...] COMMAND [ARGS...] - Display Manager tool\n"
+                        "  dm-tool [OPTION...] --batch - Run commands read from standard input\n"
+                        "\n"
+                        "Options:\n"
+                        "  -h, --help        Show help options\n"
+                        "  -v, --version     Show release version\n"
+                        "  --session-bus     Use session D-Bus\n"
+                        "  --batch           Run one command per line from standard input\n"
+                        "  --json            Print output as JSON\n"
+                        "\n"
+                        "Commands:\n"
+                        "  switch-to-greeter                                    Switch to the greeter\n"
+                        "  switch-to-user USERNAME [SESSION]                    Switch to a user session\n"
+                        "  switch-to-guest [SESSION]                            Switch to a guest session\n"
+                        "  lock                                                 Lock the current seat\n"
+                        "  list-seats                                           List the active seats\n"
+                        "  add-nested-seat [--fullscreen|--screen DIMENSIONS]   Start a nested display\n"
+                        "  add-local-x-seat DISPLAY_NUMBER                      Add a local X seat\n"
+                        "  add-seat TYPE [NAME=VALUE...]                        Add a dynamic seat\n");
+            return EXIT_SUCCESS;
+        }
+        else if (strcmp (arg, "-v") == 0 || strcmp (arg, "--version") == 0)
+        {
+            /* NOTE: Is not translated so can be easily parsed */
+            g_printerr ("lightdm %s\n", VERSION);
+            return EXIT_SUCCESS;
+        }
+        else if (strcmp (arg, "--session-bus") == 0)
+            bus_type = G_BUS_TYPE_SESSION;
+        else if (strcmp (arg, "--batch") == 0)
+            batch_mode = TRUE;
+        else if (strcmp (arg, "--json") == 0)
+            json_output = TRUE;
+        else
+        {
+            g_printerr ("Unknown option %s\n", arg);
+            usage ();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (batch_mode && arg_index < argc)
+    {
+        g_printerr ("Commands are read from standard input in batch mode\n");
+        usage ();
+        return EXIT_FAILURE;
+    }
+    if (!batch_mode && arg_index >= argc)
+    {
+        g_printerr ("Missing command\n");
+        usage ();
+        return EXIT_FAILURE;
+    }
+
+    /* Properties are never read from this proxy, so don't spend round trips fetching them */
+    g_autoptr(GError) error = NULL;
+    dm_proxy = g_dbus_proxy_new_for_bus_sync (bus_type,
+                                              G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES | G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+                                              NULL,
+                                              "org.freedesktop.DisplayManager",
+                                              DISPLAY_MANAGER_PATH,
+                                              "org.freedesktop.DisplayManager",
+                                              NULL,
+                                              &error);
+    if (!dm_proxy)
+    {
+        g_printerr ("Unable to contact display manager: %s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    gboolean result;
+    if (batch_mode)
+        result = run_batch ();
+    else
+        result = run_command (argv[arg_index], argc - arg_index - 1, argv + arg_index + 1);
+
+    return result ? EXIT_SUCCESS : EXIT_FAILURE;
 }
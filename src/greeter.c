@@ -81,8 +81,19 @@ struct GreeterPrivate
     GIOChannel *to_greeter_channel;
     GIOChannel *from_greeter_channel;
     guint from_greeter_watch;
+
+    /* Shared data directory requests in the order the greeter made them */
+    GQueue *shared_dir_requests;
 };
 
+/* A request for a shared data directory that may complete out of order */
+typedef struct
+{
+    Greeter *greeter;
+    gboolean complete;
+    gchar *dir;
+} SharedDirRequest;
+
 G_DEFINE_TYPE (Greeter, greeter, G_TYPE_OBJECT)
 
 #define API_VERSION 1
@@ -724,12 +735,8 @@ handle_set_language (Greeter *greeter, const gchar *language)
 }
 
 static void
-handle_ensure_shared_dir (Greeter *greeter, const gchar *username)
+send_shared_dir_result (Greeter *greeter, const gchar *dir)
 {
-    g_debug ("Greeter requests data directory for user %s", username);
-
-    g_autofree gchar *dir = shared_data_manager_ensure_user_dir (shared_data_manager_get_instance (), username);
-
     guint8 message[MAX_MESSAGE_LENGTH];
     gsize offset = 0;
     write_header (message, MAX_MESSAGE_LENGTH, SERVER_MESSAGE_SHARED_DIR_RESULT, string_length (dir), &offset);
@@ -737,6 +744,48 @@ handle_ensure_shared_dir (Greeter *greeter, const gchar *username)
     write_message (greeter, message, offset);
 }
 
+static void
+shared_dir_request_free (SharedDirRequest *request)
+{
+    g_free (request->dir);
+    g_free (request);
+}
+
+static void
+ensure_shared_dir_cb (GObject *object, GAsyncResult *result, gpointer data)
+{
+    SharedDirRequest *request = data;
+    g_autoptr(Greeter) greeter = request->greeter;
+
+    g_autoptr(GError) error = NULL;
+    request->dir = shared_data_manager_ensure_user_dir_finish (SHARED_DATA_MANAGER (object), result, &error);
+    if (error)
+        g_warning ("Failed to get data directory: %s", error->message);
+    request->complete = TRUE;
+
+    /* Reply in the same order as the requests were made */
+    SharedDirRequest *next;
+    while ((next = g_queue_peek_head (greeter->priv->shared_dir_requests)) && next->complete)
+    {
+        g_queue_pop_head (greeter->priv->shared_dir_requests);
+        if (greeter->priv->from_greeter_watch != 0)
+            send_shared_dir_result (greeter, next->dir);
+        shared_dir_request_free (next);
+    }
+}
+
+static void
+handle_ensure_shared_dir (Greeter *greeter, const gchar *username)
+{
+    g_debug ("Greeter requests data directory for user %s", username);
+
+    /* Set up directory in the background so other seats aren't blocked */
+    SharedDirRequest *request = g_malloc0 (sizeof (SharedDirRequest));
+    request->greeter = g_object_ref (greeter);
+    g_queue_push_tail (greeter->priv->shared_dir_requests, request);
+    shared_data_manager_ensure_user_dir_async (shared_data_manager_get_instance (), username, NULL, ensure_shared_dir_cb, request);
+}
+
 static guint32
 read_int (Greeter *greeter, gsize *offset)
 {
@@ -1011,6 +1060,7 @@ greeter_init (Greeter *greeter)
     greeter->priv->use_secure_memory = config_get_boolean (config_get_instance (), "LightDM", "lock-memory");
     greeter->priv->to_greeter_input = -1;
     greeter->priv->from_greeter_output = -1;
+    greeter->priv->shared_dir_requests = g_queue_new ();
 }
 
 static void
@@ -1037,6 +1087,7 @@ greeter_finalize (GObject *object)
         g_io_channel_unref (self->priv->from_greeter_channel);
     if (self->priv->from_greeter_watch)
         g_source_remove (self->priv->from_greeter_watch);
+    g_queue_free (self->priv->shared_dir_requests);
 
     G_OBJECT_CLASS (greeter_parent_class)->finalize (object);
 }
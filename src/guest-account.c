@@ -11,10 +11,41 @@
 
 #include <string.h>
 #include <ctype.h>
+#include <gio/gio.h>
 
 #include "guest-account.h"
 #include "configuration.h"
 
+/* Guest accounts that have been set up in advance and are ready to be claimed */
+static GQueue *ready_accounts = NULL;
+
+/* Setup script running in a worker thread to fill the pool */
+typedef struct
+{
+    GSubprocess *process;
+
+    /* Set with setup_lock held once the script has completed, NULL if it failed */
+    gboolean complete;
+    gchar *username;
+} PoolSetup;
+
+/* Setup scripts running in the background to fill the pool */
+static GQueue pending_setups = G_QUEUE_INIT;
+static GMutex setup_lock;
+static GCond setup_cond;
+
+/* Cleanup scripts running in the background */
+static GQueue pending_removals = G_QUEUE_INIT;
+
+/* Seconds to wait before filling the pool again after a setup failed */
+#define MIN_RETRY_DELAY 5
+#define MAX_RETRY_DELAY 300
+static guint retry_delay = 0;
+static guint retry_timeout = 0;
+
+/* TRUE once the pool has been cleaned up and should not be refilled */
+static gboolean pool_stopped = FALSE;
+
 static gchar *
 get_setup_script (void)
 {
@@ -38,6 +69,12 @@ guest_account_is_installed (void)
     return get_setup_script () != NULL;
 }
 
+static gint
+get_pool_size (void)
+{
+    return MAX (config_get_integer (config_get_instance (), "LightDM", "guest-account-pool-size"), 0);
+}
+
 static gboolean
 run_script (const gchar *script, gchar **stdout_text, gint *exit_status, GError **error)
 {
@@ -54,9 +91,157 @@ run_script (const gchar *script, gchar **stdout_text, gint *exit_status, GError
     return result;
 }
 
+static gchar *
+get_username_from_output (gchar *stdout_text)
+{
+    /* Use the last line and trim whitespace */
+    g_auto(GStrv) lines = g_strsplit (g_strstrip (stdout_text), "\n", -1);
+    g_autofree gchar *username = NULL;
+    if (lines)
+        username = g_strdup (g_strstrip (lines[g_strv_length (lines) - 1]));
+    else
+        username = g_strdup ("");
+
+    if (strcmp (username, "") == 0)
+    {
+        g_debug ("Guest account setup script didn't return a username");
+        return NULL;
+    }
+
+    return g_steal_pointer (&username);
+}
+
+static void fill_pool (void);
+
+static gboolean
+retry_fill_pool_cb (gpointer data)
+{
+    retry_timeout = 0;
+    fill_pool ();
+    return G_SOURCE_REMOVE;
+}
+
+/* Try again later, waiting longer each time so a broken script doesn't run constantly */
+static void
+retry_fill_pool (void)
+{
+    if (pool_stopped || retry_timeout != 0)
+        return;
+
+    retry_delay = retry_delay == 0 ? MIN_RETRY_DELAY : MIN (retry_delay * 2, MAX_RETRY_DELAY);
+    g_debug ("Retrying guest account setup in %u seconds", retry_delay);
+    retry_timeout = g_timeout_add_seconds (retry_delay, retry_fill_pool_cb, NULL);
+}
+
+static void
+pool_setup_free (PoolSetup *setup)
+{
+    g_clear_object (&setup->process);
+    g_free (setup->username);
+    g_free (setup);
+}
+
+static void
+pool_setup_thread (GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+    PoolSetup *setup = task_data;
+
+    /* Read the output here so shutdown can wait for the script without running the main loop */
+    g_autofree gchar *stdout_text = NULL;
+    g_autoptr(GError) error = NULL;
+    gchar *username = NULL;
+    if (!g_subprocess_communicate_utf8 (setup->process, NULL, NULL, &stdout_text, NULL, &error))
+        g_warning ("Error running guest account setup script '%s': %s", get_setup_script (), error->message);
+    else if (!g_subprocess_get_if_exited (setup->process) || g_subprocess_get_exit_status (setup->process) != 0)
+        g_debug ("Guest account setup script returns %d: %s", g_subprocess_get_status (setup->process), stdout_text);
+    else
+        username = get_username_from_output (stdout_text);
+
+    g_mutex_lock (&setup_lock);
+    setup->username = username;
+    setup->complete = TRUE;
+    g_cond_broadcast (&setup_cond);
+    g_mutex_unlock (&setup_lock);
+
+    g_task_return_boolean (task, TRUE);
+}
+
+static void
+pool_setup_cb (GObject *object, GAsyncResult *result, gpointer data)
+{
+    PoolSetup *setup = g_task_get_task_data (G_TASK (result));
+
+    /* Already handled if the pool was cleaned up */
+    if (!g_queue_remove (&pending_setups, setup))
+        return;
+
+    g_autofree gchar *username = g_steal_pointer (&setup->username);
+    if (!username)
+    {
+        retry_fill_pool ();
+        return;
+    }
+
+    g_debug ("Guest account %s ready in pool", username);
+    g_queue_push_tail (ready_accounts, g_steal_pointer (&username));
+    retry_delay = 0;
+}
+
+static void
+fill_pool (void)
+{
+    /* Wait for the retry if setup has been failing */
+    if (pool_stopped || retry_timeout != 0 || !get_setup_script ())
+        return;
+
+    while (g_queue_get_length (ready_accounts) + g_queue_get_length (&pending_setups) < get_pool_size ())
+    {
+        g_debug ("Setting up guest account in background with command '%s add'", get_setup_script ());
+
+        g_autoptr(GError) error = NULL;
+        GSubprocess *process = g_subprocess_new (G_SUBPROCESS_FLAGS_STDOUT_PIPE, &error, get_setup_script (), "add", NULL);
+        if (!process)
+        {
+            g_warning ("Error running guest account setup script '%s': %s", get_setup_script (), error->message);
+            retry_fill_pool ();
+            return;
+        }
+
+        PoolSetup *setup = g_malloc0 (sizeof (PoolSetup));
+        setup->process = process;
+        g_queue_push_tail (&pending_setups, setup);
+
+        g_autoptr(GTask) task = g_task_new (NULL, NULL, pool_setup_cb, NULL);
+        g_task_set_task_data (task, setup, (GDestroyNotify) pool_setup_free);
+        g_task_run_in_thread (task, pool_setup_thread);
+    }
+}
+
+void
+guest_account_pool_start (void)
+{
+    if (!ready_accounts)
+        ready_accounts = g_queue_new ();
+
+    if (get_pool_size () > 0)
+        g_debug ("Keeping a pool of %d guest account(s)", get_pool_size ());
+
+    fill_pool ();
+}
+
 gchar *
 guest_account_setup (void)
 {
+    /* Claim an account that was set up in advance */
+    gchar *username = ready_accounts ? g_queue_pop_head (ready_accounts) : NULL;
+    if (username)
+    {
+        g_debug ("Using guest account %s from pool", username);
+        return username;
+    }
+    if (get_pool_size () > 0)
+        g_debug ("Guest account pool is empty, setting up account now");
+
     g_autofree gchar *command = g_strdup_printf ("%s add", get_setup_script ());
     g_debug ("Opening guest account with command '%s'", command);
     g_autofree gchar *stdout_text = NULL;
@@ -74,28 +259,55 @@ guest_account_setup (void)
         return NULL;
     }
 
-    /* Use the last line and trim whitespace */
-    g_auto(GStrv) lines = g_strsplit (g_strstrip (stdout_text), "\n", -1);
-    g_autofree gchar *username = NULL;
-    if (lines)
-        username = g_strdup (g_strstrip (lines[g_strv_length (lines) - 1]));
-    else
-        username = g_strdup ("");
-
-    if (strcmp (username, "") == 0)
-    {
-        g_debug ("Guest account setup script didn't return a username");
+    username = get_username_from_output (stdout_text);
+    if (!username)
         return NULL;
-    }
 
     g_debug ("Guest account %s setup", username);
 
-    return g_steal_pointer (&username);
+    return username;
+}
+
+static void
+cleanup_cb (GObject *object, GAsyncResult *result, gpointer data)
+{
+    g_autoptr(GSubprocess) process = G_SUBPROCESS (object);
+    g_autofree gchar *username = data;
+
+    g_queue_remove (&pending_removals, process);
+
+    g_autoptr(GError) error = NULL;
+    if (!g_subprocess_wait_finish (process, result, &error))
+        g_warning ("Error running guest account cleanup script '%s': %s", get_setup_script (), error->message);
+    else if (!g_subprocess_get_if_exited (process) || g_subprocess_get_exit_status (process) != 0)
+        g_debug ("Guest account cleanup script returns %d", g_subprocess_get_status (process));
+    else
+        g_debug ("Guest account %s removed", username);
+
+    /* Replace the account that was used */
+    fill_pool ();
 }
 
 void
 guest_account_cleanup (const gchar *username)
 {
+    /* When keeping a pool the daemon shouldn't block while the account is removed */
+    if (get_pool_size () > 0 && !pool_stopped)
+    {
+        g_debug ("Closing guest account %s in background with command '%s remove %s'", username, get_setup_script (), username);
+
+        g_autoptr(GError) error = NULL;
+        GSubprocess *process = g_subprocess_new (G_SUBPROCESS_FLAGS_NONE, &error, get_setup_script (), "remove", username, NULL);
+        if (!process)
+            g_warning ("Error running guest account cleanup script '%s': %s", get_setup_script (), error->message);
+        else
+        {
+            g_queue_push_tail (&pending_removals, process);
+            g_subprocess_wait_async (process, NULL, cleanup_cb, g_strdup (username));
+        }
+        return;
+    }
+
     g_autofree gchar *command = g_strdup_printf ("%s remove %s", get_setup_script (), username);
     g_debug ("Closing guest account %s with command '%s'", username, command);
 
@@ -109,3 +321,47 @@ guest_account_cleanup (const gchar *username)
     if (result && exit_status != 0)
         g_debug ("Guest account cleanup script returns %d", exit_status);
 }
+
+void
+guest_account_pool_cleanup (void)
+{
+    pool_stopped = TRUE;
+    if (retry_timeout != 0)
+        g_source_remove (retry_timeout);
+    retry_timeout = 0;
+
+    /* Accounts still being set up would be left behind, so wait for them and remove them as they complete */
+    if (pending_setups.length > 0)
+        g_debug ("Waiting for %u guest account setup(s) to complete", pending_setups.length);
+    PoolSetup *setup;
+    while ((setup = g_queue_pop_head (&pending_setups)))
+    {
+        g_mutex_lock (&setup_lock);
+        while (!setup->complete)
+            g_cond_wait (&setup_cond, &setup_lock);
+        g_autofree gchar *username = g_steal_pointer (&setup->username);
+        g_mutex_unlock (&setup_lock);
+
+        if (username)
+            guest_account_cleanup (username);
+    }
+
+    /* Let accounts that are being removed finish so they aren't left half removed */
+    if (pending_removals.length > 0)
+        g_debug ("Waiting for %u guest account removal(s) to complete", pending_removals.length);
+    GSubprocess *process;
+    while ((process = g_queue_pop_head (&pending_removals)))
+        g_subprocess_wait (process, NULL, NULL);
+
+    if (!ready_accounts)
+        return;
+
+    /* Remove accounts that were never claimed */
+    gchar *username;
+    while ((username = g_queue_pop_head (ready_accounts)))
+    {
+        guest_account_cleanup (username);
+        g_free (username);
+    }
+    g_clear_pointer (&ready_accounts, g_queue_free);
+}
@@ -18,10 +18,14 @@ G_BEGIN_DECLS
 
 gboolean guest_account_is_installed (void);
 
+void guest_account_pool_start (void);
+
 gchar *guest_account_setup (void);
 
 void guest_account_cleanup (const gchar *username);
 
+void guest_account_pool_cleanup (void);
+
 G_END_DECLS
 
 #endif /* GUEST_ACCOUNT_H_ */
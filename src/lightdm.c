@@ -13,13 +13,17 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <glib.h>
 #include <glib/gi18n.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
 #include <errno.h>
+#include <poll.h>
+#include <signal.h>
 
 #include "configuration.h"
 #include "display-manager.h"
@@ -29,12 +33,16 @@
 #include "seat-xdmcp-session.h"
 #include "seat-xvnc.h"
 #include "x-server.h"
+#include "x-server-local.h"
 #include "process.h"
 #include "session-child.h"
 #include "shared-data-manager.h"
+#include "guest-account.h"
 #include "user-list.h"
 #include "login1.h"
 #include "log-file.h"
+#include "log-writer.h"
+#include "plymouth.h"
 
 static gchar *config_path = NULL;
 static GMainLoop *loop = NULL;
@@ -48,6 +56,19 @@ static XDMCPServer *xdmcp_server = NULL;
 static guint xdmcp_client_count = 0;
 static VNCServer *vnc_server = NULL;
 static guint vnc_client_count = 0;
+
+/* Xvnc server started before a client connected, talking to the daemon over a socket pair */
+typedef struct
+{
+    SeatXVNC *seat;
+    GSocket *socket;
+} VNCPoolEntry;
+
+/* Pooled servers waiting for a connection, oldest first */
+static GQueue vnc_pool = G_QUEUE_INIT;
+static guint vnc_pool_size = 0;
+static guint vnc_pool_max_size = 0;
+static guint vnc_pool_refill_id = 0;
 static gint exit_code = EXIT_SUCCESS;
 
 static gboolean update_login1_seat (Login1Seat *login1_seat);
@@ -81,20 +102,14 @@ log_cb (const gchar *log_domain, GLogLevelFlags log_level, const gchar *message,
         break;
     }
 
-    g_autofree gchar *text = g_strdup_printf ("[%+.2fs] %s %s\n", g_timer_elapsed (log_timer, NULL), prefix, message);
+    /* Log everything to a file, and to stderr if requested */
+    log_writer_log (g_timer_elapsed (log_timer, NULL), prefix, message);
 
-    /* Log everything to a file */
-    if (log_fd >= 0)
-    {
-        ssize_t n_written = write (log_fd, text, strlen (text));
-        if (n_written < 0)
-            ; /* Check result so compiler doesn't warn about it */
-    }
+    /* Write out now if about to abort */
+    if ((log_level & G_LOG_FLAG_FATAL) || (log_level & G_LOG_LEVEL_MASK) == G_LOG_LEVEL_ERROR)
+        log_writer_flush ();
 
-    /* Log to stderr if requested */
-    if (debug)
-        g_printerr ("%s", text);
-    else
+    if (!debug)
         g_log_default_handler (log_domain, log_level, message, data);
 }
 
@@ -110,6 +125,7 @@ log_init (void)
     gboolean backup_logs = config_get_boolean (config_get_instance (), "LightDM", "backup-logs");
     log_fd = log_file_open (path, backup_logs ? LOG_MODE_BACKUP_AND_TRUNCATE : LOG_MODE_APPEND);
     fcntl (log_fd, F_SETFD, FD_CLOEXEC);
+    log_writer_start (log_fd, debug);
     g_log_set_default_handler (log_cb, NULL);
 
     g_debug ("Logging to %s", path);
@@ -156,6 +172,24 @@ set_seat_properties (Seat *seat, const gchar *seat_name)
     g_list_free_full (sections, g_free);
 }
 
+static void
+log_statistics (void)
+{
+    g_debug ("Log: %" G_GUINT64_FORMAT " messages dropped", log_writer_get_n_dropped ());
+    if (xdmcp_server)
+    {
+        g_debug ("XDMCP server: %" G_GUINT64_FORMAT " packets received in %" G_GUINT64_FORMAT " batches, %" G_GUINT64_FORMAT " dropped",
+                 xdmcp_server_get_n_packets_received (xdmcp_server), xdmcp_server_get_n_batches (xdmcp_server), xdmcp_server_get_n_packets_dropped (xdmcp_server));
+        g_debug ("XDMCP server: %" G_GUINT64_FORMAT " packets over rate limit, %" G_GUINT64_FORMAT " requests declined",
+                 xdmcp_server_get_n_packets_throttled (xdmcp_server), xdmcp_server_get_n_requests_rejected (xdmcp_server));
+        g_debug ("XDMCP server: %" G_GUINT64_FORMAT " sessions expired without a keep alive",
+                 xdmcp_server_get_n_sessions_expired (xdmcp_server));
+    }
+    if (vnc_server)
+        g_debug ("VNC server: %u connections queued, %u rejected",
+                 vnc_server_get_queue_length (vnc_server), vnc_server_get_n_rejected (vnc_server));
+}
+
 static void
 signal_cb (Process *process, int signum)
 {
@@ -167,8 +201,10 @@ signal_cb (Process *process, int signum)
         display_manager_stop (display_manager);
         // FIXME: Stop XDMCP server
         break;
-    case SIGUSR1:
     case SIGUSR2:
+        log_statistics ();
+        break;
+    case SIGUSR1:
     case SIGHUP:
         break;
     }
@@ -275,8 +311,8 @@ xdmcp_session_cb (XDMCPServer *server, XDMCPSession *session)
     return display_manager_add_seat (display_manager, SEAT (seat));
 }
 
-static void
-vnc_connection_cb (VNCServer *server, GSocket *connection)
+static SeatXVNC *
+add_vnc_seat (GSocket *connection)
 {
     g_autoptr(SeatXVNC) seat = seat_xvnc_new (connection);
 
@@ -285,7 +321,278 @@ vnc_connection_cb (VNCServer *server, GSocket *connection)
 
     seat_set_name (SEAT (seat), name);
     set_seat_properties (SEAT (seat), NULL);
-    display_manager_add_seat (display_manager, SEAT (seat));
+    if (!display_manager_add_seat (display_manager, SEAT (seat)))
+        return NULL;
+
+    return g_steal_pointer (&seat);
+}
+
+static void vnc_pool_seat_stopped_cb (Seat *seat, VNCPoolEntry *entry);
+static void refill_vnc_pool (void);
+
+static void
+vnc_pool_entry_free (VNCPoolEntry *entry)
+{
+    g_signal_handlers_disconnect_by_func (entry->seat, vnc_pool_seat_stopped_cb, entry);
+    g_object_unref (entry->seat);
+    g_object_unref (entry->socket);
+    g_free (entry);
+}
+
+static gboolean
+add_vnc_pool_seat (void)
+{
+    int fds[2];
+    if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+    {
+        g_warning ("Failed to create socket pair for pooled VNC server: %s", strerror (errno));
+        return FALSE;
+    }
+
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GSocket) server_socket = g_socket_new_from_fd (fds[0], &error);
+    if (!server_socket)
+    {
+        g_warning ("Failed to use socket for pooled VNC server: %s", error->message);
+        close (fds[0]);
+        close (fds[1]);
+        return FALSE;
+    }
+    g_autoptr(GSocket) socket = g_socket_new_from_fd (fds[1], &error);
+    if (!socket)
+    {
+        g_warning ("Failed to use socket for pooled VNC server: %s", error->message);
+        close (fds[1]);
+        return FALSE;
+    }
+
+    g_autoptr(SeatXVNC) seat = add_vnc_seat (server_socket);
+    if (!seat)
+        return FALSE;
+    g_debug ("Started pooled VNC seat %s", seat_get_name (SEAT (seat)));
+
+    VNCPoolEntry *entry = g_malloc0 (sizeof (VNCPoolEntry));
+    entry->seat = g_steal_pointer (&seat);
+    entry->socket = g_steal_pointer (&socket);
+    g_signal_connect (entry->seat, SEAT_SIGNAL_STOPPED, G_CALLBACK (vnc_pool_seat_stopped_cb), entry);
+    g_queue_push_tail (&vnc_pool, entry);
+
+    return TRUE;
+}
+
+static gboolean
+refill_vnc_pool_cb (gpointer data)
+{
+    vnc_pool_refill_id = 0;
+
+    /* Start one server at a time so accepting connections isn't held up */
+    if (display_manager_get_is_stopping (display_manager) ||
+        g_queue_get_length (&vnc_pool) >= vnc_pool_size ||
+        !add_vnc_pool_seat ())
+        return G_SOURCE_REMOVE;
+
+    refill_vnc_pool ();
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+refill_vnc_pool (void)
+{
+    if (vnc_pool_refill_id == 0 && g_queue_get_length (&vnc_pool) < vnc_pool_size && !display_manager_get_is_stopping (display_manager))
+        vnc_pool_refill_id = g_idle_add (refill_vnc_pool_cb, NULL);
+}
+
+static void
+vnc_pool_seat_stopped_cb (Seat *seat, VNCPoolEntry *entry)
+{
+    g_debug ("Pooled VNC seat %s stopped before being used", seat_get_name (seat));
+    g_queue_remove (&vnc_pool, entry);
+    vnc_pool_entry_free (entry);
+
+    refill_vnc_pool ();
+}
+
+static void
+vnc_seat_stopped_cb (Seat *seat, GSocket *connection)
+{
+    vnc_server_release_connection (vnc_server, connection);
+}
+
+/* Let the VNC server take another connection when this one is finished */
+static void
+watch_vnc_seat (SeatXVNC *seat, GSocket *connection)
+{
+    if (!seat)
+    {
+        vnc_server_release_connection (vnc_server, connection);
+        return;
+    }
+
+    g_signal_connect_data (seat, SEAT_SIGNAL_STOPPED, G_CALLBACK (vnc_seat_stopped_cb), g_object_ref (connection), (GClosureNotify) g_object_unref, 0);
+}
+
+static gboolean
+write_all (int fd, const gchar *data, gssize length)
+{
+    while (length > 0)
+    {
+        gssize n_written = write (fd, data, length);
+        if (n_written < 0 && errno == EINTR)
+            continue;
+        if (n_written <= 0)
+            return FALSE;
+        data += n_written;
+        length -= n_written;
+    }
+
+    return TRUE;
+}
+
+/* Runs in a forked child of a threaded process, so only async-signal-safe calls can be used */
+static void
+run_vnc_relay (int client_fd, int server_fd, int max_fd)
+{
+    struct sigaction action;
+    memset (&action, 0, sizeof (action));
+    action.sa_handler = SIG_DFL;
+    sigemptyset (&action.sa_mask);
+    sigaction (SIGTERM, &action, NULL);
+    sigaction (SIGINT, &action, NULL);
+    sigaction (SIGHUP, &action, NULL);
+    sigaction (SIGUSR1, &action, NULL);
+    sigaction (SIGUSR2, &action, NULL);
+
+    /* Don't hold open anything else the daemon has */
+    for (int fd = STDERR_FILENO + 1; fd < max_fd; fd++)
+        if (fd != client_fd && fd != server_fd)
+            close (fd);
+    fcntl (client_fd, F_SETFL, fcntl (client_fd, F_GETFL) & ~O_NONBLOCK);
+    fcntl (server_fd, F_SETFL, fcntl (server_fd, F_GETFL) & ~O_NONBLOCK);
+
+    /* Copy in both directions until either side closes */
+    struct pollfd fds[2] = { { client_fd, POLLIN, 0 }, { server_fd, POLLIN, 0 } };
+    gchar buffer[65536];
+    while (TRUE)
+    {
+        if (poll (fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        gboolean done = FALSE;
+        for (int i = 0; i < 2 && !done; i++)
+        {
+            if (fds[i].revents == 0)
+                continue;
+            gssize n_read = read (fds[i].fd, buffer, sizeof (buffer));
+            if (n_read < 0 && errno == EINTR)
+                continue;
+            done = n_read <= 0 || !write_all (fds[1 - i].fd, buffer, n_read);
+        }
+        if (done)
+            break;
+    }
+
+    _exit (EXIT_SUCCESS);
+}
+
+/* One more than the highest open file descriptor, found before forking as the child can't allocate */
+static int
+get_max_fd (void)
+{
+    g_autoptr(GDir) dir = g_dir_open ("/proc/self/fd", 0, NULL);
+    if (!dir)
+        return sysconf (_SC_OPEN_MAX);
+
+    int max_fd = 0;
+    const gchar *name;
+    while ((name = g_dir_read_name (dir)))
+        max_fd = MAX (max_fd, atoi (name));
+
+    return max_fd + 1;
+}
+
+static void
+vnc_relay_exited_cb (GPid pid, gint status, gpointer data)
+{
+    g_spawn_close_pid (pid);
+}
+
+/* Xvnc can't take a new socket once started, so a child process passes data between the client
+ * and the pooled server. This keeps the traffic off the main loop, and a stuck client only
+ * holds up its own relay */
+static gboolean
+start_vnc_relay (GSocket *connection, GSocket *server_socket)
+{
+    int max_fd = get_max_fd ();
+    pid_t pid = fork ();
+    if (pid < 0)
+    {
+        g_warning ("Failed to fork VNC relay: %s", strerror (errno));
+        return FALSE;
+    }
+    if (pid == 0)
+        run_vnc_relay (g_socket_get_fd (connection), g_socket_get_fd (server_socket), max_fd);
+
+    g_child_watch_add (pid, vnc_relay_exited_cb, NULL);
+
+    return TRUE;
+}
+
+static void
+vnc_connection_cb (VNCServer *server, GSocket *connection)
+{
+    VNCPoolEntry *entry = g_queue_pop_head (&vnc_pool);
+    if (!entry)
+    {
+        /* Keep more servers ready if they are being used up faster than they are replaced */
+        if (vnc_pool_size > 0 && vnc_pool_size < vnc_pool_max_size)
+        {
+            vnc_pool_size++;
+            g_debug ("Increasing VNC pool size to %u", vnc_pool_size);
+        }
+        refill_vnc_pool ();
+
+        /* The display manager keeps the seat, only the connection needs watching */
+        SeatXVNC *seat = add_vnc_seat (connection);
+        watch_vnc_seat (seat, connection);
+        g_clear_object (&seat);
+        return;
+    }
+
+    g_debug ("Using pooled VNC seat %s", seat_get_name (SEAT (entry->seat)));
+
+    g_autoptr(SeatXVNC) seat = g_object_ref (entry->seat);
+    g_autoptr(GSocket) server_socket = g_object_ref (entry->socket);
+    vnc_pool_entry_free (entry);
+
+    seat_xvnc_set_client (seat, connection);
+    if (start_vnc_relay (connection, server_socket))
+        watch_vnc_seat (seat, connection);
+    else
+    {
+        vnc_server_release_connection (vnc_server, connection);
+        seat_stop (SEAT (seat));
+    }
+
+    refill_vnc_pool ();
+}
+
+/* Only X servers that listen on TCP need to know the X server version */
+static gboolean
+tcp_allowed_on_any_seat (void)
+{
+    g_auto(GStrv) groups = config_get_groups (config_get_instance ());
+    for (gchar **i = groups; *i; i++)
+    {
+        if (g_str_has_prefix (*i, "Seat:") && config_get_boolean (config_get_instance (), *i, "xserver-allow-tcp"))
+            return TRUE;
+    }
+
+    return FALSE;
 }
 
 static void
@@ -308,6 +615,9 @@ start_display_manager (void)
         xdmcp_server_set_listen_address (xdmcp_server, listen_address);
         g_autofree gchar *hostname = config_get_string (config_get_instance (), "XDMCPServer", "hostname");
         xdmcp_server_set_hostname (xdmcp_server, hostname);
+        xdmcp_server_set_max_unmanaged_sessions (xdmcp_server, MAX (config_get_integer (config_get_instance (), "XDMCPServer", "max-unmanaged-sessions"), 0));
+        xdmcp_server_set_rate_limit (xdmcp_server, MAX (config_get_integer (config_get_instance (), "XDMCPServer", "request-rate-limit"), 0));
+        xdmcp_server_set_keep_alive_timeout (xdmcp_server, MAX (config_get_integer (config_get_instance (), "XDMCPServer", "keep-alive-timeout"), 0));
         g_signal_connect (xdmcp_server, XDMCP_SERVER_SIGNAL_NEW_SESSION, G_CALLBACK (xdmcp_session_cb), NULL);
 
         g_autofree gchar *key_name = config_get_string (config_get_instance (), "XDMCPServer", "key");
@@ -361,10 +671,23 @@ start_display_manager (void)
             }
             g_autofree gchar *listen_address = config_get_string (config_get_instance (), "VNCServer", "listen-address");
             vnc_server_set_listen_address (vnc_server, listen_address);
+            vnc_server_set_max_connections (vnc_server, MAX (config_get_integer (config_get_instance (), "VNCServer", "max-connections"), 0));
+            vnc_server_set_max_queue_length (vnc_server, MAX (config_get_integer (config_get_instance (), "VNCServer", "max-queued-connections"), 0));
+            vnc_server_set_rate_limit (vnc_server, MAX (config_get_integer (config_get_instance (), "VNCServer", "connection-rate-limit"), 0));
             g_signal_connect (vnc_server, VNC_SERVER_SIGNAL_NEW_CONNECTION, G_CALLBACK (vnc_connection_cb), NULL);
 
             g_debug ("Starting VNC server on TCP/IP port %d", vnc_server_get_port (vnc_server));
             vnc_server_start (vnc_server);
+
+            gint min_size = config_get_integer (config_get_instance (), "VNCServer", "pool-min-size");
+            gint max_size = config_get_integer (config_get_instance (), "VNCServer", "pool-max-size");
+            vnc_pool_size = MAX (min_size, 0);
+            vnc_pool_max_size = MAX (max_size, (gint) vnc_pool_size);
+            if (vnc_pool_size > 0)
+            {
+                g_debug ("Keeping %u VNC servers ready for connections", vnc_pool_size);
+                refill_vnc_pool ();
+            }
         }
         else
             g_warning ("Can't start VNC server, Xvnc is not in the path");
@@ -764,6 +1087,10 @@ main (int argc, char **argv)
         config_set_boolean (config_get_instance (), "LightDM", "backup-logs", TRUE);
     if (!config_has_key (config_get_instance (), "LightDM", "dbus-service"))
         config_set_boolean (config_get_instance (), "LightDM", "dbus-service", TRUE);
+    if (!config_has_key (config_get_instance (), "VNCServer", "max-queued-connections"))
+        config_set_integer (config_get_instance (), "VNCServer", "max-queued-connections", 16);
+    if (!config_has_key (config_get_instance (), "XDMCPServer", "max-unmanaged-sessions"))
+        config_set_integer (config_get_instance (), "XDMCPServer", "max-unmanaged-sessions", 64);
     if (!config_has_key (config_get_instance (), "Seat:*", "type"))
         config_set_string (config_get_instance (), "Seat:*", "type", "local");
     if (!config_has_key (config_get_instance (), "Seat:*", "pam-service"))
@@ -778,6 +1105,8 @@ main (int argc, char **argv)
         config_set_string (config_get_instance (), "Seat:*", "xmir-command", "Xmir");
     if (!config_has_key (config_get_instance (), "Seat:*", "xserver-share"))
         config_set_boolean (config_get_instance (), "Seat:*", "xserver-share", TRUE);
+    if (!config_has_key (config_get_instance (), "Seat:*", "xserver-connect-timeout"))
+        config_set_integer (config_get_instance (), "Seat:*", "xserver-connect-timeout", 10);
     if (!config_has_key (config_get_instance (), "Seat:*", "unity-compositor-command"))
         config_set_string (config_get_instance (), "Seat:*", "unity-compositor-command", "unity-system-compositor");
     if (!config_has_key (config_get_instance (), "Seat:*", "start-session"))
@@ -855,6 +1184,13 @@ main (int argc, char **argv)
     if (getenv ("DISPLAY"))
         g_debug ("Using Xephyr for X servers");
 
+    /* Find out if Plymouth is running while the seats are being set up */
+    plymouth_start ();
+
+    /* Find out the X server version in the background so the first X server doesn't wait for it */
+    if (tcp_allowed_on_any_seat ())
+        x_server_local_start_version_detection ();
+
     display_manager = display_manager_new ();
     g_signal_connect (display_manager, DISPLAY_MANAGER_SIGNAL_STOPPED, G_CALLBACK (display_manager_stopped_cb), NULL);
     g_signal_connect (display_manager, DISPLAY_MANAGER_SIGNAL_SEAT_REMOVED, G_CALLBACK (display_manager_seat_removed_cb), NULL);
@@ -872,6 +1208,8 @@ main (int argc, char **argv)
 
     shared_data_manager_start (shared_data_manager_get_instance ());
 
+    guest_account_pool_start ();
+
     /* Connect to logind */
     if (login1_service_connect (login1_service_get_instance ()))
     {
@@ -925,6 +1263,9 @@ main (int argc, char **argv)
     /* Clean up shared data manager */
     shared_data_manager_cleanup ();
 
+    /* Remove unused guest accounts */
+    guest_account_pool_cleanup ();
+
     /* Clean up user list */
     common_user_list_cleanup ();
 
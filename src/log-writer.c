@@ -0,0 +1,266 @@
+/*
+ * Copyright (C) 2010-2011 Robert Ancell.
+ * Author: Robert Ancell <robert.ancell@canonical.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+ * license.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "log-writer.h"
+
+/* Size of the buffer messages wait in, must be a power of two */
+#define LOG_BUFFER_SIZE (1024 * 1024)
+
+/* Microseconds to let messages collect before writing them */
+#define LOG_WRITE_DELAY 10000
+
+/* Where messages are written */
+static int log_fd = -1;
+static gboolean log_to_stderr = FALSE;
+
+/* Process the writer thread runs in, forked children write directly.
+ * Their messages may appear before parent messages still waiting in the buffer */
+static pid_t writer_pid = 0;
+
+/* Ring buffer; messages are added at tail and written from head.
+ * Both only increase, wrapping around is handled by masking */
+static gchar *buffer = NULL;
+static guint buffer_head = 0;
+static guint buffer_tail = 0;
+
+/* Serialises threads adding messages; only the main loop logs in practice so this is never contended */
+static GMutex add_mutex;
+
+/* Held while writing out so a flush doesn't race the writer thread */
+static GMutex write_mutex;
+
+/* Used to wake the writer thread when it is waiting for messages */
+static GMutex wake_mutex;
+static GCond wake_cond;
+static gint writer_waiting = FALSE;
+
+/* Messages dropped since the last one that fit, and in total */
+static guint n_dropped = 0;
+static guint64 total_dropped = 0;
+
+static void
+write_all (int fd, const gchar *data, gsize length)
+{
+    while (length > 0)
+    {
+        ssize_t n_written = write (fd, data, length);
+        if (n_written < 0 && errno == EINTR)
+            continue;
+        if (n_written <= 0)
+            return;
+        data += n_written;
+        length -= n_written;
+    }
+}
+
+/* Write up to the end of the buffer, the rest is written by the next call if it wrapped.
+ * Only uses async-signal-safe calls so it can be used from a fatal signal handler */
+static guint
+write_chunk (guint head, guint tail)
+{
+    guint offset = head & (LOG_BUFFER_SIZE - 1);
+    guint length = MIN (tail - head, LOG_BUFFER_SIZE - offset);
+    if (log_fd >= 0)
+        write_all (log_fd, buffer + offset, length);
+    if (log_to_stderr)
+        write_all (STDERR_FILENO, buffer + offset, length);
+
+    return head + length;
+}
+
+static void
+write_pending (void)
+{
+    g_mutex_lock (&write_mutex);
+
+    guint head = buffer_head;
+    guint tail = g_atomic_int_get (&buffer_tail);
+    while (head != tail)
+    {
+        head = write_chunk (head, tail);
+
+        /* Release the space straight away so messages can be added while the rest is written */
+        g_atomic_int_set (&buffer_head, head);
+    }
+
+    g_mutex_unlock (&write_mutex);
+}
+
+static void
+fatal_signal_cb (int signum)
+{
+    /* Write out what is waiting so the messages leading up to a crash aren't lost.
+     * This can't take write_mutex, so if the writer thread was part way through
+     * some messages may be written twice */
+    if (getpid () == writer_pid)
+    {
+        guint head = g_atomic_int_get (&buffer_head);
+        guint tail = g_atomic_int_get (&buffer_tail);
+        while (head != tail)
+            head = write_chunk (head, tail);
+    }
+
+    /* The default action was restored when this handler was called */
+    raise (signum);
+}
+
+static gpointer
+writer_thread_cb (gpointer data)
+{
+    /* Leave signals for the main loop to handle */
+    sigset_t mask;
+    sigfillset (&mask);
+    pthread_sigmask (SIG_BLOCK, &mask, NULL);
+
+    while (TRUE)
+    {
+        g_mutex_lock (&wake_mutex);
+        g_atomic_int_set (&writer_waiting, TRUE);
+        while (g_atomic_int_get (&buffer_head) == g_atomic_int_get (&buffer_tail))
+            g_cond_wait (&wake_cond, &wake_mutex);
+        g_atomic_int_set (&writer_waiting, FALSE);
+        g_mutex_unlock (&wake_mutex);
+
+        /* Let more messages arrive so they are written together, unless the buffer is filling up */
+        if ((guint) g_atomic_int_get (&buffer_tail) - (guint) g_atomic_int_get (&buffer_head) < LOG_BUFFER_SIZE / 2)
+            g_usleep (LOG_WRITE_DELAY);
+
+        write_pending ();
+    }
+
+    return NULL;
+}
+
+static void
+copy_to_buffer (guint *tail, const gchar *data, gsize length)
+{
+    guint offset = *tail & (LOG_BUFFER_SIZE - 1);
+    gsize n_end = MIN (length, LOG_BUFFER_SIZE - offset);
+    memcpy (buffer + offset, data, n_end);
+    memcpy (buffer, data + n_end, length - n_end);
+    *tail += length;
+}
+
+void
+log_writer_start (int fd, gboolean copy_to_stderr)
+{
+    log_fd = fd;
+    log_to_stderr = copy_to_stderr;
+
+    if (buffer)
+        return;
+
+    buffer = g_malloc (LOG_BUFFER_SIZE);
+    writer_pid = getpid ();
+    g_thread_unref (g_thread_new ("log-writer", writer_thread_cb, NULL));
+
+    /* Make sure everything is written when exiting or crashing */
+    atexit (log_writer_flush);
+    struct sigaction action;
+    memset (&action, 0, sizeof (action));
+    action.sa_handler = fatal_signal_cb;
+    sigemptyset (&action.sa_mask);
+    action.sa_flags = SA_RESETHAND;
+    sigaction (SIGSEGV, &action, NULL);
+    sigaction (SIGBUS, &action, NULL);
+    sigaction (SIGILL, &action, NULL);
+    sigaction (SIGFPE, &action, NULL);
+    sigaction (SIGABRT, &action, NULL);
+}
+
+void
+log_writer_log (gdouble time, const gchar *prefix, const gchar *message)
+{
+    gchar header[64];
+    gsize header_length = g_snprintf (header, sizeof (header), "[%+.2fs] %s ", time, prefix);
+    header_length = MIN (header_length, sizeof (header) - 1);
+    gsize message_length = strlen (message);
+
+    /* Forked children don't have the writer thread, so write before the process goes away */
+    if (!buffer || getpid () != writer_pid)
+    {
+        struct iovec parts[] = { { header, header_length }, { (gchar *) message, message_length }, { (gchar *) "\n", 1 } };
+        if (log_fd >= 0 && writev (log_fd, parts, G_N_ELEMENTS (parts)) < 0)
+            ; /* Check result so compiler doesn't warn about it */
+        if (log_to_stderr && writev (STDERR_FILENO, parts, G_N_ELEMENTS (parts)) < 0)
+            ; /* Check result so compiler doesn't warn about it */
+        return;
+    }
+
+    g_mutex_lock (&add_mutex);
+
+    guint tail = buffer_tail;
+    gsize available = LOG_BUFFER_SIZE - (tail - (guint) g_atomic_int_get (&buffer_head));
+
+    /* Note where messages were lost once there is space again */
+    if (n_dropped > 0)
+    {
+        gchar note[128];
+        gsize note_length = g_snprintf (note, sizeof (note), "[%+.2fs] WARNING: %u log messages dropped\n", time, n_dropped);
+        if (note_length <= available)
+        {
+            copy_to_buffer (&tail, note, note_length);
+            available -= note_length;
+            n_dropped = 0;
+        }
+    }
+
+    /* Drop messages rather than wait for a slow disk */
+    if (n_dropped == 0 && header_length + message_length + 1 <= available)
+    {
+        copy_to_buffer (&tail, header, header_length);
+        copy_to_buffer (&tail, message, message_length);
+        copy_to_buffer (&tail, "\n", 1);
+    }
+    else
+    {
+        n_dropped++;
+        total_dropped++;
+    }
+
+    g_atomic_int_set (&buffer_tail, tail);
+
+    g_mutex_unlock (&add_mutex);
+
+    if (g_atomic_int_get (&writer_waiting))
+    {
+        g_mutex_lock (&wake_mutex);
+        g_cond_signal (&wake_cond);
+        g_mutex_unlock (&wake_mutex);
+    }
+}
+
+void
+log_writer_flush (void)
+{
+    if (!buffer || getpid () != writer_pid)
+        return;
+
+    write_pending ();
+}
+
+guint64
+log_writer_get_n_dropped (void)
+{
+    g_mutex_lock (&add_mutex);
+    guint64 n = total_dropped;
+    g_mutex_unlock (&add_mutex);
+
+    return n;
+}
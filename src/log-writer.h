@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2010-2011 Robert Ancell.
+ * Author: Robert Ancell <robert.ancell@canonical.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version. See http://www.gnu.org/copyleft/gpl.html the full text of the
+ * license.
+ */
+
+#ifndef LOG_WRITER_H_
+#define LOG_WRITER_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+void log_writer_start (int fd, gboolean copy_to_stderr);
+
+void log_writer_log (gdouble time, const gchar *prefix, const gchar *message);
+
+void log_writer_flush (void);
+
+guint64 log_writer_get_n_dropped (void);
+
+G_END_DECLS
+
+#endif /* LOG_WRITER_H_ */
@@ -10,76 +10,349 @@
  */
 
 #include <stdlib.h>
-#include <sys/wait.h>
+#include <string.h>
+#include <errno.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <glib-unix.h>
 
 #include "plymouth.h"
 
+/* Abstract socket plymouthd listens on */
+#define PLYMOUTH_SOCKET_PATH "/org/freedesktop/plymouthd"
+
+/* Requests and responses from ply-boot-protocol.h */
+#define PLYMOUTH_REQUEST_PING          'P'
+#define PLYMOUTH_REQUEST_DEACTIVATE    'D'
+#define PLYMOUTH_REQUEST_QUIT          'Q'
+#define PLYMOUTH_REQUEST_HAS_ACTIVE_VT 'V'
+#define PLYMOUTH_REQUEST_ARGUMENT      '\002'
+#define PLYMOUTH_RESPONSE_ACK          '\006'
+
+/* Number of seconds to wait for Plymouth to respond */
+#define PLYMOUTH_TIMEOUT 5
+
+/* Called with the response to a request, TRUE if Plymouth acknowledged it */
+typedef void (*RequestCallback) (gboolean result, gpointer data);
+
+typedef struct
+{
+    gchar command;
+    RequestCallback callback;
+    gpointer data;
+    guint timeout;
+} PlymouthRequest;
+
+/* Caller waiting for Plymouth */
+typedef struct
+{
+    PlymouthCallback callback;
+    gpointer data;
+    gboolean need_active_vt;
+} Waiter;
+
 static gboolean have_pinged = FALSE;
+static gboolean have_ping_response = FALSE;
+static gboolean checking_active_vt = FALSE;
 static gboolean have_checked_active_vt = FALSE;
+static gboolean have_quit = FALSE;
 
 static gboolean is_running = FALSE;
 static gboolean is_active = FALSE;
 static gboolean has_active_vt = FALSE;
 
+/* Connection to plymouthd */
+static int plymouth_fd = -1;
+static guint plymouth_watch = 0;
+
+/* Requests sent that are waiting for a response, plymouthd responds in order */
+static GQueue pending_requests = G_QUEUE_INIT;
+
+/* Callers waiting to find out if Plymouth is running, answered in order */
+static GQueue status_waiters = G_QUEUE_INIT;
+
+static void
+complete_request (PlymouthRequest *request, gboolean result)
+{
+    if (request->timeout)
+        g_source_remove (request->timeout);
+    if (request->callback)
+        request->callback (result, request->data);
+    g_free (request);
+}
+
+static void
+plymouth_disconnect (void)
+{
+    if (plymouth_watch)
+        g_source_remove (plymouth_watch);
+    plymouth_watch = 0;
+    if (plymouth_fd >= 0)
+        close (plymouth_fd);
+    plymouth_fd = -1;
+
+    /* Anything not responded to has failed, callbacks may send new requests on a new connection */
+    GQueue failed_requests = pending_requests;
+    g_queue_init (&pending_requests);
+    PlymouthRequest *request;
+    while ((request = g_queue_pop_head (&failed_requests)))
+        complete_request (request, FALSE);
+}
+
+static void
+read_responses (void)
+{
+    while (plymouth_fd >= 0)
+    {
+        guint8 response;
+        ssize_t n_read = recv (plymouth_fd, &response, sizeof (response), 0);
+        if (n_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            return;
+        if (n_read < 0)
+            g_debug ("Error reading from Plymouth: %s", strerror (errno));
+        if (n_read <= 0)
+        {
+            plymouth_disconnect ();
+            return;
+        }
+
+        PlymouthRequest *request = g_queue_pop_head (&pending_requests);
+        if (request)
+            complete_request (request, response == PLYMOUTH_RESPONSE_ACK);
+    }
+}
+
 static gboolean
-plymouth_run_command (const gchar *command, gint *exit_status)
+plymouth_read_cb (gint fd, GIOCondition condition, gpointer data)
 {
-    g_autofree gchar *command_line = g_strdup_printf ("plymouth %s", command);
-    g_autoptr(GError) error = NULL;
-    gboolean result = g_spawn_command_line_sync (command_line, NULL, NULL, exit_status, &error);
+    read_responses ();
 
-    if (error)
-        g_debug ("Could not run %s: %s", command_line, error->message);
+    if (plymouth_fd < 0)
+    {
+        plymouth_watch = 0;
+        return G_SOURCE_REMOVE;
+    }
 
-    return result;
+    return G_SOURCE_CONTINUE;
 }
 
 static gboolean
-plymouth_command_returns_true (gchar *command)
+plymouth_connect (void)
 {
-    gint exit_status;
-    if (!plymouth_run_command (command, &exit_status))
+    if (plymouth_fd >= 0)
+        return TRUE;
+
+    int fd = socket (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        g_debug ("Could not create socket to Plymouth: %s", strerror (errno));
         return FALSE;
-    return WIFEXITED (exit_status) && WEXITSTATUS (exit_status) == 0;
+    }
+
+    /* Plymouth uses an abstract socket with the address trimmed to the length of the path */
+    struct sockaddr_un address;
+    memset (&address, 0, sizeof (address));
+    address.sun_family = AF_UNIX;
+    memcpy (address.sun_path + 1, PLYMOUTH_SOCKET_PATH, strlen (PLYMOUTH_SOCKET_PATH));
+    socklen_t address_length = offsetof (struct sockaddr_un, sun_path) + 1 + strlen (PLYMOUTH_SOCKET_PATH);
+    if (connect (fd, (struct sockaddr *) &address, address_length) < 0)
+    {
+        g_debug ("Could not connect to Plymouth: %s", strerror (errno));
+        close (fd);
+        return FALSE;
+    }
+
+    plymouth_fd = fd;
+    plymouth_watch = g_unix_fd_add (plymouth_fd, G_IO_IN | G_IO_HUP | G_IO_ERR, plymouth_read_cb, NULL);
+
+    return TRUE;
+}
+
+static gboolean
+request_timeout_cb (gpointer data)
+{
+    PlymouthRequest *request = data;
+
+    request->timeout = 0;
+
+    /* Responses come in order, so nothing after this request can be matched up either */
+    g_debug ("Timed out waiting for Plymouth to respond");
+    plymouth_disconnect ();
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+request_failed_cb (gpointer data)
+{
+    complete_request (data, FALSE);
+    return G_SOURCE_REMOVE;
+}
+
+/* Send a request, the callback is always called from the main loop with the response */
+static void
+send_request (gchar command, const gchar *argument, RequestCallback callback, gpointer callback_data)
+{
+    PlymouthRequest *request = g_malloc0 (sizeof (PlymouthRequest));
+    request->command = command;
+    request->callback = callback;
+    request->data = callback_data;
+
+    if (!plymouth_connect ())
+    {
+        g_idle_add (request_failed_cb, request);
+        return;
+    }
+
+    /* Requests are the command character then either a nul or an argument with its length */
+    guint8 data[260];
+    gsize length = 0;
+    data[length++] = command;
+    if (argument)
+    {
+        gsize argument_length = MIN (strlen (argument) + 1, 255);
+        data[length++] = PLYMOUTH_REQUEST_ARGUMENT;
+        data[length++] = argument_length;
+        memcpy (data + length, argument, argument_length);
+        length += argument_length;
+    }
+    else
+        data[length++] = '\0';
+
+    /* The request is tiny so it fits in the socket buffer unless Plymouth is stuck */
+    ssize_t n_written = send (plymouth_fd, data, length, MSG_NOSIGNAL);
+    if (n_written < 0 || (gsize) n_written != length)
+    {
+        g_debug ("Error writing to Plymouth: %s", n_written < 0 ? strerror (errno) : "Short write");
+        plymouth_disconnect ();
+        g_idle_add (request_failed_cb, request);
+        return;
+    }
+
+    request->timeout = g_timeout_add_seconds (PLYMOUTH_TIMEOUT, request_timeout_cb, request);
+    g_queue_push_tail (&pending_requests, request);
 }
 
 gboolean
-plymouth_get_is_running (void)
+plymouth_get_has_status (gboolean need_active_vt)
+{
+    if (!have_ping_response)
+        return FALSE;
+
+    /* Only ask about the VT if Plymouth is running and a seat could take it over */
+    return !need_active_vt || !is_running || have_checked_active_vt;
+}
+
+static void has_active_vt_cb (gboolean result, gpointer data);
+
+static void
+answer_waiters (void)
 {
-    if (!have_pinged)
+    Waiter *waiter;
+    while ((waiter = g_queue_peek_head (&status_waiters)))
     {
-        have_pinged = TRUE;
-        is_running = plymouth_command_returns_true ("--ping");
-        is_active = is_running;
+        if (!plymouth_get_has_status (waiter->need_active_vt))
+        {
+            if (have_ping_response && !checking_active_vt)
+            {
+                checking_active_vt = TRUE;
+                send_request (PLYMOUTH_REQUEST_HAS_ACTIVE_VT, NULL, has_active_vt_cb, NULL);
+            }
+            return;
+        }
+
+        g_queue_pop_head (&status_waiters);
+        waiter->callback (waiter->data);
+        g_free (waiter);
     }
+}
 
+static void
+has_active_vt_cb (gboolean result, gpointer data)
+{
+    checking_active_vt = FALSE;
+    have_checked_active_vt = TRUE;
+    has_active_vt = result;
+    answer_waiters ();
+}
+
+static void
+ping_cb (gboolean result, gpointer data)
+{
+    /* Plymouth may have been told to quit while we were waiting */
+    have_ping_response = TRUE;
+    is_running = result && !have_quit;
+    is_active = is_running;
+    answer_waiters ();
+}
+
+void
+plymouth_start (void)
+{
+    /* Check if Plymouth is running in the background, seats wait for the answer before starting */
+    if (have_pinged)
+        return;
+    have_pinged = TRUE;
+
+    send_request (PLYMOUTH_REQUEST_PING, NULL, ping_cb, NULL);
+}
+
+void
+plymouth_wait_for_status (gboolean need_active_vt, PlymouthCallback callback, gpointer data)
+{
+    plymouth_start ();
+
+    Waiter *waiter = g_malloc0 (sizeof (Waiter));
+    waiter->callback = callback;
+    waiter->data = data;
+    waiter->need_active_vt = need_active_vt;
+    g_queue_push_tail (&status_waiters, waiter);
+
+    answer_waiters ();
+}
+
+gboolean
+plymouth_get_is_running (void)
+{
     return is_running;
 }
 
 gboolean
 plymouth_get_is_active (void)
 {
-    return plymouth_get_is_running () && is_active;
+    return is_running && is_active;
 }
 
 gboolean
 plymouth_has_active_vt (void)
 {
-    if (!have_checked_active_vt)
-    {
-        have_checked_active_vt = TRUE;
-        has_active_vt = plymouth_command_returns_true ("--has-active-vt");
-    }
-
     return has_active_vt;
 }
 
+static void
+deactivate_cb (gboolean result, gpointer data)
+{
+    Waiter *waiter = data;
+
+    if (!result)
+        g_debug ("Plymouth did not acknowledge being deactivated");
+    waiter->callback (waiter->data);
+    g_free (waiter);
+}
+
 void
-plymouth_deactivate (void)
+plymouth_deactivate (PlymouthCallback callback, gpointer data)
 {
     g_debug ("Deactivating Plymouth");
     is_active = FALSE;
-    plymouth_run_command ("deactivate", NULL);
+
+    /* Call back once Plymouth has released the display so the display server can take it over */
+    Waiter *waiter = g_malloc0 (sizeof (Waiter));
+    waiter->callback = callback;
+    waiter->data = data;
+    send_request (PLYMOUTH_REQUEST_DEACTIVATE, NULL, deactivate_cb, waiter);
 }
 
 void
@@ -90,10 +363,10 @@ plymouth_quit (gboolean retain_splash)
     else
         g_debug ("Quitting Plymouth");
 
-    have_pinged = TRUE;
+    have_quit = TRUE;
     is_running = FALSE;
-    if (retain_splash)
-        plymouth_run_command ("quit --retain-splash", NULL);
-    else
-        plymouth_run_command ("quit", NULL);
+
+    /* Nothing depends on Plymouth having quit, so don't wait for the response */
+    const gchar retain_argument[] = { retain_splash ? '\001' : '\0', '\0' };
+    send_request (PLYMOUTH_REQUEST_QUIT, retain_argument, NULL, NULL);
 }
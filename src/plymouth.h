@@ -16,13 +16,21 @@
 
 G_BEGIN_DECLS
 
+typedef void (*PlymouthCallback) (gpointer data);
+
+void plymouth_start (void);
+
+gboolean plymouth_get_has_status (gboolean need_active_vt);
+
+void plymouth_wait_for_status (gboolean need_active_vt, PlymouthCallback callback, gpointer data);
+
 gboolean plymouth_get_is_running (void);
 
 gboolean plymouth_get_is_active (void);
 
 gboolean plymouth_has_active_vt (void);
 
-void plymouth_deactivate (void);
+void plymouth_deactivate (PlymouthCallback callback, gpointer data);
 
 void plymouth_quit (gboolean retain_splash);
 
@@ -33,6 +33,9 @@ struct SeatLocalPrivate
 
     /* X server being used for XDMCP */
     XServerLocal *xdmcp_x_server;
+
+    /* VT Plymouth was deactivated on for the first display server to take over */
+    gint plymouth_vt;
 };
 
 G_DEFINE_TYPE (SeatLocal, seat_local, SEAT_TYPE)
@@ -80,7 +83,7 @@ compositor_stopped_cb (UnitySystemCompositor *compositor, SeatLocal *seat)
 }
 
 static gboolean
-seat_local_start (Seat *seat)
+start_seat (Seat *seat)
 {
     /* If running as an XDMCP client then just start an X server */
     const gchar *xdmcp_manager = seat_get_string_property (seat, "xdmcp-manager");
@@ -124,6 +127,70 @@ seat_local_start (Seat *seat)
     return SEAT_CLASS (seat_local_parent_class)->start (seat);
 }
 
+static void
+plymouth_deactivated_cb (gpointer data)
+{
+    g_autoptr(Seat) seat = data;
+
+    if (!seat_get_is_stopping (seat) && !start_seat (seat))
+        seat_stop (seat);
+}
+
+/* Returns TRUE if the seat is waiting for Plymouth to release the display */
+static gboolean
+replace_plymouth (Seat *seat)
+{
+    if (strcmp (seat_get_name (seat), "seat0") != 0)
+        return FALSE;
+
+    /* If Plymouth is running, replace it with the first display server */
+    if (plymouth_get_is_active () && plymouth_has_active_vt ())
+    {
+        gint active_vt = vt_get_active ();
+        if (active_vt >= vt_get_min ())
+        {
+            SEAT_LOCAL (seat)->priv->plymouth_vt = active_vt;
+            plymouth_deactivate (plymouth_deactivated_cb, g_object_ref (seat));
+            return TRUE;
+        }
+        else
+            l_debug (seat, "Plymouth is running on VT %d, but this is less than the configured minimum of %d so not replacing it", active_vt, vt_get_min ());
+    }
+    if (plymouth_get_is_active ())
+        plymouth_quit (FALSE);
+
+    return FALSE;
+}
+
+static void
+plymouth_status_cb (gpointer data)
+{
+    g_autoptr(Seat) seat = data;
+
+    if (seat_get_is_stopping (seat) || replace_plymouth (seat))
+        return;
+
+    if (!start_seat (seat))
+        seat_stop (seat);
+}
+
+static gboolean
+seat_local_start (Seat *seat)
+{
+    /* Wait to find out if Plymouth is running without blocking the other seats */
+    if (strcmp (seat_get_name (seat), "seat0") == 0 && !plymouth_get_has_status (TRUE))
+    {
+        l_debug (seat, "Waiting for Plymouth");
+        plymouth_wait_for_status (TRUE, plymouth_status_cb, g_object_ref (seat));
+        return TRUE;
+    }
+
+    if (replace_plymouth (seat))
+        return TRUE;
+
+    return start_seat (seat);
+}
+
 static void
 display_server_ready_cb (DisplayServer *display_server, Seat *seat)
 {
@@ -147,23 +214,15 @@ get_vt (SeatLocal *seat, DisplayServer *display_server)
     if (strcmp (seat_get_name (SEAT (seat)), "seat0") != 0)
         return -1;
 
-    /* If Plymouth is running, stop it */
+    /* Take over from Plymouth, deactivated before the seat started */
     gint vt = -1;
-    if (plymouth_get_is_active () && plymouth_has_active_vt ())
+    if (seat->priv->plymouth_vt >= 0)
     {
-        gint active_vt = vt_get_active ();
-        if (active_vt >= vt_get_min ())
-        {
-            vt = active_vt;
-            g_signal_connect (display_server, DISPLAY_SERVER_SIGNAL_READY, G_CALLBACK (display_server_ready_cb), seat);
-            g_signal_connect (display_server, DISPLAY_SERVER_SIGNAL_STOPPED, G_CALLBACK (display_server_transition_plymouth_cb), seat);
-            plymouth_deactivate ();
-        }
-        else
-            l_debug (seat, "Plymouth is running on VT %d, but this is less than the configured minimum of %d so not replacing it", active_vt, vt_get_min ());
+        vt = seat->priv->plymouth_vt;
+        seat->priv->plymouth_vt = -1;
+        g_signal_connect (display_server, DISPLAY_SERVER_SIGNAL_READY, G_CALLBACK (display_server_ready_cb), seat);
+        g_signal_connect (display_server, DISPLAY_SERVER_SIGNAL_STOPPED, G_CALLBACK (display_server_transition_plymouth_cb), seat);
     }
-    if (plymouth_get_is_active ())
-        plymouth_quit (FALSE);
     if (vt < 0)
         vt = vt_get_unused ();
 
@@ -257,6 +316,8 @@ create_x_server (SeatLocal *seat)
     gboolean allow_tcp = seat_get_boolean_property (SEAT (seat), "xserver-allow-tcp");
     x_server_local_set_allow_tcp (x_server, allow_tcp);
 
+    x_server_local_set_use_displayfd (x_server, seat_get_boolean_property (SEAT (seat), "xserver-displayfd"));
+
     return g_steal_pointer (&x_server);
 }
 
@@ -427,6 +488,7 @@ static void
 seat_local_init (SeatLocal *seat)
 {
     seat->priv = G_TYPE_INSTANCE_GET_PRIVATE (seat, SEAT_LOCAL_TYPE, SeatLocalPrivate);
+    seat->priv->plymouth_vt = -1;
 }
 
 static void
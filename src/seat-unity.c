@@ -131,7 +131,7 @@ compositor_stopped_cb (UnitySystemCompositor *compositor, SeatUnity *seat)
 }
 
 static gboolean
-seat_unity_start (Seat *seat)
+start_seat (Seat *seat)
 {
     /* Replace Plymouth if it is running */
     gint vt = -1;
@@ -170,6 +170,29 @@ seat_unity_start (Seat *seat)
     return display_server_start (DISPLAY_SERVER (SEAT_UNITY (seat)->priv->compositor));
 }
 
+static void
+plymouth_status_cb (gpointer data)
+{
+    g_autoptr(Seat) seat = data;
+
+    if (!seat_get_is_stopping (seat) && !start_seat (seat))
+        seat_stop (seat);
+}
+
+static gboolean
+seat_unity_start (Seat *seat)
+{
+    /* Wait to find out if Plymouth is running without blocking the other seats */
+    if (!plymouth_get_has_status (TRUE))
+    {
+        l_debug (seat, "Waiting for Plymouth");
+        plymouth_wait_for_status (TRUE, plymouth_status_cb, g_object_ref (seat));
+        return TRUE;
+    }
+
+    return start_seat (seat);
+}
+
 static XServerXmir *
 create_x_server (Seat *seat)
 {
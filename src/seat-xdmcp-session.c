@@ -21,19 +21,36 @@ struct SeatXDMCPSessionPrivate
 
     /* X server using XDMCP connection */
     XServerRemote *x_server;
+
+    /* TRUE once the X server has been connected to */
+    gboolean x_server_connected;
 };
 
 G_DEFINE_TYPE (SeatXDMCPSession, seat_xdmcp_session, SEAT_TYPE)
 
+static void
+session_expired_cb (XDMCPSession *session, SeatXDMCPSession *seat)
+{
+    l_debug (seat, "Terminal stopped responding, stopping seat");
+    seat_stop (SEAT (seat));
+}
+
 SeatXDMCPSession *
 seat_xdmcp_session_new (XDMCPSession *session)
 {
     SeatXDMCPSession *seat = g_object_new (SEAT_XDMCP_SESSION_TYPE, NULL);
     seat->priv->session = g_object_ref (session);
+    g_signal_connect (session, XDMCP_SESSION_SIGNAL_EXPIRED, G_CALLBACK (session_expired_cb), seat);
 
     return seat;
 }
 
+static void
+x_server_ready_cb (DisplayServer *display_server, SeatXDMCPSession *seat)
+{
+    seat->priv->x_server_connected = TRUE;
+}
+
 static DisplayServer *
 seat_xdmcp_session_create_display_server (Seat *seat, Session *session)
 {
@@ -48,10 +65,31 @@ seat_xdmcp_session_create_display_server (Seat *seat, Session *session)
     g_autofree gchar *host = g_inet_address_to_string (xdmcp_session_get_address (SEAT_XDMCP_SESSION (seat)->priv->session));
 
     SEAT_XDMCP_SESSION (seat)->priv->x_server = x_server_remote_new (host, xdmcp_session_get_display_number (SEAT_XDMCP_SESSION (seat)->priv->session), authority);
+    x_server_set_connect_timeout (X_SERVER (SEAT_XDMCP_SESSION (seat)->priv->x_server), seat_get_integer_property (seat, "xserver-connect-timeout"));
+    g_signal_connect (SEAT_XDMCP_SESSION (seat)->priv->x_server, DISPLAY_SERVER_SIGNAL_READY, G_CALLBACK (x_server_ready_cb), seat);
 
     return g_object_ref (DISPLAY_SERVER (SEAT_XDMCP_SESSION (seat)->priv->x_server));
 }
 
+static void
+seat_xdmcp_session_stop (Seat *seat)
+{
+    /* Tell the terminal its session is over when it next checks */
+    xdmcp_session_set_running (SEAT_XDMCP_SESSION (seat)->priv->session, FALSE);
+
+    SEAT_CLASS (seat_xdmcp_session_parent_class)->stop (seat);
+}
+
+static void
+seat_xdmcp_session_stopped (Seat *seat)
+{
+    xdmcp_session_set_running (SEAT_XDMCP_SESSION (seat)->priv->session, FALSE);
+
+    /* The X server is connected to in the background, so the terminal is only told it failed now */
+    if (SEAT_XDMCP_SESSION (seat)->priv->x_server && !SEAT_XDMCP_SESSION (seat)->priv->x_server_connected)
+        xdmcp_session_connect_failed (SEAT_XDMCP_SESSION (seat)->priv->session);
+}
+
 static void
 seat_xdmcp_session_init (SeatXDMCPSession *seat)
 {
@@ -63,7 +101,10 @@ seat_xdmcp_session_finalize (GObject *object)
 {
     SeatXDMCPSession *self = SEAT_XDMCP_SESSION (object);
 
+    g_signal_handlers_disconnect_matched (self->priv->session, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, self);
     g_clear_object (&self->priv->session);
+    if (self->priv->x_server)
+        g_signal_handlers_disconnect_matched (self->priv->x_server, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, self);
     g_clear_object (&self->priv->x_server);
 
     G_OBJECT_CLASS (seat_xdmcp_session_parent_class)->finalize (object);
@@ -76,6 +117,8 @@ seat_xdmcp_session_class_init (SeatXDMCPSessionClass *klass)
     GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
     seat_class->create_display_server = seat_xdmcp_session_create_display_server;
+    seat_class->stop = seat_xdmcp_session_stop;
+    seat_class->stopped = seat_xdmcp_session_stopped;
     object_class->finalize = seat_xdmcp_session_finalize;
 
     g_type_class_add_private (klass, sizeof (SeatXDMCPSessionPrivate));
@@ -22,6 +22,9 @@ struct SeatXVNCPrivate
     /* VNC connection */
     GSocket *connection;
 
+    /* Connection from the VNC client if it is relayed to a pooled server */
+    GSocket *client;
+
     /* X server using VNC connection */
     XServerXVNC *x_server;
 };
@@ -34,6 +37,14 @@ SeatXVNC *seat_xvnc_new (GSocket *connection)
     return seat;
 }
 
+void
+seat_xvnc_set_client (SeatXVNC *seat, GSocket *client)
+{
+    g_return_if_fail (seat != NULL);
+    g_clear_object (&seat->priv->client);
+    seat->priv->client = g_object_ref (client);
+}
+
 static void
 seat_xvnc_setup (Seat *seat)
 {
@@ -57,6 +68,7 @@ seat_xvnc_create_display_server (Seat *seat, Session *session)
     g_autoptr(XAuthority) cookie = x_authority_new_local_cookie (number);
     x_server_set_authority (X_SERVER (x_server), cookie);
     x_server_xvnc_set_socket (x_server, g_socket_get_fd (SEAT_XVNC (seat)->priv->connection));
+    x_server_local_set_use_displayfd (X_SERVER_LOCAL (x_server), seat_get_boolean_property (seat, "xserver-displayfd"));
 
     const gchar *command = config_get_string (config_get_instance (), "VNCServer", "command");
     if (command)
@@ -86,12 +98,16 @@ static void
 seat_xvnc_run_script (Seat *seat, DisplayServer *display_server, Process *script)
 {
     XServerXVNC *x_server = X_SERVER_XVNC (display_server);
-
-    GInetSocketAddress *address = G_INET_SOCKET_ADDRESS (g_socket_get_remote_address (SEAT_XVNC (seat)->priv->connection, NULL));
-    g_autofree gchar *hostname = g_inet_address_to_string (g_inet_socket_address_get_address (address));
     const gchar *path = x_server_local_get_authority_file_path (X_SERVER_LOCAL (x_server));
 
-    process_set_env (script, "REMOTE_HOST", hostname);
+    /* Pooled servers aren't connected to a client until one is relayed to them */
+    GSocket *client = SEAT_XVNC (seat)->priv->client ? SEAT_XVNC (seat)->priv->client : SEAT_XVNC (seat)->priv->connection;
+    g_autoptr(GSocketAddress) address = g_socket_get_remote_address (client, NULL);
+    if (G_IS_INET_SOCKET_ADDRESS (address))
+    {
+        g_autofree gchar *hostname = g_inet_address_to_string (g_inet_socket_address_get_address (G_INET_SOCKET_ADDRESS (address)));
+        process_set_env (script, "REMOTE_HOST", hostname);
+    }
     process_set_env (script, "DISPLAY", x_server_get_address (X_SERVER (x_server)));
     process_set_env (script, "XAUTHORITY", path);
 
@@ -110,6 +126,7 @@ seat_xvnc_session_finalize (GObject *object)
     SeatXVNC *self = SEAT_XVNC (object);
 
     g_clear_object (&self->priv->connection);
+    g_clear_object (&self->priv->client);
     g_clear_object (&self->priv->x_server);
 
     G_OBJECT_CLASS (seat_xvnc_parent_class)->finalize (object);
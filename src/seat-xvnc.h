@@ -39,6 +39,8 @@ GType seat_xvnc_get_type (void);
 
 SeatXVNC *seat_xvnc_new (GSocket *connection);
 
+void seat_xvnc_set_client (SeatXVNC *seat, GSocket *client);
+
 G_END_DECLS
 
 #endif /* SEAT_XVNC_H_ */
@@ -71,6 +71,15 @@ struct SeatPrivate
 
     /* TRUE before the display server has successfully started */
     gboolean starting;
+
+    /* Display servers waiting for the display setup script to complete */
+    GList *setting_up_display_servers;
+
+    /* Number of hook scripts running in the background */
+    guint n_running_scripts;
+
+    /* Time the seat was started, cleared once the first session is running */
+    gint64 start_time;
 };
 
 static void seat_logger_iface_init (LoggerInterface *iface);
@@ -207,6 +216,7 @@ seat_start (Seat *seat)
 
     l_debug (seat, "Starting");
 
+    seat->priv->start_time = g_get_monotonic_time ();
     SEAT_GET_CLASS (seat)->setup (seat);
     seat->priv->started = SEAT_GET_CLASS (seat)->start (seat);
 
@@ -347,10 +357,10 @@ seat_get_allow_guest (Seat *seat)
     return seat_get_boolean_property (seat, "allow-guest") && guest_account_is_installed ();
 }
 
-static gboolean
-run_script (Seat *seat, DisplayServer *display_server, const gchar *script_name, User *user)
+static Process *
+create_script (Seat *seat, DisplayServer *display_server, const gchar *script_name, User *user)
 {
-    g_autoptr(Process) script = process_new (NULL, NULL);
+    Process *script = process_new (NULL, NULL);
 
     process_set_command (script, script_name);
 
@@ -385,18 +395,77 @@ run_script (Seat *seat, DisplayServer *display_server, const gchar *script_name,
 
     SEAT_GET_CLASS (seat)->run_script (seat, display_server, script);
 
-    gboolean result = FALSE;
-    if (process_start (script, TRUE))
+    return script;
+}
+
+static gboolean
+get_script_succeeded (Seat *seat, Process *script)
+{
+    int exit_status = process_get_exit_status (script);
+    if (!WIFEXITED (exit_status))
+        return FALSE;
+
+    l_debug (seat, "Exit status of %s: %d", process_get_command (script), WEXITSTATUS (exit_status));
+    return WEXITSTATUS (exit_status) == EXIT_SUCCESS;
+}
+
+/* Called when a script run with run_script completes */
+typedef void (*ScriptCallback) (Seat *seat, gboolean succeeded, gpointer data);
+
+typedef struct
+{
+    Seat *seat;
+    ScriptCallback callback;
+    gpointer data;
+    GDestroyNotify data_free;
+} ScriptRequest;
+
+static void check_stopped (Seat *seat);
+
+static void
+complete_script (ScriptRequest *request, gboolean succeeded)
+{
+    Seat *seat = request->seat;
+
+    request->callback (seat, succeeded, request->data);
+    if (request->data_free)
+        request->data_free (request->data);
+    g_free (request);
+
+    check_stopped (seat);
+    g_object_unref (seat);
+}
+
+static void
+script_stopped_cb (Process *script, ScriptRequest *request)
+{
+    /* Drop the reference held while the script was running */
+    g_autoptr(Process) s = script;
+
+    request->seat->priv->n_running_scripts--;
+    complete_script (request, get_script_succeeded (request->seat, script));
+}
+
+/* Run a script in the background so other seats aren't held up, the callback is called with the result */
+static void
+run_script (Seat *seat, DisplayServer *display_server, const gchar *script_name, User *user, ScriptCallback callback, gpointer data, GDestroyNotify data_free)
+{
+    ScriptRequest *request = g_malloc0 (sizeof (ScriptRequest));
+    request->seat = g_object_ref (seat);
+    request->callback = callback;
+    request->data = data;
+    request->data_free = data_free;
+
+    Process *script = create_script (seat, display_server, script_name, user);
+    g_signal_connect (script, PROCESS_SIGNAL_STOPPED, G_CALLBACK (script_stopped_cb), request);
+    if (!process_start (script, FALSE))
     {
-        int exit_status = process_get_exit_status (script);
-        if (WIFEXITED (exit_status))
-        {
-            l_debug (seat, "Exit status of %s: %d", script_name, WEXITSTATUS (exit_status));
-            result = WEXITSTATUS (exit_status) == EXIT_SUCCESS;
-        }
+        g_signal_handlers_disconnect_matched (script, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, request);
+        g_object_unref (script);
+        complete_script (request, FALSE);
+        return;
     }
-
-    return result;
+    seat->priv->n_running_scripts++;
 }
 
 static void
@@ -423,7 +492,8 @@ check_stopped (Seat *seat)
     if (seat->priv->stopping &&
         !seat->priv->stopped &&
         g_list_length (seat->priv->display_servers) == 0 &&
-        g_list_length (seat->priv->sessions) == 0)
+        g_list_length (seat->priv->sessions) == 0 &&
+        seat->priv->n_running_scripts == 0)
     {
         seat->priv->stopped = TRUE;
         l_debug (seat, "Stopped");
@@ -431,6 +501,14 @@ check_stopped (Seat *seat)
     }
 }
 
+static void finish_display_server_stopped (Seat *seat, DisplayServer *display_server);
+
+static void
+display_stopped_script_cb (Seat *seat, gboolean succeeded, gpointer data)
+{
+    finish_display_server_stopped (seat, DISPLAY_SERVER (data));
+}
+
 static void
 display_server_stopped_cb (DisplayServer *display_server, Seat *seat)
 {
@@ -443,18 +521,27 @@ display_server_stopped_cb (DisplayServer *display_server, Seat *seat)
         return;
     }
 
-    /* Run a script right after stopping the display server */
-    const gchar *script = seat_get_string_property (seat, "display-stopped-script");
-    if (script)
-        run_script (seat, NULL, script, NULL);
-
     g_signal_handlers_disconnect_matched (display_server, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, seat);
     seat->priv->display_servers = g_list_remove (seat->priv->display_servers, display_server);
+    seat->priv->setting_up_display_servers = g_list_remove (seat->priv->setting_up_display_servers, display_server);
 
+    /* Run a script right after stopping the display server, and carry on when it completes */
+    const gchar *script = seat_get_string_property (seat, "display-stopped-script");
+    if (script)
+        run_script (seat, NULL, script, NULL, display_stopped_script_cb, display_server, g_object_unref);
+    else
+    {
+        finish_display_server_stopped (seat, display_server);
+        g_object_unref (display_server);
+    }
+}
+
+static void
+finish_display_server_stopped (Seat *seat, DisplayServer *display_server)
+{
     if (seat->priv->stopping || !seat->priv->started)
     {
         check_stopped (seat);
-        g_object_unref (display_server);
         return;
     }
 
@@ -498,8 +585,13 @@ display_server_stopped_cb (DisplayServer *display_server, Seat *seat)
             }
         }
     }
+}
 
-    g_object_unref (display_server);
+static gboolean
+get_display_server_is_set_up (Seat *seat, DisplayServer *display_server)
+{
+    return display_server_get_is_ready (display_server) &&
+           !g_list_find (seat->priv->setting_up_display_servers, display_server);
 }
 
 static gboolean
@@ -627,20 +719,8 @@ start_session (Seat *seat, Session *session)
 }
 
 static void
-run_session (Seat *seat, Session *session)
+finish_run_session (Seat *seat, Session *session)
 {
-    const gchar *script;
-    if (IS_GREETER_SESSION (session))
-        script = seat_get_string_property (seat, "greeter-setup-script");
-    else
-        script = seat_get_string_property (seat, "session-setup-script");
-    if (script && !run_script (seat, session_get_display_server (session), script, session_get_user (session)))
-    {
-        l_debug (seat, "Switching to greeter due to failed setup script");
-        switch_to_greeter_from_failed_session (seat, session);
-        return;
-    }
-
     if (!IS_GREETER_SESSION (session))
     {
         g_signal_emit (seat, signals[RUNNING_USER_SESSION], 0, session);
@@ -649,6 +729,12 @@ run_session (Seat *seat, Session *session)
 
     session_run (session);
 
+    if (seat->priv->start_time != 0)
+    {
+        l_debug (seat, "First session running %.3f seconds after seat start", (g_get_monotonic_time () - seat->priv->start_time) / (gdouble) G_USEC_PER_SEC);
+        seat->priv->start_time = 0;
+    }
+
     // FIXME: Wait until the session is ready
 
     if (session == seat->priv->session_to_activate)
@@ -669,6 +755,39 @@ run_session (Seat *seat, Session *session)
     }
 }
 
+static void
+session_setup_script_cb (Seat *seat, gboolean succeeded, gpointer data)
+{
+    Session *session = data;
+
+    /* Ignore if the session went away while the script was running */
+    if (!g_list_find (seat->priv->sessions, session) || session_get_is_stopping (session))
+        return;
+
+    if (!succeeded)
+    {
+        l_debug (seat, "Switching to greeter due to failed setup script");
+        switch_to_greeter_from_failed_session (seat, session);
+        return;
+    }
+
+    finish_run_session (seat, session);
+}
+
+static void
+run_session (Seat *seat, Session *session)
+{
+    const gchar *script;
+    if (IS_GREETER_SESSION (session))
+        script = seat_get_string_property (seat, "greeter-setup-script");
+    else
+        script = seat_get_string_property (seat, "session-setup-script");
+    if (script)
+        run_script (seat, session_get_display_server (session), script, session_get_user (session), session_setup_script_cb, g_object_ref (session), g_object_unref);
+    else
+        finish_run_session (seat, session);
+}
+
 static Session *
 find_user_session (Seat *seat, const gchar *username, Session *ignore_session)
 {
@@ -712,6 +831,12 @@ session_authentication_complete_cb (Session *session, Seat *seat)
             seat_set_active_session (seat, s);
             session_stop (session);
         }
+        else if (session_get_display_server (session) &&
+                 !get_display_server_is_set_up (seat, session_get_display_server (session)))
+        {
+            /* Run when the display server is ready */
+            l_debug (seat, "Session authenticated, waiting for display server");
+        }
         else
         {
             l_debug (seat, "Session authenticated, running command");
@@ -730,6 +855,14 @@ session_authentication_complete_cb (Session *session, Seat *seat)
     }
 }
 
+static void finish_session_stopped (Seat *seat, Session *session);
+
+static void
+session_cleanup_script_cb (Seat *seat, gboolean succeeded, gpointer data)
+{
+    finish_session_stopped (seat, SESSION (data));
+}
+
 static void
 session_stopped_cb (Session *session, Seat *seat)
 {
@@ -744,15 +877,20 @@ session_stopped_cb (Session *session, Seat *seat)
     if (session == seat->priv->session_to_activate)
         g_clear_object (&seat->priv->session_to_activate);
 
-    DisplayServer *display_server = session_get_display_server (session);
-
-    /* Cleanup */
+    /* Cleanup, and carry on when the script completes */
+    const gchar *script = NULL;
     if (!IS_GREETER_SESSION (session))
-    {
-        const gchar *script = seat_get_string_property (seat, "session-cleanup-script");
-        if (script)
-            run_script (seat, display_server, script, session_get_user (session));
-    }
+        script = seat_get_string_property (seat, "session-cleanup-script");
+    if (script)
+        run_script (seat, session_get_display_server (session), script, session_get_user (session), session_cleanup_script_cb, session, NULL);
+    else
+        finish_session_stopped (seat, session);
+}
+
+static void
+finish_session_stopped (Seat *seat, Session *session)
+{
+    DisplayServer *display_server = session_get_display_server (session);
 
     /* We were waiting for this session, but it didn't start :( */
     // FIXME: Start a greeter on this?
@@ -1288,18 +1426,8 @@ find_session_for_display_server (Seat *seat, DisplayServer *display_server)
 }
 
 static void
-display_server_ready_cb (DisplayServer *display_server, Seat *seat)
+display_server_set_up (Seat *seat, DisplayServer *display_server)
 {
-    /* Run setup script */
-    seat->priv->starting = FALSE;
-    const gchar *script = seat_get_string_property (seat, "display-setup-script");
-    if (script && !run_script (seat, display_server, script, NULL))
-    {
-        l_debug (seat, "Stopping display server due to failed setup script");
-        display_server_stop (display_server);
-        return;
-    }
-
     emit_upstart_signal ("login-session-start");
 
     /* Start the session waiting for this display server */
@@ -1311,6 +1439,11 @@ display_server_ready_cb (DisplayServer *display_server, Seat *seat)
             l_debug (seat, "Display server ready, running session");
             run_session (seat, session);
         }
+        else if (session_get_is_started (session))
+        {
+            /* Run when authentication completes */
+            l_debug (seat, "Display server ready, waiting for session authentication");
+        }
         else
         {
             l_debug (seat, "Display server ready, starting session authentication");
@@ -1324,6 +1457,44 @@ display_server_ready_cb (DisplayServer *display_server, Seat *seat)
     }
 }
 
+static void
+display_setup_script_cb (Seat *seat, gboolean succeeded, gpointer data)
+{
+    DisplayServer *display_server = data;
+
+    /* Ignore if the display server went away while the script was running */
+    GList *link = g_list_find (seat->priv->setting_up_display_servers, display_server);
+    if (!link)
+        return;
+    seat->priv->setting_up_display_servers = g_list_delete_link (seat->priv->setting_up_display_servers, link);
+
+    if (!succeeded)
+    {
+        l_debug (seat, "Stopping display server due to failed setup script");
+        display_server_stop (display_server);
+        return;
+    }
+
+    display_server_set_up (seat, display_server);
+}
+
+static void
+display_server_ready_cb (DisplayServer *display_server, Seat *seat)
+{
+    seat->priv->starting = FALSE;
+
+    const gchar *script_name = seat_get_string_property (seat, "display-setup-script");
+    if (!script_name)
+    {
+        display_server_set_up (seat, display_server);
+        return;
+    }
+
+    /* Sessions wait until the display server is set up */
+    seat->priv->setting_up_display_servers = g_list_append (seat->priv->setting_up_display_servers, display_server);
+    run_script (seat, display_server, script_name, NULL, display_setup_script_cb, g_object_ref (display_server), g_object_unref);
+}
+
 static DisplayServer *
 create_display_server (Seat *seat, Session *session)
 {
@@ -1669,6 +1840,12 @@ seat_real_start (Seat *seat)
                     display_server_stop (display_server);
                 session = NULL;
             }
+            /* Authentication doesn't need the display, so do it while the display server starts */
+            else if (!session_get_is_started (session))
+            {
+                l_debug (seat, "Starting session authentication while display server starts");
+                start_session (seat, session);
+            }
         }
     }
 
@@ -1854,6 +2031,7 @@ seat_finalize (GObject *object)
         g_signal_handlers_disconnect_matched (display_server, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, self);
     }
     g_list_free_full (self->priv->display_servers, g_object_unref);
+    g_list_free (self->priv->setting_up_display_servers);
     for (GList *link = self->priv->sessions; link; link = link->next)
     {
         Session *session = link->data;
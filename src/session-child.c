@@ -9,6 +9,7 @@
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <pwd.h>
 #include <grp.h>
 #include <glib.h>
@@ -46,6 +47,9 @@ static pam_handle_t *pam_handle;
 /* Maximum length of a string to pass between daemon and session */
 #define MAX_STRING_LENGTH 65535
 
+/* Number of seconds to wait for an X authority file to be updated */
+#define X_AUTHORITY_TIMEOUT 10
+
 static void
 write_data (const void *buf, size_t count)
 {
@@ -214,6 +218,82 @@ updwtmpx (const gchar *wtmp_file, struct utmpx *ut)
     updwtmp (wtmp_file, &u);
 }
 
+/* Update the X authority as the user in a separate process, so if the file is on a filesystem
+ * that has stopped responding (e.g. an NFS home directory) we can give up on it */
+static gboolean
+write_x_authority (XAuthority *x_authority, XAuthWriteMode mode, const gchar *filename, User *user, gboolean *timed_out)
+{
+    *timed_out = FALSE;
+
+    /* The writer exiting closes this pipe */
+    int done_pipe[2];
+    if (pipe (done_pipe) < 0)
+    {
+        g_printerr ("Failed to create pipe to X authority writer: %s\n", strerror (errno));
+        return FALSE;
+    }
+
+    pid_t pid = fork ();
+    if (pid < 0)
+    {
+        g_printerr ("Failed to fork X authority writer: %s\n", strerror (errno));
+        close (done_pipe[0]);
+        close (done_pipe[1]);
+        return FALSE;
+    }
+    if (pid == 0)
+    {
+        close (done_pipe[0]);
+
+        if (geteuid () == 0)
+            privileges_drop (user_get_uid (user), user_get_gid (user));
+
+        g_autoptr(GError) error = NULL;
+        gboolean result = x_authority_write (x_authority, mode, filename, &error);
+        if (error)
+            g_printerr ("Error %s X authority: %s\n", mode == XAUTH_WRITE_MODE_REMOVE ? "removing" : "writing", error->message);
+        _exit (result ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    close (done_pipe[1]);
+
+    struct pollfd fds = { done_pipe[0], POLLIN, 0 };
+    int n;
+    do
+        n = poll (&fds, 1, X_AUTHORITY_TIMEOUT * 1000);
+    while (n < 0 && errno == EINTR);
+    close (done_pipe[0]);
+
+    /* Leave the writer behind, it may not be able to exit until the filesystem recovers */
+    if (n == 0)
+    {
+        g_printerr ("Timed out updating X authority %s\n", filename);
+        kill (pid, SIGKILL);
+        *timed_out = TRUE;
+        return FALSE;
+    }
+
+    int status;
+    while (waitpid (pid, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+            return FALSE;
+    }
+
+    return WIFEXITED (status) && WEXITSTATUS (status) == EXIT_SUCCESS;
+}
+
+static void
+ensure_user_dir (const gchar *dir, User *user)
+{
+    if (g_mkdir_with_parents (dir, S_IRWXU) < 0)
+        g_printerr ("Failed to create system authority dir %s: %s\n", dir, strerror (errno));
+    if (getuid () == 0)
+    {
+        if (chown (dir, user_get_uid (user), user_get_gid (user)) < 0)
+            g_printerr ("Failed to set ownership of user authority dir: %s\n", strerror (errno));
+    }
+}
+
 #if HAVE_LIBAUDIT
 static void
 audit_event (int type, const gchar *username, uid_t uid, const gchar *remote_host_name, const gchar *tty, gboolean success)
@@ -467,6 +547,9 @@ session_child_run (int argc, char **argv)
         tty = read_string ();
     }
     g_autofree gchar *x_authority_filename = read_string ();
+    g_autofree gchar *x_authority_fallback_filename = NULL;
+    if (version >= 4)
+        x_authority_fallback_filename = read_string ();
     if (version >= 1)
     {
         g_free (xdisplay);
@@ -604,17 +687,20 @@ session_child_run (int argc, char **argv)
     /* Write X authority */
     if (x_authority)
     {
-        gboolean drop_privileges = geteuid () == 0;
-        if (drop_privileges)
-            privileges_drop (user_get_uid (user), user_get_gid (user));
+        gboolean timed_out;
+        gboolean result = write_x_authority (x_authority, XAUTH_WRITE_MODE_REPLACE, x_authority_filename, user, &timed_out);
 
-        g_autoptr(GError) error = NULL;
-        gboolean result = x_authority_write (x_authority, XAUTH_WRITE_MODE_REPLACE, x_authority_filename, &error);
-        if (drop_privileges)
-            privileges_reclaim ();
+        /* Use the system location if the home directory is not responding */
+        if (timed_out && x_authority_fallback_filename)
+        {
+            g_printerr ("Using X authority %s instead\n", x_authority_fallback_filename);
+            g_autofree gchar *dir = g_path_get_dirname (x_authority_fallback_filename);
+            ensure_user_dir (dir, user);
+            g_free (x_authority_filename);
+            x_authority_filename = g_steal_pointer (&x_authority_fallback_filename);
+            result = write_x_authority (x_authority, XAUTH_WRITE_MODE_REPLACE, x_authority_filename, user, &timed_out);
+        }
 
-        if (error)
-            g_printerr ("Error writing X authority: %s\n", error->message);
         if (!result)
         {
             pam_end (pam_handle, 0);
@@ -766,18 +852,8 @@ session_child_run (int argc, char **argv)
     /* Remove X authority */
     if (x_authority)
     {
-        gboolean drop_privileges = geteuid () == 0;
-        if (drop_privileges)
-            privileges_drop (user_get_uid (user), user_get_gid (user));
-
-        g_autoptr(GError) error = NULL;
-        gboolean result = x_authority_write (x_authority, XAUTH_WRITE_MODE_REMOVE, x_authority_filename, &error);
-        if (drop_privileges)
-            privileges_reclaim ();
-
-        if (error)
-            g_printerr ("Error removing X authority: %s\n", error->message);
-        if (!result)
+        gboolean timed_out;
+        if (!write_x_authority (x_authority, XAUTH_WRITE_MODE_REMOVE, x_authority_filename, user, &timed_out))
             _exit (EXIT_FAILURE);
     }
 
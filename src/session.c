@@ -606,7 +606,7 @@ session_real_start (Session *session)
     close (from_child_input);
 
     /* Indicate what version of the protocol we are using */
-    int version = 3;
+    int version = 4;
     write_data (session, &version, sizeof (version));
 
     /* Send configuration */
@@ -744,6 +744,7 @@ session_real_run (Session *session)
 
     /* Create authority location */
     g_autofree gchar *x_authority_filename = NULL;
+    g_autofree gchar *x_authority_fallback_filename = NULL;
     if (session->priv->x_authority_use_system_location)
     {
         g_autofree gchar *run_dir = config_get_string (config_get_instance (), "LightDM", "run-directory");
@@ -760,8 +761,14 @@ session_real_run (Session *session)
         x_authority_filename = g_build_filename (dir, "xauthority", NULL);
     }
     else
+    {
         x_authority_filename = g_build_filename (user_get_home_directory (session_get_user (session)), ".Xauthority", NULL);
 
+        /* The session child switches to the system location if the home directory doesn't respond */
+        g_autofree gchar *run_dir = config_get_string (config_get_instance (), "LightDM", "run-directory");
+        x_authority_fallback_filename = g_build_filename (run_dir, session->priv->username, "xauthority", NULL);
+    }
+
     /* Make sure shared user directory for this user exists */
     if (!session->priv->remote_host_name)
     {
@@ -800,6 +807,7 @@ session_real_run (Session *session)
     write_data (session, &session->priv->log_mode, sizeof (session->priv->log_mode));
     write_string (session, session->priv->tty);
     write_string (session, x_authority_filename);
+    write_string (session, x_authority_fallback_filename);
     write_string (session, session->priv->xdisplay);
     write_xauth (session, session->priv->x_authority);
     gsize argc = g_list_length (session->priv->env);
@@ -877,6 +885,7 @@ session_stop (Session *session)
         write_data (session, &log_mode, sizeof (log_mode)); // log mode
         write_string (session, NULL); // tty
         write_string (session, NULL); // xauth filename
+        write_string (session, NULL); // xauth fallback filename
         write_string (session, NULL); // xdisplay
         write_xauth (session, NULL); // xauth
         gsize n = 0;
@@ -13,7 +13,12 @@
 #include <gio/gio.h>
 #include <pwd.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <string.h>
 
 #include "configuration.h"
 #include "shared-data-manager.h"
@@ -21,13 +26,71 @@
 
 #define NUM_ENUMERATION_FILES 100
 
+/* Maximum number of files the deleter removes per second, so it doesn't starve sessions of I/O */
+#define DELETE_MAX_FILES_PER_SECOND 2000
+
+/* Number of files to delete between checks of the deletion rate */
+#define DELETE_BATCH_SIZE 100
+
+/* Number of files deleted between progress reports */
+#define DELETE_PROGRESS_INTERVAL 10000
+
 struct SharedDataManagerPrivate
 {
     gchar *greeter_user;
     guint32 greeter_gid;
     GHashTable *starting_dirs;
+
+    /* Thread deleting unused user directories and the directory names queued for it */
+    GThread *delete_thread;
+    GAsyncQueue *delete_queue;
+    gint delete_cancelled;
+
+    /* Directories known to have the correct owners, mapped to the user ID that owns them */
+    GHashTable *verified_dirs;
+    GMutex verified_dirs_lock;
 };
 
+/* Set of directories in USERS_DIR for the delete thread to remove */
+typedef struct
+{
+    /* Directory names, or NULL to stop the thread */
+    gchar **names;
+} DeleteRequest;
+
+/* State of the delete thread while removing one directory tree */
+typedef struct
+{
+    gint *cancelled;
+
+    /* Device the tree is on, we don't cross mount points */
+    dev_t device;
+
+    /* Path being deleted */
+    const gchar *path;
+
+    /* Rate limiting */
+    guint n_batch;
+    gint64 batch_start;
+
+    /* Results */
+    gboolean stopped;
+    guint n_deleted;
+    guint n_errors;
+    gchar *error_message;
+} DeleteState;
+
+/* Result of the delete thread to be reported in the main loop */
+typedef struct
+{
+    gchar *path;
+    gboolean complete;
+    gboolean stopped;
+    guint n_deleted;
+    guint n_errors;
+    gchar *error_message;
+} DeleteReport;
+
 struct OwnerInfo
 {
     SharedDataManager *manager;
@@ -52,71 +115,361 @@ shared_data_manager_cleanup (void)
     g_clear_object (&singleton);
 }
 
+static gboolean
+delete_report_cb (gpointer data)
+{
+    DeleteReport *report = data;
+
+    if (!report->complete)
+        g_debug ("Deleted %u files from unused user data directory %s so far", report->n_deleted, report->path);
+    else if (report->stopped)
+        g_debug ("Stopped deleting unused user data directory %s before it was complete (%u files deleted)", report->path, report->n_deleted);
+    else if (report->n_errors > 0)
+        g_warning ("Could not delete unused user data directory %s: %s (%u error(s), %u files deleted)", report->path, report->error_message, report->n_errors, report->n_deleted);
+    else
+        g_debug ("Deleted unused user data directory %s (%u files)", report->path, report->n_deleted);
+
+    g_free (report->path);
+    g_free (report->error_message);
+    g_free (report);
+
+    return G_SOURCE_REMOVE;
+}
+
 static void
-delete_unused_user (gpointer key, gpointer value, gpointer user_data)
+send_delete_report (DeleteState *state, gboolean complete)
 {
-    const gchar *user = (const gchar *)key;
+    DeleteReport *report = g_malloc0 (sizeof (DeleteReport));
+    report->path = g_strdup (state->path);
+    report->complete = complete;
+    report->stopped = state->stopped;
+    report->n_deleted = state->n_deleted;
+    report->n_errors = state->n_errors;
+    report->error_message = g_strdup (state->error_message);
+    g_idle_add (delete_report_cb, report);
+}
 
-    /* For this operation, we just need a fire and forget rm -rf.  Since
-       recursively deleting in GIO is a huge pain in the butt, we'll just drop
-       to shell for this. */
+static void
+delete_error (DeleteState *state, const gchar *path, int errsv)
+{
+    state->n_errors++;
 
-    g_autofree gchar *path = g_build_filename (USERS_DIR, user, NULL);
-    g_autofree gchar *quoted_path = g_shell_quote (path);
-    g_autofree gchar *cmd = g_strdup_printf ("/bin/rm -rf %s", quoted_path);
+    /* Only report the first error, the rest are likely to be the same */
+    if (!state->error_message)
+        state->error_message = g_strdup_printf ("%s: %s", path, strerror (errsv));
+}
 
-    g_autoptr(GError) error = NULL;
-    g_spawn_command_line_async (cmd, &error);
-    if (error)
-        g_warning ("Could not delete unused user data directory %s: %s", path, error->message);
+static void
+delete_throttle (DeleteState *state)
+{
+    state->n_deleted++;
+    if (state->n_deleted % DELETE_PROGRESS_INTERVAL == 0)
+        send_delete_report (state, FALSE);
+
+    state->n_batch++;
+    if (state->n_batch < DELETE_BATCH_SIZE)
+        return;
+
+    gint64 budget = (G_USEC_PER_SEC * DELETE_BATCH_SIZE) / DELETE_MAX_FILES_PER_SECOND;
+    gint64 elapsed = g_get_monotonic_time () - state->batch_start;
+    if (elapsed < budget)
+        g_usleep (budget - elapsed);
+
+    state->n_batch = 0;
+    state->batch_start = g_get_monotonic_time ();
 }
 
-gchar *
-shared_data_manager_ensure_user_dir (SharedDataManager *manager, const gchar *user)
+/* Delete name relative to the directory parent_fd.  Symbolic links are never
+   followed and directories on other devices are not entered. */
+static void
+delete_tree (DeleteState *state, int parent_fd, const gchar *name, const gchar *path)
 {
-    struct passwd *entry = getpwnam (user);
-    if (!entry)
-        return NULL;
+    if (g_atomic_int_get (state->cancelled))
+    {
+        state->stopped = TRUE;
+        return;
+    }
 
-    g_autofree gchar *path = g_build_filename (USERS_DIR, user, NULL);
-    g_autoptr(GFile) file = g_file_new_for_path (path);
+    struct stat info;
+    if (fstatat (parent_fd, name, &info, AT_SYMLINK_NOFOLLOW) < 0)
+    {
+        if (errno != ENOENT)
+            delete_error (state, path, errno);
+        return;
+    }
 
-    g_debug ("Creating shared data directory %s", path);
+    if (!S_ISDIR (info.st_mode))
+    {
+        if (unlinkat (parent_fd, name, 0) < 0 && errno != ENOENT)
+            delete_error (state, path, errno);
+        else
+            delete_throttle (state);
+        return;
+    }
 
-    g_autoptr(GError) error = NULL;
-    gboolean result = g_file_make_directory_with_parents (file, NULL, &error);
-    if (error)
+    if (info.st_dev != state->device)
+    {
+        delete_error (state, path, EXDEV);
+        return;
+    }
+
+    int fd = openat (parent_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
     {
-        if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_EXISTS))
+        delete_error (state, path, errno);
+        return;
+    }
+
+    /* Read all the names before deleting any, so we don't modify the directory while reading it */
+    g_autoptr(GPtrArray) children = g_ptr_array_new_with_free_func (g_free);
+    int dir_fd = dup (fd);
+    DIR *dir = dir_fd >= 0 ? fdopendir (dir_fd) : NULL;
+    if (!dir)
+    {
+        delete_error (state, path, errno);
+        if (dir_fd >= 0)
+            close (dir_fd);
+        close (fd);
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir (dir)))
+    {
+        if (strcmp (entry->d_name, ".") == 0 || strcmp (entry->d_name, "..") == 0)
+            continue;
+        g_ptr_array_add (children, g_strdup (entry->d_name));
+    }
+    closedir (dir);
+
+    for (guint i = 0; i < children->len; i++)
+    {
+        const gchar *child_name = g_ptr_array_index (children, i);
+        g_autofree gchar *child_path = g_build_filename (path, child_name, NULL);
+        delete_tree (state, fd, child_name, child_path);
+    }
+    close (fd);
+
+    if (g_atomic_int_get (state->cancelled))
+    {
+        state->stopped = TRUE;
+        return;
+    }
+
+    if (unlinkat (parent_fd, name, AT_REMOVEDIR) < 0 && errno != ENOENT)
+        delete_error (state, path, errno);
+    else
+        delete_throttle (state);
+}
+
+static gpointer
+delete_thread_cb (gpointer data)
+{
+    SharedDataManager *manager = data;
+
+    while (TRUE)
+    {
+        DeleteRequest *request = g_async_queue_pop (manager->priv->delete_queue);
+        g_auto(GStrv) names = request->names;
+        g_free (request);
+        if (!names)
+            break;
+
+        /* Open the users directory once for all the directories in this request */
+        int users_fd = open (USERS_DIR, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        struct stat info;
+        if (users_fd < 0 || fstat (users_fd, &info) < 0)
         {
-            g_clear_error (&error);
-            result = TRUE;
+            DeleteState state = { 0 };
+            state.path = USERS_DIR;
+            delete_error (&state, USERS_DIR, errno);
+            send_delete_report (&state, TRUE);
+            g_free (state.error_message);
+            if (users_fd >= 0)
+                close (users_fd);
+            continue;
         }
-        else
-            g_warning ("Could not create user data directory %s: %s", path, error->message);
+
+        for (gchar **name = names; *name && !g_atomic_int_get (&manager->priv->delete_cancelled); name++)
+        {
+            g_autofree gchar *path = g_build_filename (USERS_DIR, *name, NULL);
+            DeleteState state = { 0 };
+            state.cancelled = &manager->priv->delete_cancelled;
+            state.device = info.st_dev;
+            state.path = path;
+            state.batch_start = g_get_monotonic_time ();
+
+            delete_tree (&state, users_fd, *name, path);
+            send_delete_report (&state, TRUE);
+            g_free (state.error_message);
+        }
+
+        close (users_fd);
     }
-    if (!result)
+
+    return NULL;
+}
+
+static void
+delete_unused_users (SharedDataManager *manager, gchar **names)
+{
+    if (!manager->priv->delete_thread)
     {
-        g_clear_pointer (&path, g_free);
-        return NULL;
+        g_autoptr(GError) error = NULL;
+        manager->priv->delete_thread = g_thread_try_new ("shared-data-delete", delete_thread_cb, manager, &error);
+        if (!manager->priv->delete_thread)
+        {
+            g_warning ("Could not start thread to delete unused user data directories: %s", error->message);
+            return;
+        }
     }
 
+    g_mutex_lock (&manager->priv->verified_dirs_lock);
+    for (gchar **name = names; *name; name++)
+    {
+        g_autofree gchar *path = g_build_filename (USERS_DIR, *name, NULL);
+        g_hash_table_remove (manager->priv->verified_dirs, path);
+    }
+    g_mutex_unlock (&manager->priv->verified_dirs_lock);
+
+    DeleteRequest *request = g_malloc0 (sizeof (DeleteRequest));
+    request->names = g_strdupv (names);
+    g_async_queue_push (manager->priv->delete_queue, request);
+}
+
+/* Create path and make sure it is owned by uid and the greeter group.  Safe to call from any thread. */
+static gboolean
+ensure_dir (SharedDataManager *manager, const gchar *path, guint32 uid, GError **error)
+{
+    guint32 gid = manager->priv->greeter_gid;
+
+    /* Skip if already done in this run with the same owners */
+    g_mutex_lock (&manager->priv->verified_dirs_lock);
+    gpointer verified_uid;
+    gboolean verified = g_hash_table_lookup_extended (manager->priv->verified_dirs, path, NULL, &verified_uid) && GPOINTER_TO_UINT (verified_uid) == uid;
+    g_mutex_unlock (&manager->priv->verified_dirs_lock);
+    if (verified)
+        return TRUE;
+
+    g_autoptr(GFile) file = g_file_new_for_path (path);
+
     /* Even if the directory already exists, we want to re-affirm the owners
        because the greeter gid is configuration based and may change between
-       runs. */
-    g_autoptr(GFileInfo) info = g_file_info_new ();
-    g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_UID, entry->pw_uid);
-    g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_GID, manager->priv->greeter_gid);
-    g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_MODE, 0770);
-    result = g_file_set_attributes_from_info (file, info, G_FILE_QUERY_INFO_NONE, NULL, &error);
-    if (error)
-        g_warning ("Could not chown user data directory %s: %s", path, error->message);
-    if (!result)
+       runs.  Only change them if they are different though. */
+    g_autoptr(GFileInfo) current_info = g_file_query_info (file,
+                                                           G_FILE_ATTRIBUTE_STANDARD_TYPE "," G_FILE_ATTRIBUTE_UNIX_UID "," G_FILE_ATTRIBUTE_UNIX_GID "," G_FILE_ATTRIBUTE_UNIX_MODE,
+                                                           G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, NULL, NULL);
+    if (current_info &&
+        g_file_info_get_file_type (current_info) == G_FILE_TYPE_DIRECTORY &&
+        g_file_info_get_attribute_uint32 (current_info, G_FILE_ATTRIBUTE_UNIX_UID) == uid &&
+        g_file_info_get_attribute_uint32 (current_info, G_FILE_ATTRIBUTE_UNIX_GID) == gid &&
+        (g_file_info_get_attribute_uint32 (current_info, G_FILE_ATTRIBUTE_UNIX_MODE) & 07777) == 0770)
+    {
+        g_debug ("Shared data directory %s already exists", path);
+    }
+    else
+    {
+        g_debug ("Creating shared data directory %s", path);
+
+        g_autoptr(GError) mkdir_error = NULL;
+        if (!g_file_make_directory_with_parents (file, NULL, &mkdir_error) &&
+            !g_error_matches (mkdir_error, G_IO_ERROR, G_IO_ERROR_EXISTS))
+        {
+            g_propagate_prefixed_error (error, g_steal_pointer (&mkdir_error), "Could not create user data directory %s: ", path);
+            return FALSE;
+        }
+
+        g_autoptr(GFileInfo) info = g_file_info_new ();
+        g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_UID, uid);
+        g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_GID, gid);
+        g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_MODE, 0770);
+        g_autoptr(GError) chown_error = NULL;
+        if (!g_file_set_attributes_from_info (file, info, G_FILE_QUERY_INFO_NONE, NULL, &chown_error))
+        {
+            g_propagate_prefixed_error (error, g_steal_pointer (&chown_error), "Could not chown user data directory %s: ", path);
+            return FALSE;
+        }
+    }
+
+    g_mutex_lock (&manager->priv->verified_dirs_lock);
+    g_hash_table_insert (manager->priv->verified_dirs, g_strdup (path), GUINT_TO_POINTER (uid));
+    g_mutex_unlock (&manager->priv->verified_dirs_lock);
+
+    return TRUE;
+}
+
+gchar *
+shared_data_manager_ensure_user_dir (SharedDataManager *manager, const gchar *user)
+{
+    struct passwd *entry = getpwnam (user);
+    if (!entry)
         return NULL;
 
+    g_autofree gchar *path = g_build_filename (USERS_DIR, user, NULL);
+    g_autoptr(GError) error = NULL;
+    if (!ensure_dir (manager, path, entry->pw_uid, &error))
+    {
+        g_warning ("%s", error->message);
+        return NULL;
+    }
+
     return g_steal_pointer (&path);
 }
 
+typedef struct
+{
+    gchar *path;
+    guint32 uid;
+} EnsureDirRequest;
+
+static void
+ensure_dir_request_free (gpointer data)
+{
+    EnsureDirRequest *request = data;
+    g_free (request->path);
+    g_free (request);
+}
+
+static void
+ensure_dir_thread_cb (GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+    SharedDataManager *manager = source_object;
+    EnsureDirRequest *request = task_data;
+
+    GError *error = NULL;
+    if (ensure_dir (manager, request->path, request->uid, &error))
+        g_task_return_pointer (task, g_strdup (request->path), g_free);
+    else
+        g_task_return_error (task, error);
+}
+
+void
+shared_data_manager_ensure_user_dir_async (SharedDataManager *manager, const gchar *user, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data)
+{
+    g_autoptr(GTask) task = g_task_new (manager, cancellable, callback, user_data);
+
+    /* Look up the user here as the passwd functions are not thread safe */
+    struct passwd *entry = getpwnam (user);
+    if (!entry)
+    {
+        g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "Unknown user %s", user);
+        return;
+    }
+
+    EnsureDirRequest *request = g_malloc0 (sizeof (EnsureDirRequest));
+    request->path = g_build_filename (USERS_DIR, user, NULL);
+    request->uid = entry->pw_uid;
+    g_task_set_task_data (task, request, ensure_dir_request_free);
+
+    g_task_run_in_thread (task, ensure_dir_thread_cb);
+}
+
+gchar *
+shared_data_manager_ensure_user_dir_finish (SharedDataManager *manager, GAsyncResult *result, GError **error)
+{
+    g_return_val_if_fail (g_task_is_valid (result, manager), NULL);
+    return g_task_propagate_pointer (G_TASK (result), error);
+}
+
 static void
 next_user_dirs_cb (GObject *object, GAsyncResult *res, gpointer user_data)
 {
@@ -154,7 +507,12 @@ next_user_dirs_cb (GObject *object, GAsyncResult *res, gpointer user_data)
             CommonUser *user = link->data;
             g_hash_table_remove (manager->priv->starting_dirs, common_user_get_name (user));
         }
-        g_hash_table_foreach (manager->priv->starting_dirs, delete_unused_user, manager);
+        if (g_hash_table_size (manager->priv->starting_dirs) > 0)
+        {
+            g_autofree gchar **names = (gchar **) g_hash_table_get_keys_as_array (manager->priv->starting_dirs, NULL);
+            g_debug ("Deleting %u unused user data directories", g_hash_table_size (manager->priv->starting_dirs));
+            delete_unused_users (manager, names);
+        }
         g_hash_table_destroy (manager->priv->starting_dirs);
         manager->priv->starting_dirs = NULL;
 
@@ -184,7 +542,8 @@ list_user_dirs_cb (GObject *object, GAsyncResult *res, gpointer user_data)
 static void
 user_removed_cb (CommonUserList *list, CommonUser *user, SharedDataManager *manager)
 {
-    delete_unused_user ((gpointer) common_user_get_name (user), NULL, manager);
+    const gchar *names[] = { common_user_get_name (user), NULL };
+    delete_unused_users (manager, (gchar **) names);
 }
 
 void
@@ -211,6 +570,10 @@ shared_data_manager_init (SharedDataManager *manager)
     struct passwd *greeter_entry = getpwnam (manager->priv->greeter_user);
     if (greeter_entry)
         manager->priv->greeter_gid = greeter_entry->pw_gid;
+
+    manager->priv->delete_queue = g_async_queue_new ();
+    manager->priv->verified_dirs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    g_mutex_init (&manager->priv->verified_dirs_lock);
 }
 
 static void
@@ -222,6 +585,18 @@ shared_data_manager_finalize (GObject *object)
 
     g_signal_handlers_disconnect_by_data (common_user_list_get_instance (), self);
 
+    /* Abandon any remaining deletion, it will be picked up again next time we start */
+    if (self->priv->delete_thread)
+    {
+        g_atomic_int_set (&self->priv->delete_cancelled, TRUE);
+        g_async_queue_push (self->priv->delete_queue, g_malloc0 (sizeof (DeleteRequest)));
+        g_thread_join (self->priv->delete_thread);
+        self->priv->delete_thread = NULL;
+    }
+    g_async_queue_unref (self->priv->delete_queue);
+    g_hash_table_unref (self->priv->verified_dirs);
+    g_mutex_clear (&self->priv->verified_dirs_lock);
+
     if (self->priv->starting_dirs)
         g_hash_table_destroy (self->priv->starting_dirs);
 
@@ -9,6 +9,8 @@
  * license.
  */
 
+#include <errno.h>
+#include <sys/socket.h>
 #include <gio/gio.h>
 
 #include "vnc-server.h"
@@ -29,8 +31,53 @@ struct VNCServerPrivate
 
     /* Listening sockets */
     GSocket *socket, *socket6;
+
+    /* Maximum number of connections to pass on at once (0 for no limit) */
+    guint max_connections;
+
+    /* Maximum number of connections to hold while at the limit */
+    guint max_queue_length;
+
+    /* Number of connections allowed per minute from each address (0 for no limit) */
+    guint rate_limit;
+
+    /* Connections that have been passed on and not released */
+    GHashTable *connections;
+
+    /* Connections waiting to be passed on, oldest first */
+    GQueue queue;
+
+    /* Rate limit state for each address */
+    GHashTable *rate_limits;
+
+    /* Rate limit state, least recently used first */
+    GQueue rate_limit_order;
+
+    /* Number of connections turned away */
+    guint n_rejected;
 };
 
+typedef struct
+{
+    VNCServer *server;
+    GSocket *socket;
+    gchar *hostname;
+    GSource *source;
+} QueuedConnection;
+
+typedef struct
+{
+    gchar *hostname;
+    gdouble tokens;
+    gint64 last_time;
+
+    /* Link in rate_limit_order */
+    GList link;
+} RateLimit;
+
+/* Number of addresses to track before forgetting the least recently used */
+#define MAX_RATE_LIMITS 1024
+
 G_DEFINE_TYPE (VNCServer, vnc_server, G_TYPE_OBJECT)
 
 VNCServer *
@@ -69,26 +116,228 @@ vnc_server_get_listen_address (VNCServer *server)
     return server->priv->listen_address;
 }
 
+void
+vnc_server_set_max_connections (VNCServer *server, guint max_connections)
+{
+    g_return_if_fail (server != NULL);
+    server->priv->max_connections = max_connections;
+}
+
+void
+vnc_server_set_max_queue_length (VNCServer *server, guint max_queue_length)
+{
+    g_return_if_fail (server != NULL);
+    server->priv->max_queue_length = max_queue_length;
+}
+
+void
+vnc_server_set_rate_limit (VNCServer *server, guint rate_limit)
+{
+    g_return_if_fail (server != NULL);
+    server->priv->rate_limit = rate_limit;
+}
+
+guint
+vnc_server_get_queue_length (VNCServer *server)
+{
+    g_return_val_if_fail (server != NULL, 0);
+    return g_queue_get_length (&server->priv->queue);
+}
+
+guint
+vnc_server_get_n_rejected (VNCServer *server)
+{
+    g_return_val_if_fail (server != NULL, 0);
+    return server->priv->n_rejected;
+}
+
+static void
+queued_connection_free (QueuedConnection *connection)
+{
+    if (connection->source)
+    {
+        g_source_destroy (connection->source);
+        g_source_unref (connection->source);
+    }
+    g_object_unref (connection->socket);
+    g_free (connection->hostname);
+    g_free (connection);
+}
+
 static gboolean
-read_cb (GSocket *socket, GIOCondition condition, VNCServer *server)
+can_pass_on_connection (VNCServer *server)
+{
+    return server->priv->max_connections == 0 || g_hash_table_size (server->priv->connections) < server->priv->max_connections;
+}
+
+static void
+pass_on_connection (VNCServer *server, GSocket *socket)
+{
+    g_hash_table_add (server->priv->connections, g_object_ref (socket));
+    g_signal_emit (server, signals[NEW_CONNECTION], 0, socket);
+}
+
+static void
+reject_connection (VNCServer *server, GSocket *socket, const gchar *hostname, const gchar *reason)
+{
+    server->priv->n_rejected++;
+    g_debug ("Rejecting VNC connection from %s, %s (%u rejected)", hostname, reason, server->priv->n_rejected);
+    g_socket_close (socket, NULL);
+}
+
+static gboolean
+queued_connection_cb (GSocket *socket, GIOCondition condition, QueuedConnection *connection)
+{
+    /* VNC clients wait for the server to speak first, so this is either a disconnect or a client
+     * sending early.  Stop watching in the latter case, the data will be there for Xvnc */
+    gchar buffer;
+    ssize_t n_read = recv (g_socket_get_fd (socket), &buffer, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n_read > 0)
+    {
+        g_clear_pointer (&connection->source, g_source_unref);
+        return G_SOURCE_REMOVE;
+    }
+    if (n_read < 0 && (errno == EAGAIN || errno == EINTR))
+        return G_SOURCE_CONTINUE;
+
+    VNCServer *server = connection->server;
+    g_queue_remove (&server->priv->queue, connection);
+    g_debug ("Queued VNC connection from %s closed (%u waiting)", connection->hostname, g_queue_get_length (&server->priv->queue));
+    g_clear_pointer (&connection->source, g_source_unref);
+    queued_connection_free (connection);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+queue_connection (VNCServer *server, GSocket *socket, const gchar *hostname)
 {
-    g_autoptr(GError) error = NULL;
-    g_autoptr(GSocket) client_socket = g_socket_accept (socket, NULL, &error);
-    if (error)
-        g_warning ("Failed to get connection from from VNC socket: %s", error->message);
+    QueuedConnection *connection = g_malloc0 (sizeof (QueuedConnection));
+    connection->server = server;
+    connection->socket = g_object_ref (socket);
+    connection->hostname = g_strdup (hostname);
+    connection->source = g_socket_create_source (socket, G_IO_IN | G_IO_HUP | G_IO_ERR, NULL);
+    g_source_set_callback (connection->source, (GSourceFunc) queued_connection_cb, connection, NULL);
+    g_source_attach (connection->source, NULL);
+    g_queue_push_tail (&server->priv->queue, connection);
+
+    /* The client sees a connection that the server hasn't greeted yet until it can be passed on */
+    g_debug ("Queuing VNC connection from %s (%u waiting)", hostname, g_queue_get_length (&server->priv->queue));
+}
+
+static void
+rate_limit_free (RateLimit *limit)
+{
+    g_free (limit->hostname);
+    g_free (limit);
+}
+
+/* Token bucket allowing rate_limit connections a minute from each address */
+static gboolean
+check_rate_limit (VNCServer *server, const gchar *hostname)
+{
+    if (server->priv->rate_limit == 0)
+        return TRUE;
+
+    gint64 now = g_get_monotonic_time ();
+    RateLimit *limit = g_hash_table_lookup (server->priv->rate_limits, hostname);
+    if (limit)
+    {
+        limit->tokens = MIN (limit->tokens + (now - limit->last_time) * server->priv->rate_limit / (60.0 * G_USEC_PER_SEC), server->priv->rate_limit);
+        limit->last_time = now;
+        g_queue_unlink (&server->priv->rate_limit_order, &limit->link);
+    }
+    else
+    {
+        /* Forget the address seen longest ago so the table can't grow without bound */
+        if (g_hash_table_size (server->priv->rate_limits) >= MAX_RATE_LIMITS)
+        {
+            RateLimit *oldest = server->priv->rate_limit_order.head->data;
+            g_queue_unlink (&server->priv->rate_limit_order, &oldest->link);
+            g_hash_table_remove (server->priv->rate_limits, oldest->hostname);
+        }
+
+        limit = g_malloc0 (sizeof (RateLimit));
+        limit->hostname = g_strdup (hostname);
+        limit->tokens = server->priv->rate_limit;
+        limit->last_time = now;
+        limit->link.data = limit;
+        g_hash_table_insert (server->priv->rate_limits, limit->hostname, limit);
+    }
+    g_queue_push_tail_link (&server->priv->rate_limit_order, &limit->link);
+
+    if (limit->tokens < 1)
+        return FALSE;
+    limit->tokens--;
+
+    return TRUE;
+}
 
-    if (client_socket)
+static void
+handle_connection (VNCServer *server, GSocket *socket)
+{
+    g_autoptr(GSocketAddress) address = g_socket_get_remote_address (socket, NULL);
+    g_autofree gchar *hostname = NULL;
+    if (G_IS_INET_SOCKET_ADDRESS (address))
     {
-        GInetSocketAddress *address = G_INET_SOCKET_ADDRESS (g_socket_get_remote_address (client_socket, NULL));
-        g_autofree gchar *hostname = g_inet_address_to_string (g_inet_socket_address_get_address (address));
-        g_debug ("Got VNC connection from %s:%d", hostname, g_inet_socket_address_get_port (address));
+        hostname = g_inet_address_to_string (g_inet_socket_address_get_address (G_INET_SOCKET_ADDRESS (address)));
+        g_debug ("Got VNC connection from %s:%d", hostname, g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (address)));
+    }
+    else
+        hostname = g_strdup ("unknown address");
+
+    if (!check_rate_limit (server, hostname))
+        reject_connection (server, socket, hostname, "too many recent connections");
+    else if (can_pass_on_connection (server))
+        pass_on_connection (server, socket);
+    else if (g_queue_get_length (&server->priv->queue) < server->priv->max_queue_length)
+        queue_connection (server, socket, hostname);
+    else
+        reject_connection (server, socket, hostname, "too many connections");
+}
 
-        g_signal_emit (server, signals[NEW_CONNECTION], 0, client_socket);
+static gboolean
+read_cb (GSocket *socket, GIOCondition condition, VNCServer *server)
+{
+    /* Take all waiting connections so a burst is handled in one wakeup */
+    while (TRUE)
+    {
+        g_autoptr(GError) error = NULL;
+        g_autoptr(GSocket) client_socket = g_socket_accept (socket, NULL, &error);
+        if (!client_socket)
+        {
+            if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK))
+                g_warning ("Failed to get connection from from VNC socket: %s", error->message);
+            break;
+        }
+
+        handle_connection (server, client_socket);
     }
 
     return TRUE;
 }
 
+void
+vnc_server_release_connection (VNCServer *server, GSocket *connection)
+{
+    g_return_if_fail (server != NULL);
+
+    if (!g_hash_table_remove (server->priv->connections, connection))
+        return;
+
+    while (can_pass_on_connection (server))
+    {
+        QueuedConnection *queued = g_queue_pop_head (&server->priv->queue);
+        if (!queued)
+            break;
+
+        g_debug ("Passing on queued VNC connection from %s (%u waiting)", queued->hostname, g_queue_get_length (&server->priv->queue));
+        g_autoptr(GSocket) socket = g_object_ref (queued->socket);
+        queued_connection_free (queued);
+        pass_on_connection (server, socket);
+    }
+}
+
 static GSocket *
 open_tcp_socket (GSocketFamily family, guint port, const gchar *listen_address, GError **error)
 {
@@ -110,6 +359,7 @@ open_tcp_socket (GSocketFamily family, guint port, const gchar *listen_address,
     if (!g_socket_bind (socket, address, TRUE, error) ||
         !g_socket_listen (socket, error))
         return NULL;
+    g_socket_set_blocking (socket, FALSE);
 
     return g_steal_pointer (&socket);
 }
@@ -154,6 +404,10 @@ vnc_server_init (VNCServer *server)
 {
     server->priv = G_TYPE_INSTANCE_GET_PRIVATE (server, VNC_SERVER_TYPE, VNCServerPrivate);
     server->priv->port = 5900;
+    server->priv->connections = g_hash_table_new_full (g_direct_hash, g_direct_equal, g_object_unref, NULL);
+    g_queue_init (&server->priv->queue);
+    server->priv->rate_limits = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) rate_limit_free);
+    g_queue_init (&server->priv->rate_limit_order);
 }
 
 static void
@@ -164,6 +418,13 @@ vnc_server_finalize (GObject *object)
     g_clear_pointer (&self->priv->listen_address, g_free);
     g_clear_object (&self->priv->socket);
     g_clear_object (&self->priv->socket6);
+    g_clear_pointer (&self->priv->connections, g_hash_table_unref);
+    QueuedConnection *queued;
+    while ((queued = g_queue_pop_head (&self->priv->queue)))
+        queued_connection_free (queued);
+    /* Links are part of the entries so are freed with the table */
+    g_queue_init (&self->priv->rate_limit_order);
+    g_clear_pointer (&self->priv->rate_limits, g_hash_table_unref);
 
     G_OBJECT_CLASS (vnc_server_parent_class)->finalize (object);
 }
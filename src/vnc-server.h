@@ -48,8 +48,20 @@ void vnc_server_set_listen_address (VNCServer *server, const gchar *listen_addre
 
 const gchar *vnc_server_get_listen_address (VNCServer *server);
 
+void vnc_server_set_max_connections (VNCServer *server, guint max_connections);
+
+void vnc_server_set_max_queue_length (VNCServer *server, guint max_queue_length);
+
+void vnc_server_set_rate_limit (VNCServer *server, guint rate_limit);
+
 gboolean vnc_server_start (VNCServer *server);
 
+void vnc_server_release_connection (VNCServer *server, GSocket *connection);
+
+guint vnc_server_get_queue_length (VNCServer *server);
+
+guint vnc_server_get_n_rejected (VNCServer *server);
+
 G_END_DECLS
 
 #endif /* VNC_SERVER_H_ */
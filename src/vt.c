@@ -9,10 +9,13 @@
  * license.
  */
 
+#include <stdio.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <poll.h>
 #include <glib/gstdio.h>
+#include <glib-unix.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
@@ -23,7 +26,20 @@
 #include "vt.h"
 #include "configuration.h"
 
-static GList *used_vts = NULL;
+/* Highest VT number the kernel supports (MAX_NR_CONSOLES) */
+#define MAX_VT 63
+
+/* Number of references to each VT and a bitmap of the VTs that have any */
+static guint vt_ref_counts[MAX_VT + 1];
+static guint64 used_vts = 0;
+
+#ifdef __linux__
+/* Active VT as last read from sysfs, kept up to date while active_vt_watch exists */
+static gboolean can_watch_active_vt = TRUE;
+static gint active_vt = -1;
+static int active_vt_fd = -1;
+static guint active_vt_watch = 0;
+#endif
 
 static gint
 open_tty (void)
@@ -44,6 +60,70 @@ vt_can_multi_seat (void)
            access ("/sys/class/tty/tty0/active", F_OK) == 0;
 }
 
+#ifdef __linux__
+static gboolean
+read_active_vt (void)
+{
+    gchar buffer[16];
+    ssize_t n_read = pread (active_vt_fd, buffer, sizeof (buffer) - 1, 0);
+    if (n_read <= 0)
+        return FALSE;
+    buffer[n_read] = '\0';
+
+    gint number;
+    if (sscanf (buffer, "tty%d", &number) != 1)
+        return FALSE;
+    active_vt = number;
+
+    return TRUE;
+}
+
+static void
+stop_watching_active_vt (void)
+{
+    if (active_vt_watch)
+        g_source_remove (active_vt_watch);
+    active_vt_watch = 0;
+    if (active_vt_fd >= 0)
+        close (active_vt_fd);
+    active_vt_fd = -1;
+}
+
+static gboolean
+active_vt_changed_cb (gint fd, GIOCondition condition, gpointer data)
+{
+    if (read_active_vt ())
+        return G_SOURCE_CONTINUE;
+
+    g_debug ("Stopped watching active VT");
+    active_vt_watch = 0;
+    stop_watching_active_vt ();
+    return G_SOURCE_REMOVE;
+}
+
+/* The kernel notifies changes to the active VT as an exceptional condition on this file */
+static gboolean
+watch_active_vt (void)
+{
+    if (active_vt_watch)
+        return TRUE;
+    if (!can_watch_active_vt)
+        return FALSE;
+
+    active_vt_fd = g_open ("/sys/class/tty/tty0/active", O_RDONLY | O_CLOEXEC, 0);
+    if (active_vt_fd < 0 || !read_active_vt ())
+    {
+        g_debug ("Unable to watch active VT, will query it each time");
+        can_watch_active_vt = FALSE;
+        stop_watching_active_vt ();
+        return FALSE;
+    }
+    active_vt_watch = g_unix_fd_add (active_vt_fd, G_IO_PRI | G_IO_ERR, active_vt_changed_cb, NULL);
+
+    return TRUE;
+}
+#endif
+
 gint
 vt_get_active (void)
 {
@@ -52,6 +132,16 @@ vt_get_active (void)
     if (getuid () != 0)
         return 1;
 
+    if (watch_active_vt ())
+    {
+        /* Pick up a change the main loop hasn't got to yet */
+        struct pollfd fds = { active_vt_fd, POLLPRI, 0 };
+        if (poll (&fds, 1, 0) > 0 && !read_active_vt ())
+            stop_watching_active_vt ();
+        else
+            return active_vt;
+    }
+
     gint tty_fd = open_tty ();
     gint active = -1;
     if (tty_fd >= 0)
@@ -107,21 +197,11 @@ vt_set_active (gint number)
         }
 
         close (tty_fd);
-    }
-#endif
-}
 
-static gboolean
-vt_is_used (gint number)
-{
-    for (GList *link = used_vts; link; link = link->next)
-    {
-        int n = GPOINTER_TO_INT (link->data);
-        if (n == number)
-            return TRUE;
+        if (active_vt_watch)
+            active_vt = number;
     }
-
-    return FALSE;
+#endif
 }
 
 gint
@@ -141,8 +221,24 @@ vt_get_unused (void)
         return -1;
 
     gint number = vt_get_min ();
-    while (vt_is_used (number))
+    if (number > MAX_VT)
+    {
+        g_warning ("Minimum VT %d is higher than the largest supported VT %d", number, MAX_VT);
+        return -1;
+    }
+
+    /* Find the lowest VT from the minimum that has no references */
+    guint64 unused_vts = ~used_vts >> number;
+    if (unused_vts == 0)
+    {
+        g_warning ("No unused VTs");
+        return -1;
+    }
+    while ((unused_vts & 1) == 0)
+    {
+        unused_vts >>= 1;
         number++;
+    }
 
     return number;
 }
@@ -151,12 +247,21 @@ void
 vt_ref (gint number)
 {
     g_debug ("Using VT %d", number);
-    used_vts = g_list_append (used_vts, GINT_TO_POINTER (number));
+
+    if (number < 1 || number > MAX_VT)
+        return;
+    vt_ref_counts[number]++;
+    used_vts |= G_GUINT64_CONSTANT (1) << number;
 }
 
 void
 vt_unref (gint number)
 {
     g_debug ("Releasing VT %d", number);
-    used_vts = g_list_remove (used_vts, GINT_TO_POINTER (number));
+
+    if (number < 1 || number > MAX_VT || vt_ref_counts[number] == 0)
+        return;
+    vt_ref_counts[number]--;
+    if (vt_ref_counts[number] == 0)
+        used_vts &= ~(G_GUINT64_CONSTANT (1) << number);
 }
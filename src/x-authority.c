@@ -176,7 +176,7 @@ x_authority_get_authorization_data_length (XAuthority *auth)
 }
 
 static gboolean
-read_uint16 (gchar *data, gsize data_length, gsize *offset, guint16 *value)
+read_uint16 (const guint8 *data, gsize data_length, gsize *offset, guint16 *value)
 {
     if (data_length - *offset < 2)
         return FALSE;
@@ -188,52 +188,71 @@ read_uint16 (gchar *data, gsize data_length, gsize *offset, guint16 *value)
 }
 
 static gboolean
-read_data (gchar *data, gsize data_length, gsize *offset, guint16 length, guint8 **value)
+read_counted_data (const guint8 *data, gsize data_length, gsize *offset, const guint8 **value, guint16 *length)
 {
-    g_free (*value);
-    *value = NULL;
+    if (!read_uint16 (data, data_length, offset, length))
+        return FALSE;
 
-    if (data_length - *offset < length)
+    if (data_length - *offset < *length)
         return FALSE;
 
-    *value = g_malloc0 (length + 1);
-    for (int i = 0; i < length; i++)
-        (*value)[i] = data[*offset + i];
-    *offset += length;
-    (*value)[length] = 0;
+    *value = data + *offset;
+    *offset += *length;
 
     return TRUE;
 }
 
-static gboolean
-read_string (gchar *data, gsize data_length, gsize *offset, gchar **value)
-{
-    guint16 length;
-    if (!read_uint16 (data, data_length, offset, &length))
-        return FALSE;
-    return read_data (data, data_length, offset, length, (guint8 **) value);
-}
-
-static gboolean
-write_uint16 (int fd, guint16 value)
+static void
+append_uint16 (GByteArray *buffer, guint16 value)
 {
     guint8 v[2];
     v[0] = value >> 8;
     v[1] = value & 0xFF;
-    return write (fd, v, 2) == 2;
+    g_byte_array_append (buffer, v, 2);
 }
 
-static gboolean
-write_data (int fd, const guint8 *value, gsize value_length)
+static void
+append_counted_data (GByteArray *buffer, const guint8 *value, gsize value_length)
 {
-    return write (fd, value, value_length) == value_length;
+    append_uint16 (buffer, value_length);
+    g_byte_array_append (buffer, value, value_length);
+}
+
+static gsize
+get_record_length (XAuthority *auth)
+{
+    return 2 + 2 + auth->priv->address_length + 2 + strlen (auth->priv->number) + 2 + strlen (auth->priv->authorization_name) + 2 + auth->priv->authorization_data_length;
 }
 
 static gboolean
-write_string (int fd, const gchar *value)
+write_all (int fd, const guint8 *data, gsize data_length)
 {
-    size_t value_length = strlen (value);
-    return write_uint16 (fd, value_length) && write_data (fd, (guint8 *) value, value_length);
+    gsize n_written = 0;
+    while (n_written < data_length)
+    {
+        ssize_t n = write (fd, data + n_written, data_length - n_written);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return FALSE;
+        n_written += n;
+    }
+
+    return TRUE;
+}
+
+/* Replace the file the Xauthority path points to rather than any symbolic link to it */
+static gchar *
+resolve_filename (const gchar *filename)
+{
+    g_autofree gchar *target = g_file_read_link (filename, NULL);
+    if (!target)
+        return g_strdup (filename);
+    if (g_path_is_absolute (target))
+        return g_steal_pointer (&target);
+
+    g_autofree gchar *dir = g_path_get_dirname (filename);
+    return g_build_filename (dir, target, NULL);
 }
 
 gboolean
@@ -242,68 +261,75 @@ x_authority_write (XAuthority *auth, XAuthWriteMode mode, const gchar *filename,
     g_return_val_if_fail (auth != NULL, FALSE);
     g_return_val_if_fail (filename != NULL, FALSE);
 
+    g_autofree gchar *path = resolve_filename (filename);
+
     /* Read out existing records */
     g_autofree gchar *input = NULL;
-    gsize input_length = 0, input_offset = 0;
+    gsize input_length = 0;
     if (mode != XAUTH_WRITE_MODE_SET)
     {
         g_autoptr(GError) read_error = NULL;
-        g_file_get_contents (filename, &input, &input_length, &read_error);
+        g_file_get_contents (path, &input, &input_length, &read_error);
         if (read_error && !g_error_matches (read_error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
             g_warning ("Error reading existing Xauthority: %s", read_error->message);
     }
-    GList *records = NULL;
+
+    /* Build the new file in memory so it can be written in one go.
+     * Records that don't match are copied through unchanged without being decoded further. */
+    g_autoptr(GByteArray) output = g_byte_array_sized_new (input_length + get_record_length (auth));
+    const guint8 *data = (const guint8 *) input;
+    gsize auth_number_length = strlen (auth->priv->number);
+    gsize input_offset = 0;
     gboolean matched = FALSE;
     while (input_offset != input_length)
     {
-        g_autoptr(XAuthority) a = g_object_new (X_AUTHORITY_TYPE, NULL);
-
-        guint16 address_length = 0;
-        guint16 authorization_data_length = 0;
-        gboolean result = read_uint16 (input, input_length, &input_offset, &a->priv->family) &&
-                          read_uint16 (input, input_length, &input_offset, &address_length) &&
-                          read_data (input, input_length, &input_offset, address_length, &a->priv->address) &&
-                          read_string (input, input_length, &input_offset, &a->priv->number) &&
-                          read_string (input, input_length, &input_offset, &a->priv->authorization_name) &&
-                          read_uint16 (input, input_length, &input_offset, &authorization_data_length) &&
-                          read_data (input, input_length, &input_offset, authorization_data_length, &a->priv->authorization_data);
-        a->priv->address_length = address_length;
-        a->priv->authorization_data_length = authorization_data_length;
-
+        gsize record_start = input_offset;
+        guint16 family, address_length, number_length, name_length, authorization_data_length;
+        const guint8 *address, *number, *name, *authorization_data;
+        gboolean result = read_uint16 (data, input_length, &input_offset, &family) &&
+                          read_counted_data (data, input_length, &input_offset, &address, &address_length) &&
+                          read_counted_data (data, input_length, &input_offset, &number, &number_length) &&
+                          read_counted_data (data, input_length, &input_offset, &name, &name_length) &&
+                          read_counted_data (data, input_length, &input_offset, &authorization_data, &authorization_data_length);
         if (!result)
             break;
 
-        gboolean address_matches = FALSE;
-        if (auth->priv->address_length == a->priv->address_length)
-        {
-            guint16 i;
-            for (i = 0; i < auth->priv->address_length && auth->priv->address[i] == a->priv->address[i]; i++);
-            address_matches = i == auth->priv->address_length;
-        }
-
         /* If this record matches, then update or delete it */
         if (!matched &&
-            auth->priv->family == a->priv->family &&
-            address_matches &&
-            strcmp (auth->priv->number, a->priv->number) == 0)
+            family == auth->priv->family &&
+            address_length == auth->priv->address_length &&
+            number_length == auth_number_length &&
+            memcmp (address, auth->priv->address, address_length) == 0 &&
+            memcmp (number, auth->priv->number, auth_number_length) == 0)
         {
             matched = TRUE;
             if (mode == XAUTH_WRITE_MODE_REMOVE)
                 continue;
-            else
-                x_authority_set_authorization_data (a, auth->priv->authorization_data, auth->priv->authorization_data_length);
-        }
 
-        records = g_list_append (records, g_steal_pointer (&a));
+            append_uint16 (output, family);
+            append_counted_data (output, address, address_length);
+            append_counted_data (output, number, number_length);
+            append_counted_data (output, name, name_length);
+            append_counted_data (output, auth->priv->authorization_data, auth->priv->authorization_data_length);
+        }
+        else
+            g_byte_array_append (output, data + record_start, input_offset - record_start);
     }
 
     /* If didn't exist, then add a new one */
-    if (!matched)
-        records = g_list_append (records, g_object_ref (auth));
+    if (!matched && mode != XAUTH_WRITE_MODE_REMOVE)
+    {
+        append_uint16 (output, auth->priv->family);
+        append_counted_data (output, auth->priv->address, auth->priv->address_length);
+        append_counted_data (output, (const guint8 *) auth->priv->number, auth_number_length);
+        append_counted_data (output, (const guint8 *) auth->priv->authorization_name, strlen (auth->priv->authorization_name));
+        append_counted_data (output, auth->priv->authorization_data, auth->priv->authorization_data_length);
+    }
 
-    /* Write records back */
+    /* Write to a temporary file and move it into place so readers never see a partial file */
+    g_autofree gchar *temp_path = g_strdup_printf ("%s.XXXXXX", path);
     errno = 0;
-    int output_fd = g_open (filename, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
+    int output_fd = g_mkstemp_full (temp_path, O_WRONLY | O_CLOEXEC, S_IRUSR | S_IWUSR);
     if (output_fd < 0)
     {
         g_set_error (error,
@@ -316,32 +342,28 @@ x_authority_write (XAuthority *auth, XAuthWriteMode mode, const gchar *filename,
     }
 
     errno = 0;
-    gboolean result = TRUE;
-    for (GList *link = records; link && result; link = link->next)
+    gboolean result = write_all (output_fd, output->data, output->len) && fsync (output_fd) == 0;
+    int write_errno = errno;
+    if (close (output_fd) != 0 && result)
     {
-        XAuthority *a = link->data;
-
-        result = write_uint16 (output_fd, a->priv->family) &&
-                 write_uint16 (output_fd, a->priv->address_length) &&
-                 write_data (output_fd, a->priv->address, a->priv->address_length) &&
-                 write_string (output_fd, a->priv->number) &&
-                 write_string (output_fd, a->priv->authorization_name) &&
-                 write_uint16 (output_fd, a->priv->authorization_data_length) &&
-                 write_data (output_fd, a->priv->authorization_data, a->priv->authorization_data_length);
+        result = FALSE;
+        write_errno = errno;
+    }
+    if (result && g_rename (temp_path, path) != 0)
+    {
+        result = FALSE;
+        write_errno = errno;
     }
-    g_list_free_full (records, g_object_unref);
-
-    fsync (output_fd);
-    close (output_fd);
 
     if (!result)
     {
+        g_unlink (temp_path);
         g_set_error (error,
                      G_FILE_ERROR,
-                     g_file_error_from_errno (errno),
+                     g_file_error_from_errno (write_errno),
                      "Failed to write X authority %s: %s",
                      filename,
-                     g_strerror (errno));
+                     g_strerror (write_errno));
         return FALSE;
     }
 
@@ -10,11 +10,13 @@
  */
 
 #include <config.h>
+#include <stdio.h>
 #include <string.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <errno.h>
 #include <glib/gstdio.h>
+#include <glib-unix.h>
 #include <stdlib.h>
 
 #include "x-server-local.h"
@@ -57,6 +59,15 @@ struct XServerLocalPrivate
     /* XDMCP key to use */
     gchar *xdmcp_key;
 
+    /* TRUE if the X server reports when it is ready using -displayfd */
+    gboolean use_displayfd;
+
+    /* Pipe the X server writes its display number to when ready */
+    int displayfd_pipe[2];
+    guint displayfd_watch;
+    gchar displayfd_buffer[16];
+    gsize displayfd_buffer_length;
+
     /* TRUE when received ready signal */
     gboolean got_signal;
 
@@ -75,10 +86,44 @@ G_DEFINE_TYPE_WITH_CODE (XServerLocal, x_server_local, X_SERVER_TYPE,
 
 static gchar *version = NULL;
 static guint version_major = 0, version_minor = 0;
-static GList *display_numbers = NULL;
+
+/* Bitmap of display numbers used by X servers we manage */
+static guint64 *used_display_numbers = NULL;
+static guint used_display_numbers_length = 0;
+
+/* Version detection runs in a worker thread, started early when the version will be needed and again if it failed */
+static GMutex version_lock;
+static GCond version_cond;
+static gboolean version_detection_running = FALSE;
+static gboolean have_version = FALSE;
 
 #define XORG_VERSION_PREFIX "X.Org X Server "
 
+/* Name of the file in the cache directory the detected version is stored in */
+#define VERSION_CACHE_FILE "xserver-version"
+#define VERSION_CACHE_GROUP "XServer"
+
+typedef struct
+{
+    /* Absolute path to the X binary */
+    gchar *path;
+
+    /* Identity of the binary the version was detected from */
+    guint64 inode;
+    gint64 mtime;
+
+    /* File to write the detected version to */
+    gchar *cache_file;
+} VersionCacheKey;
+
+static void
+version_cache_key_free (VersionCacheKey *key)
+{
+    g_free (key->path);
+    g_free (key->cache_file);
+    g_free (key);
+}
+
 static gchar *
 find_version (const gchar *line)
 {
@@ -88,27 +133,162 @@ find_version (const gchar *line)
     return g_strdup (line + strlen (XORG_VERSION_PREFIX));
 }
 
-const gchar *
-x_server_local_get_version (void)
+/* Called with version_lock held; a NULL version means detection failed and should be tried again next time */
+static void
+set_version (gchar *new_version)
 {
+    g_free (version);
+    version = new_version;
+
+    version_major = version_minor = 0;
     if (version)
-        return version;
+    {
+        g_auto(GStrv) tokens = g_strsplit (version, ".", 3);
+        guint n_tokens = g_strv_length (tokens);
+        version_major = n_tokens > 0 ? atoi (tokens[0]) : 0;
+        version_minor = n_tokens > 1 ? atoi (tokens[1]) : 0;
+    }
 
+    have_version = version != NULL;
+    version_detection_running = FALSE;
+    g_cond_broadcast (&version_cond);
+}
+
+static gchar *
+run_version_command (const gchar *path)
+{
+    g_autofree gchar *command = g_strdup_printf ("%s -version", path);
     g_autofree gchar *stderr_text = NULL;
     gint exit_status;
-    if (!g_spawn_command_line_sync ("X -version", NULL, &stderr_text, &exit_status, NULL))
+    if (!g_spawn_command_line_sync (command, NULL, &stderr_text, &exit_status, NULL))
         return NULL;
+
+    gchar *result = NULL;
     if (exit_status == EXIT_SUCCESS)
     {
         g_auto(GStrv) lines = g_strsplit (stderr_text, "\n", -1);
-        for (int i = 0; lines[i] && !version; i++)
-            version = find_version (lines[i]);
+        for (int i = 0; lines[i] && !result; i++)
+            result = find_version (lines[i]);
+    }
+
+    return result;
+}
+
+static VersionCacheKey *
+get_version_cache_key (void)
+{
+    g_autofree gchar *path = g_find_program_in_path ("X");
+    if (!path)
+        return NULL;
+
+    struct stat info;
+    if (stat (path, &info) < 0)
+        return NULL;
+
+    VersionCacheKey *key = g_malloc0 (sizeof (VersionCacheKey));
+    key->path = g_steal_pointer (&path);
+    key->inode = info.st_ino;
+    key->mtime = info.st_mtime;
+    g_autofree gchar *cache_dir = config_get_string (config_get_instance (), "LightDM", "cache-directory");
+    key->cache_file = g_build_filename (cache_dir, VERSION_CACHE_FILE, NULL);
+
+    return key;
+}
+
+static gchar *
+load_cached_version (VersionCacheKey *key)
+{
+    g_autoptr(GKeyFile) cache = g_key_file_new ();
+    if (!g_key_file_load_from_file (cache, key->cache_file, G_KEY_FILE_NONE, NULL))
+        return NULL;
+
+    /* Only use the cached version if it was detected from this exact binary */
+    g_autofree gchar *path = g_key_file_get_string (cache, VERSION_CACHE_GROUP, "path", NULL);
+    if (g_strcmp0 (path, key->path) != 0 ||
+        g_key_file_get_uint64 (cache, VERSION_CACHE_GROUP, "inode", NULL) != key->inode ||
+        g_key_file_get_int64 (cache, VERSION_CACHE_GROUP, "mtime", NULL) != key->mtime)
+        return NULL;
+
+    return g_key_file_get_string (cache, VERSION_CACHE_GROUP, "version", NULL);
+}
+
+static void
+save_cached_version (VersionCacheKey *key, const gchar *detected_version)
+{
+    g_autoptr(GKeyFile) cache = g_key_file_new ();
+    g_key_file_set_string (cache, VERSION_CACHE_GROUP, "path", key->path);
+    g_key_file_set_uint64 (cache, VERSION_CACHE_GROUP, "inode", key->inode);
+    g_key_file_set_int64 (cache, VERSION_CACHE_GROUP, "mtime", key->mtime);
+    g_key_file_set_string (cache, VERSION_CACHE_GROUP, "version", detected_version);
+
+    g_autoptr(GError) error = NULL;
+    if (!g_key_file_save_to_file (cache, key->cache_file, &error))
+        g_warning ("Failed to write X server version cache %s: %s", key->cache_file, error->message);
+}
+
+static void
+detect_version_thread (GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+    VersionCacheKey *key = task_data;
+
+    gchar *detected_version = run_version_command (key->path);
+    if (detected_version)
+        save_cached_version (key, detected_version);
+
+    g_mutex_lock (&version_lock);
+    set_version (detected_version);
+    g_mutex_unlock (&version_lock);
+
+    g_task_return_boolean (task, TRUE);
+}
+
+void
+x_server_local_start_version_detection (void)
+{
+    g_mutex_lock (&version_lock);
+    gboolean start = !have_version && !version_detection_running;
+    if (start)
+        version_detection_running = TRUE;
+    g_mutex_unlock (&version_lock);
+    if (!start)
+        return;
+
+    VersionCacheKey *key = get_version_cache_key ();
+    if (!key)
+    {
+        g_mutex_lock (&version_lock);
+        set_version (NULL);
+        g_mutex_unlock (&version_lock);
+        return;
+    }
+
+    gchar *cached_version = load_cached_version (key);
+    if (cached_version)
+    {
+        g_debug ("Using cached X server version %s", cached_version);
+        g_mutex_lock (&version_lock);
+        set_version (cached_version);
+        g_mutex_unlock (&version_lock);
+        version_cache_key_free (key);
+        return;
     }
 
-    g_auto(GStrv) tokens = g_strsplit (version, ".", 3);
-    guint n_tokens = g_strv_length (tokens);
-    version_major = n_tokens > 0 ? atoi (tokens[0]) : 0;
-    version_minor = n_tokens > 1 ? atoi (tokens[1]) : 0;
+    /* Run X -version in the background, it is only waited for if the version is needed */
+    g_autoptr(GTask) task = g_task_new (NULL, NULL, NULL, NULL);
+    g_task_set_task_data (task, key, (GDestroyNotify) version_cache_key_free);
+    g_task_run_in_thread (task, detect_version_thread);
+}
+
+const gchar *
+x_server_local_get_version (void)
+{
+    /* Only blocks if detection hasn't finished since it was started early */
+    x_server_local_start_version_detection ();
+
+    g_mutex_lock (&version_lock);
+    while (version_detection_running)
+        g_cond_wait (&version_cond, &version_lock);
+    g_mutex_unlock (&version_lock);
 
     return version;
 }
@@ -124,42 +304,84 @@ x_server_local_version_compare (guint major, guint minor)
 }
 
 static gboolean
-display_number_in_use (guint display_number)
+display_number_is_used (guint display_number)
 {
-    /* See if we know we are managing a server with that number */
-    for (GList *link = display_numbers; link; link = link->next)
+    guint index = display_number / 64;
+    if (index >= used_display_numbers_length)
+        return FALSE;
+    return (used_display_numbers[index] & ((guint64) 1 << (display_number % 64))) != 0;
+}
+
+static void
+set_display_number_used (guint display_number, gboolean used)
+{
+    guint index = display_number / 64;
+    if (index >= used_display_numbers_length)
     {
-        guint number = GPOINTER_TO_UINT (link->data);
-        if (number == display_number)
-            return TRUE;
+        if (!used)
+            return;
+        guint length = MAX (index + 1, used_display_numbers_length * 2);
+        used_display_numbers = g_renew (guint64, used_display_numbers, length);
+        memset (used_display_numbers + used_display_numbers_length, 0, sizeof (guint64) * (length - used_display_numbers_length));
+        used_display_numbers_length = length;
     }
 
-    /* See if an X server that we don't know of has a lock on that number */
-    g_autofree gchar *path = g_strdup_printf ("/tmp/.X%d-lock", display_number);
-    gboolean in_use = g_file_test (path, G_FILE_TEST_EXISTS);
+    if (used)
+        used_display_numbers[index] |= (guint64) 1 << (display_number % 64);
+    else
+        used_display_numbers[index] &= ~((guint64) 1 << (display_number % 64));
+}
 
-    /* See if that lock file is valid, ignore it if the contents are invalid or the process doesn't exist */
+static gboolean
+lock_file_is_valid (guint display_number)
+{
+    /* Only the lock for this number is looked at, so other files in /tmp don't matter */
+    g_autofree gchar *path = g_strdup_printf ("/tmp/.X%d-lock", display_number);
     g_autofree gchar *data = NULL;
-    if (in_use && g_file_get_contents (path, &data, NULL, NULL))
-    {
-        int pid = atoi (g_strstrip (data));
+    g_autoptr(GError) error = NULL;
+    if (!g_file_get_contents (path, &data, NULL, &error))
+        return !g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT);
 
-        errno = 0;
-        if (pid < 0 || (kill (pid, 0) < 0 && errno == ESRCH))
-            in_use = FALSE;
-    }
+    /* Ignore the lock if the contents are invalid or the process doesn't exist */
+    int pid = atoi (g_strstrip (data));
+    errno = 0;
+    if (pid < 0 || (kill (pid, 0) < 0 && errno == ESRCH))
+        return FALSE;
 
-    return in_use;
+    return TRUE;
+}
+
+static gboolean
+display_number_in_use (guint display_number)
+{
+    /* See if we know we are managing a server with that number */
+    if (display_number_is_used (display_number))
+        return TRUE;
+
+    /* See if an X server that we don't know of has a lock on that number */
+    return lock_file_is_valid (display_number);
 }
 
 guint
 x_server_local_get_unused_display_number (void)
 {
     guint number = config_get_integer (config_get_instance (), "LightDM", "minimum-display-number");
-    while (display_number_in_use (number))
+    while (TRUE)
+    {
+        /* Skip over blocks of numbers we are already using */
+        guint index = number / 64;
+        if (index < used_display_numbers_length && used_display_numbers[index] == G_MAXUINT64)
+        {
+            number = (index + 1) * 64;
+            continue;
+        }
+
+        if (!display_number_in_use (number))
+            break;
         number++;
+    }
 
-    display_numbers = g_list_append (display_numbers, GUINT_TO_POINTER (number));
+    set_display_number_used (number, TRUE);
 
     return number;
 }
@@ -167,15 +389,7 @@ x_server_local_get_unused_display_number (void)
 void
 x_server_local_release_display_number (guint display_number)
 {
-    for (GList *link = display_numbers; link; link = link->next)
-    {
-        guint number = GPOINTER_TO_UINT (link->data);
-        if (number == display_number)
-        {
-            display_numbers = g_list_delete_link (display_numbers, link);
-            return;
-        }
-    }
+    set_display_number_used (display_number, FALSE);
 }
 
 XServerLocal *
@@ -238,6 +452,13 @@ x_server_local_set_allow_tcp (XServerLocal *server, gboolean allow_tcp)
     server->priv->allow_tcp = allow_tcp;
 }
 
+void
+x_server_local_set_use_displayfd (XServerLocal *server, gboolean use_displayfd)
+{
+    g_return_if_fail (server != NULL);
+    server->priv->use_displayfd = use_displayfd;
+}
+
 void
 x_server_local_set_xdmcp_server (XServerLocal *server, const gchar *hostname)
 {
@@ -338,23 +559,106 @@ x_server_local_get_run_function (XServerLocal *server)
     return x_server_local_run;
 }
 
+static void
+run_cb (Process *process, gpointer user_data)
+{
+    XServerLocal *server = user_data;
+
+    /* Let the X server inherit the end of the pipe it reports its display number on */
+    if (server->priv->displayfd_pipe[1] >= 0)
+        fcntl (server->priv->displayfd_pipe[1], F_SETFD, 0);
+
+    ProcessRunFunc run_func = X_SERVER_LOCAL_GET_CLASS (server)->get_run_function (server);
+    if (run_func)
+        run_func (process, user_data);
+}
+
 static gboolean
 x_server_local_get_log_stdout (XServerLocal *server)
 {
     return TRUE;
 }
 
+static void
+x_server_ready (XServerLocal *server)
+{
+    server->priv->got_signal = TRUE;
+
+    // FIXME: Check return value
+    DISPLAY_SERVER_CLASS (x_server_local_parent_class)->start (DISPLAY_SERVER (server));
+}
+
 static void
 got_signal_cb (Process *process, int signum, XServerLocal *server)
 {
     if (signum == SIGUSR1 && !server->priv->got_signal)
     {
-        server->priv->got_signal = TRUE;
         l_debug (server, "Got signal from X server :%d", server->priv->display_number);
+        x_server_ready (server);
+    }
+}
+
+static void
+close_displayfd (XServerLocal *server)
+{
+    if (server->priv->displayfd_watch)
+        g_source_remove (server->priv->displayfd_watch);
+    server->priv->displayfd_watch = 0;
+    for (int i = 0; i < 2; i++)
+    {
+        if (server->priv->displayfd_pipe[i] >= 0)
+            close (server->priv->displayfd_pipe[i]);
+        server->priv->displayfd_pipe[i] = -1;
+    }
+    server->priv->displayfd_buffer_length = 0;
+}
+
+static gboolean
+displayfd_cb (gint fd, GIOCondition condition, gpointer data)
+{
+    XServerLocal *server = data;
+
+    gsize buffer_size = sizeof (server->priv->displayfd_buffer) - 1;
+    ssize_t n_read = read (fd, server->priv->displayfd_buffer + server->priv->displayfd_buffer_length, buffer_size - server->priv->displayfd_buffer_length);
+    if (n_read < 0 && errno == EINTR)
+        return G_SOURCE_CONTINUE;
+    if (n_read <= 0)
+    {
+        /* The X server closed the pipe without reporting, it will be detected as stopped */
+        server->priv->displayfd_watch = 0;
+        close_displayfd (server);
+        return G_SOURCE_REMOVE;
+    }
+    server->priv->displayfd_buffer_length += n_read;
+    server->priv->displayfd_buffer[server->priv->displayfd_buffer_length] = '\0';
 
-        // FIXME: Check return value
-        DISPLAY_SERVER_CLASS (x_server_local_parent_class)->start (DISPLAY_SERVER (server));
+    /* The display number is written as a line of text once the server is ready */
+    gchar *end = strchr (server->priv->displayfd_buffer, '\n');
+    if (!end)
+    {
+        if (server->priv->displayfd_buffer_length < buffer_size)
+            return G_SOURCE_CONTINUE;
+        l_warning (server, "Ignoring invalid display number from X server");
+        server->priv->displayfd_watch = 0;
+        close_displayfd (server);
+        return G_SOURCE_REMOVE;
     }
+    *end = '\0';
+
+    guint display_number = atoi (server->priv->displayfd_buffer);
+    if (display_number != server->priv->display_number)
+        l_warning (server, "X server reported display number %d, expected %d", display_number, server->priv->display_number);
+
+    server->priv->displayfd_watch = 0;
+    close_displayfd (server);
+
+    if (!server->priv->got_signal)
+    {
+        l_debug (server, "Got display number from X server :%d", server->priv->display_number);
+        x_server_ready (server);
+    }
+
+    return G_SOURCE_REMOVE;
 }
 
 static void
@@ -362,6 +666,8 @@ stopped_cb (Process *process, XServerLocal *server)
 {
     l_debug (server, "X server stopped");
 
+    close_displayfd (server);
+
     /* Release VT and display number for re-use */
     if (server->priv->have_vt_ref)
     {
@@ -422,7 +728,6 @@ x_server_local_start (DisplayServer *display_server)
 
     g_return_val_if_fail (server->priv->command != NULL, FALSE);
 
-    ProcessRunFunc run_cb = X_SERVER_LOCAL_GET_CLASS (server)->get_run_function (server);
     server->priv->x_server_process = process_new (run_cb, server);
     process_set_clear_environment (server->priv->x_server_process, TRUE);
     g_signal_connect (server->priv->x_server_process, PROCESS_SIGNAL_GOT_SIGNAL, G_CALLBACK (got_signal_cb), server);
@@ -483,6 +788,16 @@ x_server_local_start (DisplayServer *display_server)
     if (server->priv->background)
         g_string_append_printf (command, " -background %s", server->priv->background);
 
+    /* Have the X server report when it is ready on a pipe instead of by signal */
+    if (server->priv->use_displayfd)
+    {
+        g_autoptr(GError) error = NULL;
+        if (g_unix_open_pipe (server->priv->displayfd_pipe, FD_CLOEXEC, &error))
+            g_string_append_printf (command, " -displayfd %d", server->priv->displayfd_pipe[1]);
+        else
+            l_warning (server, "Failed to create display number pipe: %s", error->message);
+    }
+
     /* Allow sub-classes to add arguments */
     if (X_SERVER_LOCAL_GET_CLASS (server)->add_args)
         X_SERVER_LOCAL_GET_CLASS (server)->add_args (server, command);
@@ -517,7 +832,15 @@ x_server_local_start (DisplayServer *display_server)
         process_set_env (server->priv->x_server_process, "LIGHTDM_TEST_ROOT", g_getenv ("LIGHTDM_TEST_ROOT"));
 
     gboolean result = process_start (server->priv->x_server_process, FALSE);
-    if (result)
+    if (result && server->priv->displayfd_pipe[1] >= 0)
+    {
+        /* Only the X server should hold the write end so we see it close if the server fails */
+        close (server->priv->displayfd_pipe[1]);
+        server->priv->displayfd_pipe[1] = -1;
+        server->priv->displayfd_watch = g_unix_fd_add (server->priv->displayfd_pipe[0], G_IO_IN | G_IO_HUP | G_IO_ERR, displayfd_cb, server);
+        l_debug (display_server, "Waiting for display number from X server :%d", server->priv->display_number);
+    }
+    else if (result)
         l_debug (display_server, "Waiting for ready signal from X server :%d", server->priv->display_number);
     else
         stopped_cb (server->priv->x_server_process, X_SERVER_LOCAL (server));
@@ -536,6 +859,7 @@ x_server_local_init (XServerLocal *server)
 {
     server->priv = G_TYPE_INSTANCE_GET_PRIVATE (server, X_SERVER_LOCAL_TYPE, XServerLocalPrivate);
     server->priv->vt = -1;
+    server->priv->displayfd_pipe[0] = server->priv->displayfd_pipe[1] = -1;
     server->priv->command = g_strdup ("X");
     server->priv->display_number = x_server_local_get_unused_display_number ();
 }
@@ -548,6 +872,7 @@ x_server_local_finalize (GObject *object)
     if (self->priv->x_server_process)
         g_signal_handlers_disconnect_matched (self->priv->x_server_process, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, self);
     g_clear_object (&self->priv->x_server_process);
+    close_displayfd (self);
     g_clear_pointer (&self->priv->command, g_free);
     g_clear_pointer (&self->priv->config_file, g_free);
     g_clear_pointer (&self->priv->layout, g_free);
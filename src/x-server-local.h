@@ -42,6 +42,8 @@ typedef struct
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (XServerLocal, g_object_unref)
 
+void x_server_local_start_version_detection (void);
+
 const gchar *x_server_local_get_version (void);
 
 gint x_server_local_version_compare (guint major, guint minor);
@@ -66,6 +68,8 @@ void x_server_local_set_xdg_seat (XServerLocal *server, const gchar *xdg_seat);
 
 void x_server_local_set_allow_tcp (XServerLocal *server, gboolean allow_tcp);
 
+void x_server_local_set_use_displayfd (XServerLocal *server, gboolean use_displayfd);
+
 void x_server_local_set_xdmcp_server (XServerLocal *server, const gchar *hostname);
 
 const gchar *x_server_local_get_xdmcp_server (XServerLocal *server);
@@ -11,6 +11,8 @@
 
 #include <config.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
 #include <xcb/xcb.h>
 
 #include "x-server.h"
@@ -29,8 +31,22 @@ struct XServerPrivate
 
     /* Connection to this X server */
     xcb_connection_t *connection;
+
+    /* Number of seconds to wait for a remote X server to accept a connection */
+    guint connect_timeout;
+
+    /* Connection being made to a remote X server */
+    GCancellable *connect_cancellable;
+    guint connect_timeout_id;
+    gboolean connect_timed_out;
+
+    /* Socket the X setup is being done on, shut down to abandon it */
+    GSocket *connect_socket;
 };
 
+/* TCP port of display :0 */
+#define X_TCP_PORT 6000
+
 G_DEFINE_TYPE (XServer, x_server, DISPLAY_SERVER_TYPE)
 
 void
@@ -90,6 +106,13 @@ x_server_get_authority (XServer *server)
     return server->priv->authority;
 }
 
+void
+x_server_set_connect_timeout (XServer *server, guint timeout)
+{
+    g_return_if_fail (server != NULL);
+    server->priv->connect_timeout = timeout;
+}
+
 static const gchar *
 x_server_get_session_type (DisplayServer *server)
 {
@@ -102,24 +125,181 @@ x_server_get_can_share (DisplayServer *server)
     return TRUE;
 }
 
+static xcb_auth_info_t *
+get_auth_info (XAuthority *authority, xcb_auth_info_t *auth)
+{
+    if (!authority)
+        return NULL;
+
+    auth->namelen = strlen (x_authority_get_authorization_name (authority));
+    auth->name = (char *) x_authority_get_authorization_name (authority);
+    auth->datalen = x_authority_get_authorization_data_length (authority);
+    auth->data = (char *) x_authority_get_authorization_data (authority);
+
+    return auth;
+}
+
+/* Abandon a connection in progress, whichever step it is at */
+static void
+cancel_connect (XServer *server)
+{
+    g_cancellable_cancel (server->priv->connect_cancellable);
+    if (server->priv->connect_socket)
+        g_socket_shutdown (server->priv->connect_socket, TRUE, TRUE, NULL);
+}
+
+static void
+finish_connect (XServer *server)
+{
+    if (server->priv->connect_timeout_id)
+        g_source_remove (server->priv->connect_timeout_id);
+    server->priv->connect_timeout_id = 0;
+    g_clear_object (&server->priv->connect_cancellable);
+    g_clear_object (&server->priv->connect_socket);
+}
+
+static gboolean
+connect_timeout_cb (gpointer data)
+{
+    XServer *server = data;
+
+    server->priv->connect_timeout_id = 0;
+    server->priv->connect_timed_out = TRUE;
+    cancel_connect (server);
+
+    return G_SOURCE_REMOVE;
+}
+
+typedef struct
+{
+    int fd;
+    XAuthority *authority;
+} SetupData;
+
+static void
+setup_data_free (SetupData *data)
+{
+    if (data->fd >= 0)
+        close (data->fd);
+    g_clear_object (&data->authority);
+    g_free (data);
+}
+
+static void
+setup_thread (GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+    SetupData *data = task_data;
+
+    /* XCB takes the file descriptor, even if it fails */
+    xcb_auth_info_t a;
+    xcb_connection_t *connection = xcb_connect_to_fd (data->fd, get_auth_info (data->authority, &a));
+    data->fd = -1;
+
+    g_task_return_pointer (task, connection, (GDestroyNotify) xcb_disconnect);
+}
+
+static void
+setup_cb (GObject *object, GAsyncResult *result, gpointer data)
+{
+    XServer *server = X_SERVER (object);
+
+    xcb_connection_t *connection = g_task_propagate_pointer (G_TASK (result), NULL);
+    finish_connect (server);
+
+    /* Stopped while connecting */
+    if (display_server_get_is_stopping (DISPLAY_SERVER (server)))
+    {
+        xcb_disconnect (connection);
+        return;
+    }
+
+    server->priv->connection = connection;
+    if (xcb_connection_has_error (server->priv->connection))
+    {
+        if (server->priv->connect_timed_out)
+            l_debug (server, "Timed out waiting for XServer %s to accept connection", x_server_get_address (server));
+        else
+            l_debug (server, "Error connecting to XServer %s", x_server_get_address (server));
+        DISPLAY_SERVER_CLASS (x_server_parent_class)->stop (DISPLAY_SERVER (server));
+        return;
+    }
+
+    l_debug (server, "Connected to XServer %s", x_server_get_address (server));
+    DISPLAY_SERVER_CLASS (x_server_parent_class)->start (DISPLAY_SERVER (server));
+}
+
+static void
+connect_cb (GObject *object, GAsyncResult *result, gpointer data)
+{
+    g_autoptr(XServer) server = data;
+
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GSocketConnection) connection = g_socket_client_connect_finish (G_SOCKET_CLIENT (object), result, &error);
+
+    /* Stopped while connecting */
+    if (display_server_get_is_stopping (DISPLAY_SERVER (server)))
+    {
+        finish_connect (server);
+        return;
+    }
+
+    if (!connection)
+    {
+        finish_connect (server);
+        if (server->priv->connect_timed_out)
+            l_debug (server, "Timed out connecting to XServer %s", x_server_get_address (server));
+        else
+            l_debug (server, "Error connecting to XServer %s: %s", x_server_get_address (server), error->message);
+        DISPLAY_SERVER_CLASS (x_server_parent_class)->stop (DISPLAY_SERVER (server));
+        return;
+    }
+
+    SetupData *setup_data = g_malloc0 (sizeof (SetupData));
+    setup_data->fd = dup (g_socket_get_fd (g_socket_connection_get_socket (connection)));
+    if (setup_data->fd < 0)
+    {
+        l_debug (server, "Failed to duplicate socket for XServer %s: %s", x_server_get_address (server), strerror (errno));
+        g_free (setup_data);
+        finish_connect (server);
+        DISPLAY_SERVER_CLASS (x_server_parent_class)->stop (DISPLAY_SERVER (server));
+        return;
+    }
+    if (server->priv->authority)
+        setup_data->authority = g_object_ref (server->priv->authority);
+
+    /* XCB does the X setup round trip synchronously, so do it in a thread. The connect timeout
+     * still applies, if the server doesn't reply in time the socket is shut down to end it */
+    server->priv->connect_socket = g_object_ref (g_socket_connection_get_socket (connection));
+    g_autoptr(GTask) task = g_task_new (server, NULL, setup_cb, NULL);
+    g_task_set_task_data (task, setup_data, (GDestroyNotify) setup_data_free);
+    g_task_run_in_thread (task, setup_thread);
+}
+
 static gboolean
 x_server_start (DisplayServer *display_server)
 {
     XServer *server = X_SERVER (display_server);
 
-    xcb_auth_info_t *auth = NULL, a;
-    if (server->priv->authority)
+    l_debug (server, "Connecting to XServer %s", x_server_get_address (server));
+
+    /* Connect to remote servers in the background so an unreachable host doesn't block other seats */
+    if (server->priv->hostname)
     {
-        a.namelen = strlen (x_authority_get_authorization_name (server->priv->authority));
-        a.name = (char *) x_authority_get_authorization_name (server->priv->authority);
-        a.datalen = x_authority_get_authorization_data_length (server->priv->authority);
-        a.data = (char *) x_authority_get_authorization_data (server->priv->authority);
-        auth = &a;
+        g_autoptr(GSocketClient) client = g_socket_client_new ();
+        g_autoptr(GSocketConnectable) address = g_network_address_new (server->priv->hostname, X_TCP_PORT + x_server_get_display_number (server));
+
+        server->priv->connect_cancellable = g_cancellable_new ();
+        server->priv->connect_timed_out = FALSE;
+        if (server->priv->connect_timeout > 0)
+            server->priv->connect_timeout_id = g_timeout_add_seconds (server->priv->connect_timeout, connect_timeout_cb, server);
+        g_socket_client_connect_async (client, address, server->priv->connect_cancellable, connect_cb, g_object_ref (server));
+
+        return TRUE;
     }
 
-    /* Open connection */
-    l_debug (server, "Connecting to XServer %s", x_server_get_address (server));
-    server->priv->connection = xcb_connect_to_display_with_auth_info (x_server_get_address (server), auth, NULL);
+    /* Local servers have already reported they are accepting connections */
+    xcb_auth_info_t a;
+    server->priv->connection = xcb_connect_to_display_with_auth_info (x_server_get_address (server), get_auth_info (server->priv->authority, &a), NULL);
     if (xcb_connection_has_error (server->priv->connection))
     {
         l_debug (server, "Error connecting to XServer %s", x_server_get_address (server));
@@ -129,6 +309,16 @@ x_server_start (DisplayServer *display_server)
     return DISPLAY_SERVER_CLASS (x_server_parent_class)->start (display_server);
 }
 
+static void
+x_server_stop (DisplayServer *display_server)
+{
+    XServer *server = X_SERVER (display_server);
+
+    cancel_connect (server);
+
+    DISPLAY_SERVER_CLASS (x_server_parent_class)->stop (display_server);
+}
+
 static void
 x_server_connect_session (DisplayServer *display_server, Session *session)
 {
@@ -179,6 +369,7 @@ void
 x_server_init (XServer *server)
 {
     server->priv = G_TYPE_INSTANCE_GET_PRIVATE (server, X_SERVER_TYPE, XServerPrivate);
+    server->priv->connect_timeout = 10;
 }
 
 static void
@@ -189,6 +380,11 @@ x_server_finalize (GObject *object)
     g_clear_pointer (&self->priv->hostname, g_free);
     g_clear_pointer (&self->priv->address, g_free);
     g_clear_object (&self->priv->authority);
+    if (self->priv->connect_timeout_id)
+        g_source_remove (self->priv->connect_timeout_id);
+    self->priv->connect_timeout_id = 0;
+    g_clear_object (&self->priv->connect_cancellable);
+    g_clear_object (&self->priv->connect_socket);
     if (self->priv->connection)
         xcb_disconnect (self->priv->connection);
     self->priv->connection = NULL;
@@ -205,6 +401,7 @@ x_server_class_init (XServerClass *klass)
     display_server_class->get_session_type = x_server_get_session_type;
     display_server_class->get_can_share = x_server_get_can_share;
     display_server_class->start = x_server_start;
+    display_server_class->stop = x_server_stop;
     display_server_class->connect_session = x_server_connect_session;
     display_server_class->disconnect_session = x_server_disconnect_session;
     object_class->finalize = x_server_finalize;
@@ -60,6 +60,8 @@ void x_server_set_authority (XServer *server, XAuthority *authority);
 
 XAuthority *x_server_get_authority (XServer *server);
 
+void x_server_set_connect_timeout (XServer *server, guint timeout);
+
 G_END_DECLS
 
 #endif /* X_SERVER_H_ */
@@ -15,13 +15,79 @@
 #include "xdmcp-protocol.h"
 #include "x-authority.h"
 
+gpointer
+xdmcp_arena_alloc (XDMCPArena *arena, gsize size)
+{
+    /* Packet structures only contain pointers and smaller types */
+    gsize offset = (arena->used + sizeof (gpointer) - 1) & ~(sizeof (gpointer) - 1);
+    if (offset + size > XDMCP_ARENA_SIZE)
+    {
+        gpointer block = g_malloc (size);
+        arena->overflow = g_slist_prepend (arena->overflow, block);
+        return block;
+    }
+
+    arena->used = offset + size;
+    return arena->data + offset;
+}
+
+gchar *
+xdmcp_arena_strdup_printf (XDMCPArena *arena, const gchar *format, ...)
+{
+    va_list ap;
+    va_start (ap, format);
+    va_list ap2;
+    va_copy (ap2, ap);
+    gint length = g_vsnprintf (NULL, 0, format, ap);
+    va_end (ap);
+
+    gchar *string = xdmcp_arena_alloc (arena, length + 1);
+    g_vsnprintf (string, length + 1, format, ap2);
+    va_end (ap2);
+
+    return string;
+}
+
+void
+xdmcp_arena_reset (XDMCPArena *arena)
+{
+    g_slist_free_full (arena->overflow, g_free);
+    arena->overflow = NULL;
+    arena->used = 0;
+}
+
 typedef struct
 {
     const guint8 *data;
     guint16 remaining;
     gboolean overflow;
+
+    /* Where to allocate decoded fields, or NULL to use the heap */
+    XDMCPArena *arena;
 } PacketReader;
 
+static gpointer
+reader_alloc (PacketReader *reader, gsize size)
+{
+    if (reader->arena)
+        return xdmcp_arena_alloc (reader->arena, size);
+    else
+        return g_malloc (size);
+}
+
+/* Check the packet has enough data left for what a length field claims, so it doesn't cause a large allocation */
+static gboolean
+check_remaining (PacketReader *reader, gsize length)
+{
+    if (length > reader->remaining)
+    {
+        reader->overflow = TRUE;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 static guint8
 read_card8 (PacketReader *reader)
 {
@@ -50,24 +116,33 @@ read_card32 (PacketReader *reader)
     return read_card8 (reader) << 24 | read_card8 (reader) << 16 | read_card8 (reader) << 8 | read_card8 (reader);
 }
 
+static void
+read_bytes (PacketReader *reader, guint8 *data, guint16 length)
+{
+    memcpy (data, reader->data, length);
+    reader->data += length;
+    reader->remaining -= length;
+}
+
 static void
 read_data (PacketReader *reader, XDMCPData *data)
 {
     data->length = read_card16 (reader);
-    data->data = g_malloc (sizeof (guint8) * data->length);
-    for (guint16 i = 0; i < data->length; i++)
-        data->data[i] = read_card8 (reader);
+    if (!check_remaining (reader, data->length))
+        data->length = 0;
+    data->data = reader_alloc (reader, sizeof (guint8) * data->length);
+    read_bytes (reader, data->data, data->length);
 }
 
 static gchar *
 read_string (PacketReader *reader)
 {
     guint16 length = read_card16 (reader);
-    gchar *string = g_malloc (sizeof (gchar) * (length + 1));
-    guint16 i;
-    for (i = 0; i < length; i++)
-        string[i] = (gchar) read_card8 (reader);
-    string[i] = '\0';
+    if (!check_remaining (reader, length))
+        length = 0;
+    gchar *string = reader_alloc (reader, sizeof (gchar) * (length + 1));
+    read_bytes (reader, (guint8 *) string, length);
+    string[length] = '\0';
 
     return string;
 }
@@ -75,8 +150,11 @@ read_string (PacketReader *reader)
 static gchar **
 read_string_array (PacketReader *reader)
 {
+    /* Each string has at least a two octet length */
     guint8 n_strings = read_card8 (reader);
-    gchar **strings = g_malloc (sizeof (gchar *) * (n_strings + 1));
+    if (!check_remaining (reader, n_strings * 2))
+        n_strings = 0;
+    gchar **strings = reader_alloc (reader, sizeof (gchar *) * (n_strings + 1));
     guint8 i;
     for (i = 0; i < n_strings; i++)
         strings[i] = read_string (reader);
@@ -122,20 +200,33 @@ write_card32 (PacketWriter *writer, guint32 value)
     write_card8 (writer, value & 0xFF);
 }
 
+static void
+write_bytes (PacketWriter *writer, const guint8 *data, gsize length)
+{
+    if (writer->remaining < length)
+    {
+        writer->overflow = TRUE;
+        return;
+    }
+
+    memcpy (writer->data, data, length);
+    writer->data += length;
+    writer->remaining -= length;
+}
+
 static void
 write_data (PacketWriter *writer, const XDMCPData *value)
 {
     write_card16 (writer, value->length);
-    for (guint16 i = 0; i < value->length; i++)
-        write_card8 (writer, value->data[i]);
+    write_bytes (writer, value->data, value->length);
 }
 
 static void
 write_string (PacketWriter *writer, const gchar *value)
 {
-    write_card16 (writer, strlen (value));
-    for (const gchar *c = value; *c; c++)
-        write_card8 (writer, *c);
+    gsize length = strlen (value);
+    write_card16 (writer, length);
+    write_bytes (writer, (const guint8 *) value, length);
 }
 
 static void
@@ -156,12 +247,23 @@ xdmcp_packet_alloc (XDMCPOpcode opcode)
 }
 
 XDMCPPacket *
-xdmcp_packet_decode (const guint8 *data, gsize data_length)
+xdmcp_packet_alloc_in_arena (XDMCPArena *arena, XDMCPOpcode opcode)
+{
+    XDMCPPacket *packet = xdmcp_arena_alloc (arena, sizeof (XDMCPPacket));
+    memset (packet, 0, sizeof (XDMCPPacket));
+    packet->opcode = opcode;
+
+    return packet;
+}
+
+static XDMCPPacket *
+decode_packet (XDMCPArena *arena, const guint8 *data, gsize data_length)
 {
     PacketReader reader;
     reader.data = data;
     reader.remaining = data_length;
     reader.overflow = FALSE;
+    reader.arena = arena;
 
     guint16 version = read_card16 (&reader);
     guint16 opcode = read_card16 (&reader);
@@ -183,7 +285,7 @@ xdmcp_packet_decode (const guint8 *data, gsize data_length)
         return NULL;
     }
 
-    XDMCPPacket *packet = xdmcp_packet_alloc (opcode);
+    XDMCPPacket *packet = arena ? xdmcp_packet_alloc_in_arena (arena, opcode) : xdmcp_packet_alloc (opcode);
     gboolean failed = FALSE;
     switch (packet->opcode)
     {
@@ -209,7 +311,9 @@ xdmcp_packet_decode (const guint8 *data, gsize data_length)
     case XDMCP_Request:
         packet->Request.display_number = read_card16 (&reader);
         packet->Request.n_connections = read_card8 (&reader);
-        packet->Request.connections = g_malloc (sizeof (XDMCPConnection) * packet->Request.n_connections);
+        if (!check_remaining (&reader, packet->Request.n_connections * 2))
+            packet->Request.n_connections = 0;
+        packet->Request.connections = reader_alloc (&reader, sizeof (XDMCPConnection) * packet->Request.n_connections);
         for (int i = 0; i < packet->Request.n_connections; i++)
             packet->Request.connections[i].type = read_card16 (&reader);
         if (read_card8 (&reader) != packet->Request.n_connections)
@@ -277,13 +381,26 @@ xdmcp_packet_decode (const guint8 *data, gsize data_length)
     }
     if (failed)
     {
-        xdmcp_packet_free (packet);
+        if (!arena)
+            xdmcp_packet_free (packet);
         return NULL;
     }
 
     return packet;
 }
 
+XDMCPPacket *
+xdmcp_packet_decode (const guint8 *data, gsize data_length)
+{
+    return decode_packet (NULL, data, data_length);
+}
+
+XDMCPPacket *
+xdmcp_packet_decode_in_arena (XDMCPArena *arena, const guint8 *data, gsize data_length)
+{
+    return decode_packet (arena, data, data_length);
+}
+
 gssize
 xdmcp_packet_encode (XDMCPPacket *packet, guint8 *data, gsize max_length)
 {
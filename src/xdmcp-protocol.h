@@ -136,10 +136,33 @@ typedef struct
     };
 } XDMCPPacket;
 
+/* Memory for packets that are only needed while handling one datagram.
+ * Start zeroed and reset before reuse, this frees everything allocated from it */
+#define XDMCP_ARENA_SIZE 8192
+
+typedef struct
+{
+    /* Blocks allocated when the buffer is full */
+    GSList *overflow;
+
+    gsize used;
+    guint8 data[XDMCP_ARENA_SIZE];
+} XDMCPArena;
+
+gpointer xdmcp_arena_alloc (XDMCPArena *arena, gsize size);
+
+gchar *xdmcp_arena_strdup_printf (XDMCPArena *arena, const gchar *format, ...) G_GNUC_PRINTF (2, 3);
+
+void xdmcp_arena_reset (XDMCPArena *arena);
+
 XDMCPPacket *xdmcp_packet_alloc (XDMCPOpcode opcode);
 
+XDMCPPacket *xdmcp_packet_alloc_in_arena (XDMCPArena *arena, XDMCPOpcode opcode);
+
 XDMCPPacket *xdmcp_packet_decode (const guchar *data, gsize length);
 
+XDMCPPacket *xdmcp_packet_decode_in_arena (XDMCPArena *arena, const guchar *data, gsize length);
+
 gssize xdmcp_packet_encode (XDMCPPacket *packet, guchar *data, gsize length);
 
 gchar *xdmcp_packet_tostring (XDMCPPacket *packet);
@@ -21,12 +21,37 @@
 #include "xdmcp-session-private.h"
 #include "x-authority.h"
 
+/* Maximum number of packets to receive or send in one system call */
+#define XDMCP_BATCH_SIZE 32
+
+/* Largest packet that is handled */
+#define XDMCP_MAX_PACKET_SIZE 1024
+
+/* Number of session IDs, zero is not used as it means no session */
+#define N_SESSION_IDS 65535
+
+/* Number of addresses to track before forgetting the least recently used */
+#define MAX_RATE_LIMITS 1024
+
+/* Number of one second slots in the wheel that expires sessions, later expiries wrap around */
+#define WHEEL_N_SLOTS 64
+
 enum {
     NEW_SESSION,
     LAST_SIGNAL
 };
 static guint signals[LAST_SIGNAL] = { 0 };
 
+/* A response that is the same for every client */
+typedef struct
+{
+    guint8 data[XDMCP_MAX_PACKET_SIZE];
+    gssize length;
+
+    /* Description for the log */
+    gchar *text;
+} EncodedPacket;
+
 struct XDMCPServerPrivate
 {
     /* Port to listen on */
@@ -46,22 +71,145 @@ struct XDMCPServerPrivate
 
     /* XDM-AUTHENTICATION-1 key */
     gchar *key;
+    guint8 decoded_key[8];
+
+    /* Responses to Query, encoded when first needed */
+    EncodedPacket *willing_response;
+    EncodedPacket *unwilling_response;
 
     /* Active XDMCP sessions */
     GHashTable *sessions;
+
+    /* Session IDs not in use, in a random order */
+    guint16 *free_ids;
+    guint free_ids_start;
+    guint n_free_ids;
+
+    /* Number of sessions that have not been managed yet and the most allowed */
+    guint n_unmanaged_sessions;
+    guint max_unmanaged_sessions;
+
+    /* Seconds a running session can go without a KeepAlive before it is ended */
+    guint keep_alive_timeout;
+
+    /* Sessions waiting to expire, the current slot is for wheel_time */
+    GQueue wheel[WHEEL_N_SLOTS];
+    guint wheel_position;
+    gint64 wheel_time;
+    guint n_wheel_sessions;
+    guint wheel_timeout;
+
+    /* Query and Request packets allowed a minute from each address */
+    guint rate_limit;
+    GHashTable *rate_limits;
+
+    /* Rate limit state, least recently used first */
+    GQueue rate_limit_order;
+
+    /* Buffers to receive a batch of packets into */
+    guint8 *receive_data;
+
+    /* Replies waiting to be sent together */
+    GSocket *send_socket;
+    guint8 *send_data;
+    GOutputVector send_vectors[XDMCP_BATCH_SIZE];
+    GOutputMessage send_messages[XDMCP_BATCH_SIZE];
+    guint n_send_messages;
+
+    /* Memory for the packet being handled and its responses */
+    XDMCPArena arena;
+
+    /* Packet statistics */
+    guint64 n_packets_received;
+    guint64 n_batches;
+    guint max_batch_size;
+    guint64 n_packets_dropped;
+    guint64 n_packets_throttled;
+    guint64 n_requests_rejected;
+    guint64 n_sessions_expired;
 };
 
 G_DEFINE_TYPE (XDMCPServer, xdmcp_server, G_TYPE_OBJECT)
 
-/* Maximum number of milliseconds client will resend manage requests before giving up */
-#define MANAGE_TIMEOUT 126000
+/* Maximum number of seconds client will resend manage requests before giving up */
+#define MANAGE_TIMEOUT 126
 
-/* Address sort support structure */
+/* Source of packets being rate limited */
 typedef struct
 {
-    gsize index;
-    GInetAddress *address;
-} AddrSortItem;
+    GSocketFamily family;
+    guint8 address[16];
+} SourceAddress;
+
+typedef struct
+{
+    SourceAddress source;
+    gdouble tokens;
+    gint64 last_time;
+
+    /* TRUE if the last packet from this address was ignored */
+    gboolean throttled;
+
+    /* Link in rate_limit_order */
+    GList link;
+} RateLimit;
+
+/* Properties of an offered connection used to choose the best one */
+typedef struct
+{
+    GSocketFamily family;
+    gboolean is_link_local;
+    gboolean is_source;
+} ConnectionRank;
+
+static guint8
+atox (char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return 0;
+}
+
+static void
+decode_key (const gchar *key, guint8 *data)
+{
+    memset (data, 0, 8);
+    if (strncmp (key, "0x", 2) == 0 || strncmp (key, "0X", 2) == 0)
+    {
+        for (gint i = 0; i < 8; i++)
+        {
+            if (key[i*2] == '\0')
+                break;
+            data[i] |= atox (key[i*2]) << 8;
+            if (key[i*2+1] == '\0')
+                break;
+            data[i] |= atox (key[i*2+1]);
+        }
+    }
+    else
+    {
+        for (gint i = 1; i < 8 && key[i-1]; i++)
+           data[i] = key[i-1];
+    }
+}
+
+static void
+encoded_packet_free (EncodedPacket *packet)
+{
+    g_free (packet->text);
+    g_free (packet);
+}
+
+static void
+clear_query_responses (XDMCPServer *server)
+{
+    g_clear_pointer (&server->priv->willing_response, encoded_packet_free);
+    g_clear_pointer (&server->priv->unwilling_response, encoded_packet_free);
+}
 
 XDMCPServer *
 xdmcp_server_new (void)
@@ -106,6 +254,7 @@ xdmcp_server_set_hostname (XDMCPServer *server, const gchar *hostname)
 
     g_free (server->priv->hostname);
     server->priv->hostname = g_strdup (hostname);
+    clear_query_responses (server);
 }
 
 const gchar *
@@ -122,6 +271,7 @@ xdmcp_server_set_status (XDMCPServer *server, const gchar *status)
 
     g_free (server->priv->status);
     server->priv->status = g_strdup (status);
+    clear_query_responses (server);
 }
 
 const gchar *
@@ -131,37 +281,199 @@ xdmcp_server_get_status (XDMCPServer *server)
     return server->priv->status;
 }
 
+void
+xdmcp_server_set_max_unmanaged_sessions (XDMCPServer *server, guint max_unmanaged_sessions)
+{
+    g_return_if_fail (server != NULL);
+    server->priv->max_unmanaged_sessions = max_unmanaged_sessions;
+}
+
+void
+xdmcp_server_set_rate_limit (XDMCPServer *server, guint rate_limit)
+{
+    g_return_if_fail (server != NULL);
+    server->priv->rate_limit = rate_limit;
+}
+
+void
+xdmcp_server_set_keep_alive_timeout (XDMCPServer *server, guint keep_alive_timeout)
+{
+    g_return_if_fail (server != NULL);
+    server->priv->keep_alive_timeout = keep_alive_timeout;
+}
+
 void
 xdmcp_server_set_key (XDMCPServer *server, const gchar *key)
 {
     g_return_if_fail (server != NULL);
     g_free (server->priv->key);
     server->priv->key = g_strdup (key);
+    if (key)
+        decode_key (key, server->priv->decoded_key);
+    clear_query_responses (server);
+}
+
+static void
+release_session_id (XDMCPServer *server, guint16 id)
+{
+    server->priv->free_ids[(server->priv->free_ids_start + server->priv->n_free_ids) % N_SESSION_IDS] = id;
+    server->priv->n_free_ids++;
+}
+
+static void
+unschedule_session (XDMCPServer *server, XDMCPSession *session)
+{
+    if (!session->priv->wheel_link.data)
+        return;
+
+    g_queue_unlink (&server->priv->wheel[session->priv->wheel_slot], &session->priv->wheel_link);
+    session->priv->wheel_link.data = NULL;
+    server->priv->n_wheel_sessions--;
+
+    /* Don't wake up when there is nothing to expire */
+    if (server->priv->n_wheel_sessions == 0 && server->priv->wheel_timeout)
+    {
+        g_source_remove (server->priv->wheel_timeout);
+        server->priv->wheel_timeout = 0;
+    }
+}
+
+static void session_connect_failed_cb (XDMCPSession *session, XDMCPServer *server);
+
+static void
+remove_session (XDMCPServer *server, XDMCPSession *session)
+{
+    guint16 id = session->priv->id;
+
+    g_signal_handlers_disconnect_by_func (session, session_connect_failed_cb, server);
+    unschedule_session (server, session);
+    if (!session->priv->started)
+        server->priv->n_unmanaged_sessions--;
+    g_hash_table_remove (server->priv->sessions, GINT_TO_POINTER ((gint) id));
+    release_session_id (server, id);
+}
+
+static void
+expire_session (XDMCPServer *server, XDMCPSession *session)
+{
+    /* Keep the session alive while the seat handles it expiring */
+    g_object_ref (session);
+
+    if (!session->priv->started)
+        g_debug ("Timing out unmanaged session %d", session->priv->id);
+    else if (session->priv->running)
+    {
+        g_debug ("Ending session %d, terminal has not sent KeepAlive for %d seconds", session->priv->id, server->priv->keep_alive_timeout);
+        server->priv->n_sessions_expired++;
+        session->priv->running = FALSE;
+        g_signal_emit_by_name (session, XDMCP_SESSION_SIGNAL_EXPIRED);
+    }
+    else
+        g_debug ("Removing stopped session %d", session->priv->id);
+
+    remove_session (server, session);
+    g_object_unref (session);
 }
 
+static void schedule_session (XDMCPServer *server, XDMCPSession *session);
+
 static gboolean
-session_timeout_cb (XDMCPSession *session)
+wheel_tick_cb (XDMCPServer *server)
 {
-    session->priv->inactive_timeout = 0;
+    gint64 now = g_get_monotonic_time () / G_USEC_PER_SEC;
+    gint64 n_ticks = now - server->priv->wheel_time;
 
-    g_debug ("Timing out unmanaged session %d", session->priv->id);
-    g_hash_table_remove (session->priv->server->priv->sessions, GINT_TO_POINTER ((gint) session->priv->id));
-    return FALSE;
+    /* Check each slot that has come due since the last tick, once is enough if we've been asleep for longer than the wheel */
+    GList *expired = NULL, *recheck = NULL;
+    for (gint64 i = 1; i <= MIN (n_ticks, WHEEL_N_SLOTS); i++)
+    {
+        GQueue *slot = &server->priv->wheel[(server->priv->wheel_position + i) % WHEEL_N_SLOTS];
+        for (GList *link = slot->head; link; link = link->next)
+        {
+            XDMCPSession *session = link->data;
+            if (session->priv->expire_time > now)
+                continue;
+
+            /* Sessions still running without KeepAlive checking are looked at again later */
+            if (session->priv->started && session->priv->running && server->priv->keep_alive_timeout == 0)
+                recheck = g_list_prepend (recheck, session);
+            else
+                expired = g_list_prepend (expired, g_object_ref (session));
+        }
+    }
+    server->priv->wheel_position = (server->priv->wheel_position + MAX (n_ticks, 0)) % WHEEL_N_SLOTS;
+    server->priv->wheel_time = now;
+
+    for (GList *link = recheck; link; link = link->next)
+        schedule_session (server, link->data);
+    g_list_free (recheck);
+
+    /* Expire outside the loop as the seat may stop other sessions when it is told */
+    for (GList *link = expired; link; link = link->next)
+    {
+        XDMCPSession *session = link->data;
+        if (session->priv->wheel_link.data)
+            expire_session (server, session);
+    }
+    g_list_free_full (expired, g_object_unref);
+
+    if (server->priv->n_wheel_sessions == 0)
+    {
+        server->priv->wheel_timeout = 0;
+        return G_SOURCE_REMOVE;
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+schedule_session (XDMCPServer *server, XDMCPSession *session)
+{
+    unschedule_session (server, session);
+
+    /* Unmanaged sessions wait for the client to give up on Manage. Running sessions wait for the next
+     * KeepAlive, or are checked occasionally to see if the seat has stopped if those aren't tracked */
+    guint timeout = MANAGE_TIMEOUT;
+    if (session->priv->started && session->priv->running && server->priv->keep_alive_timeout > 0)
+        timeout = server->priv->keep_alive_timeout;
+
+    gint64 now = g_get_monotonic_time () / G_USEC_PER_SEC;
+    if (server->priv->n_wheel_sessions == 0)
+    {
+        server->priv->wheel_time = now;
+        server->priv->wheel_timeout = g_timeout_add_seconds (1, (GSourceFunc) wheel_tick_cb, server);
+    }
+
+    session->priv->expire_time = now + timeout;
+    session->priv->wheel_slot = (server->priv->wheel_position + MAX (session->priv->expire_time - server->priv->wheel_time, 1)) % WHEEL_N_SLOTS;
+    session->priv->wheel_link.data = session;
+    g_queue_push_tail_link (&server->priv->wheel[session->priv->wheel_slot], &session->priv->wheel_link);
+    server->priv->n_wheel_sessions++;
+}
+
+static gboolean
+can_add_session (XDMCPServer *server)
+{
+    if (server->priv->n_free_ids == 0)
+        return FALSE;
+
+    return server->priv->max_unmanaged_sessions == 0 || server->priv->n_unmanaged_sessions < server->priv->max_unmanaged_sessions;
 }
 
 static XDMCPSession *
 add_session (XDMCPServer *server)
 {
-    guint16 id;
-    do
-    {
-        id = g_random_int () & 0xFFFFFFFF;
-    } while (g_hash_table_lookup (server->priv->sessions, GINT_TO_POINTER ((gint) id)));
+    /* IDs are handed out in a random order so they can't be guessed */
+    guint16 id = server->priv->free_ids[server->priv->free_ids_start];
+    server->priv->free_ids_start = (server->priv->free_ids_start + 1) % N_SESSION_IDS;
+    server->priv->n_free_ids--;
+    server->priv->n_unmanaged_sessions++;
 
     XDMCPSession *session = xdmcp_session_new (id);
     session->priv->server = server;
+    g_signal_connect (session, XDMCP_SESSION_SIGNAL_CONNECT_FAILED, G_CALLBACK (session_connect_failed_cb), server);
     g_hash_table_insert (server->priv->sessions, GINT_TO_POINTER ((gint) id), g_object_ref (session));
-    session->priv->inactive_timeout = g_timeout_add (MANAGE_TIMEOUT, (GSourceFunc) session_timeout_cb, session);
+    schedule_session (server, session);
 
     return session;
 }
@@ -180,22 +492,113 @@ socket_address_to_string (GSocketAddress *address)
 }
 
 static void
-send_packet (GSocket *socket, GSocketAddress *address, XDMCPPacket *packet)
+flush_packets (XDMCPServer *server)
+{
+    GOutputMessage *messages = server->priv->send_messages;
+    guint n_messages = server->priv->n_send_messages;
+    server->priv->n_send_messages = 0;
+
+    for (guint offset = 0; offset < n_messages; )
+    {
+        g_autoptr(GError) error = NULL;
+        gint n_sent = g_socket_send_messages (server->priv->send_socket, messages + offset, n_messages - offset, 0, NULL, &error);
+        if (n_sent < 0)
+        {
+            /* Skip the packet that failed and carry on with the rest */
+            g_warning ("Error sending packet: %s", error->message);
+            server->priv->n_packets_dropped++;
+            offset++;
+        }
+        else
+            offset += n_sent;
+    }
+
+    for (guint i = 0; i < n_messages; i++)
+        g_clear_object (&messages[i].address);
+}
+
+/* Get the buffer for the next reply, sending the queued replies first if it can't go with them */
+static guint8 *
+get_send_buffer (XDMCPServer *server, GSocket *socket)
+{
+    if (server->priv->n_send_messages > 0 &&
+        (server->priv->send_socket != socket || server->priv->n_send_messages == XDMCP_BATCH_SIZE))
+        flush_packets (server);
+
+    return server->priv->send_data + server->priv->n_send_messages * XDMCP_MAX_PACKET_SIZE;
+}
+
+/* Replies are sent together once all the packets from a read have been handled */
+static void
+queue_packet (XDMCPServer *server, GSocket *socket, GSocketAddress *address, gsize length, const gchar *packet_text)
 {
     g_autofree gchar *address_string = socket_address_to_string (address);
-    g_debug ("Send %s to %s", xdmcp_packet_tostring (packet), address_string);
+    g_debug ("Send %s to %s", packet_text, address_string);
+
+    guint i = server->priv->n_send_messages;
+    server->priv->send_socket = socket;
+    server->priv->send_vectors[i].buffer = server->priv->send_data + i * XDMCP_MAX_PACKET_SIZE;
+    server->priv->send_vectors[i].size = length;
+    GOutputMessage *message = &server->priv->send_messages[i];
+    message->address = g_object_ref (address);
+    message->vectors = &server->priv->send_vectors[i];
+    message->num_vectors = 1;
+    message->bytes_sent = 0;
+    message->control_messages = NULL;
+    message->num_control_messages = 0;
+    server->priv->n_send_messages++;
+}
 
-    guint8 data[1024];
-    gssize n_written = xdmcp_packet_encode (packet, data, 1024);
+static void
+send_packet (XDMCPServer *server, GSocket *socket, GSocketAddress *address, XDMCPPacket *packet)
+{
+    guint8 *data = get_send_buffer (server, socket);
+    gssize n_written = xdmcp_packet_encode (packet, data, XDMCP_MAX_PACKET_SIZE);
     if (n_written < 0)
+    {
         g_critical ("Failed to encode XDMCP packet");
-    else
+        return;
+    }
+
+    g_autofree gchar *packet_string = xdmcp_packet_tostring (packet);
+    queue_packet (server, socket, address, n_written, packet_string);
+}
+
+static void
+send_failed (XDMCPServer *server, GSocket *socket, GSocketAddress *address, guint16 session_id, guint16 display_number)
+{
+    XDMCPPacket *response = xdmcp_packet_alloc_in_arena (&server->priv->arena, XDMCP_Failed);
+    response->Failed.session_id = session_id;
+    response->Failed.status = xdmcp_arena_strdup_printf (&server->priv->arena, "Failed to connect to display :%d", display_number);
+    send_packet (server, socket, address, response);
+}
+
+static void
+session_connect_failed_cb (XDMCPSession *session, XDMCPServer *server)
+{
+    /* Failures while the Manage is being handled are replied to there */
+    if (!session->priv->started || session->priv->failed)
+        return;
+
+    g_debug ("Failed to connect to display :%d for session %d", session->priv->display_number, session->priv->id);
+    session->priv->failed = TRUE;
+    session->priv->running = FALSE;
+    send_failed (server, session->priv->manage_socket, session->priv->manage_address, session->priv->id, session->priv->display_number);
+    flush_packets (server);
+}
+
+static void
+send_encoded_packet (XDMCPServer *server, GSocket *socket, GSocketAddress *address, EncodedPacket *packet)
+{
+    if (packet->length < 0)
     {
-        g_autoptr(GError) error = NULL;
-        g_socket_send_to (socket, address, (gchar *) data, n_written, NULL, &error);
-        if (error)
-            g_warning ("Error sending packet: %s", error->message);
+        g_critical ("Failed to encode XDMCP packet");
+        return;
     }
+
+    guint8 *data = get_send_buffer (server, socket);
+    memcpy (data, packet->data, packet->length);
+    queue_packet (server, socket, address, packet->length, packet->text);
 }
 
 static const gchar *
@@ -207,44 +610,61 @@ get_authentication_name (XDMCPServer *server)
         return "";
 }
 
-static void
-handle_query (XDMCPServer *server, GSocket *socket, GSocketAddress *address, gchar **authentication_names)
+static EncodedPacket *
+get_query_response (XDMCPServer *server, gboolean willing)
 {
-    /* If no authentication requested and we are configured for none then allow */
-    const gchar *authentication_name = NULL;
-    if (authentication_names[0] == NULL && server->priv->key == NULL)
-        authentication_name = "";
-
-    for (gchar **i = authentication_names; *i; i++)
+    EncodedPacket **response = willing ? &server->priv->willing_response : &server->priv->unwilling_response;
+    if (*response)
+        return *response;
+
+    XDMCPPacket packet;
+    memset (&packet, 0, sizeof (packet));
+    g_autofree gchar *status = NULL;
+    if (willing)
     {
-        if (strcmp (*i, get_authentication_name (server)) == 0 && server->priv->key != NULL)
-        {
-            authentication_name = *i;
-            break;
-        }
-    }
-
-    XDMCPPacket *response;
-    if (authentication_name)
-    {
-        response = xdmcp_packet_alloc (XDMCP_Willing);
-        response->Willing.authentication_name = g_strdup (authentication_name);
-        response->Willing.hostname = g_strdup (server->priv->hostname);
-        response->Willing.status = g_strdup (server->priv->status);
+        packet.opcode = XDMCP_Willing;
+        packet.Willing.authentication_name = (gchar *) get_authentication_name (server);
+        packet.Willing.hostname = server->priv->hostname;
+        packet.Willing.status = server->priv->status;
     }
     else
     {
-        response = xdmcp_packet_alloc (XDMCP_Unwilling);
-        response->Unwilling.hostname = g_strdup (server->priv->hostname);
+        packet.opcode = XDMCP_Unwilling;
+        packet.Unwilling.hostname = server->priv->hostname;
         if (server->priv->key)
-            response->Unwilling.status = g_strdup_printf ("No matching authentication, server requires %s", get_authentication_name (server));
+            status = g_strdup_printf ("No matching authentication, server requires %s", get_authentication_name (server));
         else
-            response->Unwilling.status = g_strdup ("No matching authentication");
+            status = g_strdup ("No matching authentication");
+        packet.Unwilling.status = status;
     }
 
-    send_packet (socket, address, response);
+    *response = g_malloc0 (sizeof (EncodedPacket));
+    (*response)->length = xdmcp_packet_encode (&packet, (*response)->data, XDMCP_MAX_PACKET_SIZE);
+    (*response)->text = xdmcp_packet_tostring (&packet);
 
-    xdmcp_packet_free (response);
+    return *response;
+}
+
+static void
+handle_query (XDMCPServer *server, GSocket *socket, GSocketAddress *address, gchar **authentication_names)
+{
+    /* If no authentication requested and we are configured for none then allow */
+    gboolean willing = authentication_names[0] == NULL && server->priv->key == NULL;
+
+    if (server->priv->key)
+    {
+        for (gchar **i = authentication_names; *i; i++)
+        {
+            if (strcmp (*i, get_authentication_name (server)) == 0)
+            {
+                willing = TRUE;
+                break;
+            }
+        }
+    }
+
+    /* The response only depends on the server configuration, so it is encoded once */
+    send_encoded_packet (server, socket, address, get_query_response (server, willing));
 }
 
 static void
@@ -282,41 +702,6 @@ handle_forward_query (XDMCPServer *server, GSocket *socket, GSocketAddress *addr
     handle_query (server, socket, client_address, packet->ForwardQuery.authentication_names);
 }
 
-static guint8
-atox (char c)
-{
-    if (c >= '0' && c <= '9')
-        return c - '0';
-    if (c >= 'a' && c <= 'f')
-        return c - 'a' + 10;
-    if (c >= 'A' && c <= 'F')
-        return c - 'A' + 10;
-    return 0;
-}
-
-static void
-decode_key (const gchar *key, guint8 *data)
-{
-    memset (data, 0, 8);
-    if (strncmp (key, "0x", 2) == 0 || strncmp (key, "0X", 2) == 0)
-    {
-        for (gint i = 0; i < 8; i++)
-        {
-            if (key[i*2] == '\0')
-                break;
-            data[i] |= atox (key[i*2]) << 8;
-            if (key[i*2+1] == '\0')
-                break;
-            data[i] |= atox (key[i*2+1]);
-        }
-    }
-    else
-    {
-        for (gint i = 1; i < 8 && key[i-1]; i++)
-           data[i] = key[i-1];
-    }
-}
-
 static GInetAddress *
 connection_to_address (XDMCPConnection *connection)
 {
@@ -337,82 +722,86 @@ connection_to_address (XDMCPConnection *connection)
     }
 }
 
-/* Sort function to order XDMCP addresses by which is best to connect to */
-static gint
-compare_addresses (gconstpointer a, gconstpointer b, gpointer user_data)
+static gboolean
+get_connection_rank (XDMCPConnection *connection, GSocketFamily source_family, const guint8 *source_bytes, ConnectionRank *rank)
 {
-    const AddrSortItem *item_a = a;
-    const AddrSortItem *item_b = b;
-    GInetAddress *source_address = user_data;
+    const guint8 *data = connection->address.data;
+    switch (connection->type)
+    {
+    case XAUTH_FAMILY_INTERNET:
+        if (connection->address.length != 4)
+            return FALSE;
+        rank->family = G_SOCKET_FAMILY_IPV4;
+        /* 169.254.0.0/16 */
+        rank->is_link_local = data[0] == 169 && data[1] == 254;
+        break;
+    case XAUTH_FAMILY_INTERNET6:
+        if (connection->address.length != 16)
+            return FALSE;
+        rank->family = G_SOCKET_FAMILY_IPV6;
+        /* fe80::/10 */
+        rank->is_link_local = data[0] == 0xFE && (data[1] & 0xC0) == 0x80;
+        break;
+    default:
+        return FALSE;
+    }
+
+    rank->is_source = rank->family == source_family && memcmp (data, source_bytes, connection->address.length) == 0;
+
+    return TRUE;
+}
 
+/* Order XDMCP connections by which is best to connect to */
+static gint
+compare_connections (const ConnectionRank *a, const ConnectionRank *b, GSocketFamily source_family)
+{
     /* Prefer non link-local addresses */
-    gboolean is_link_local = g_inet_address_get_is_link_local (item_a->address);
-    if (is_link_local != g_inet_address_get_is_link_local (item_b->address))
-        return is_link_local ? 1 : -1;
+    if (a->is_link_local != b->is_link_local)
+        return a->is_link_local ? 1 : -1;
 
     /* Prefer the source address family */
-    GSocketFamily family_a = g_inet_address_get_family (item_a->address);
-    GSocketFamily family_b = g_inet_address_get_family (item_b->address);
-    if (family_a != family_b)
+    if (a->family != b->family)
     {
-        GSocketFamily family = g_inet_address_get_family (source_address);
-        if (family_a == family)
+        if (a->family == source_family)
             return -1;
-        if (family_b == family)
+        if (b->family == source_family)
             return 1;
-        return family_a < family_b ? -1 : 1;
+        return a->family < b->family ? -1 : 1;
     }
 
-    /* Check equality */
-    if (g_inet_address_equal (item_a->address, item_b->address))
-        return 0;
-
     /* Prefer the source address */
-    if (g_inet_address_equal (source_address, item_a->address))
-        return -1;
-    if (g_inet_address_equal (source_address, item_b->address))
-        return 1;
+    if (a->is_source != b->is_source)
+        return a->is_source ? -1 : 1;
 
-    /* Addresses are not equal, but preferences are: order is undefined */
+    /* Otherwise the order is undefined */
     return 0;
 }
 
 static XDMCPConnection *
 choose_connection (XDMCPPacket *packet, GInetAddress *source_address)
 {
-    gsize addresses_length = packet->Request.n_connections;
-    if (addresses_length == 0)
-        return NULL;
+    GSocketFamily source_family = g_inet_address_get_family (source_address);
+    const guint8 *source_bytes = g_inet_address_to_bytes (source_address);
 
-    AddrSortItem addr;
-    GArray *addresses = g_array_sized_new (FALSE, FALSE, sizeof addr, addresses_length);
-    if (!addresses)
-        return NULL;
-
-    for (gsize i = 0; i < addresses_length; i++)
+    /* Use the best address, the first offered if several are as good */
+    XDMCPConnection *best_connection = NULL;
+    ConnectionRank best_rank;
+    for (guint8 i = 0; i < packet->Request.n_connections; i++)
     {
-        addr.address = connection_to_address (&packet->Request.connections[i]);
-        if (addr.address)
+        XDMCPConnection *connection = &packet->Request.connections[i];
+
+        ConnectionRank rank;
+        if (!get_connection_rank (connection, source_family, source_bytes, &rank))
+            continue;
+
+        if (!best_connection || compare_connections (&rank, &best_rank, source_family) < 0)
         {
-            addr.index = i;
-            g_array_append_val (addresses, addr);
+            best_connection = connection;
+            best_rank = rank;
         }
     }
 
-    /* Sort the addresses according to our preferences */
-    g_array_sort_with_data (addresses, compare_addresses, source_address);
-
-    /* Use the best address */
-    gssize index = -1;
-    if (addresses->len)
-        index = g_array_index (addresses, AddrSortItem, 0).index;
-
-    /* Free the local sort array and items */
-    for (gsize i = 0; i < addresses->len; i++)
-        g_object_unref (g_array_index (addresses, AddrSortItem, i).address);
-    g_array_unref (addresses);
-
-    return index >= 0 ? &packet->Request.connections[index] : NULL;
+    return best_connection;
 }
 
 static gboolean
@@ -448,21 +837,18 @@ handle_request (XDMCPServer *server, GSocket *socket, GSocketAddress *address, X
     {
         if (packet->Request.authentication_data.length == 8)
         {
-            guint8 input[8], key[8];
+            guint8 input[8];
 
             memcpy (input, packet->Request.authentication_data.data, packet->Request.authentication_data.length);
 
-            /* Setup key */
-            decode_key (server->priv->key, key);
-
             /* Decode message from server */
             authentication_name = g_strdup ("XDM-AUTHENTICATION-1");
             authentication_data = g_malloc (sizeof (guint8) * 8);
             authentication_data_length = 8;
 
-            XdmcpUnwrap (input, key, rho.data, authentication_data_length);
+            XdmcpUnwrap (input, server->priv->decoded_key, rho.data, authentication_data_length);
             XdmcpIncrementKey (&rho);
-            XdmcpWrap (rho.data, key, authentication_data, authentication_data_length);
+            XdmcpWrap (rho.data, server->priv->decoded_key, authentication_data, authentication_data_length);
 
             if (!has_string (packet->Request.authorization_names, "XDM-AUTHORIZATION-1"))
                 decline_status = g_strdup ("No matching authorization, server requires XDM-AUTHORIZATION-1");
@@ -488,6 +874,14 @@ handle_request (XDMCPServer *server, GSocket *socket, GSocketAddress *address, X
     if (!authentication_name)
         authentication_name = g_strdup ("");
 
+    /* Limit the number of sessions waiting to be managed */
+    if (!decline_status && !can_add_session (server))
+    {
+        server->priv->n_requests_rejected++;
+        g_debug ("Declining request, too many unmanaged sessions (%" G_GUINT64_FORMAT " declined)", server->priv->n_requests_rejected);
+        decline_status = g_strdup ("Too many sessions waiting to be managed");
+    }
+
     /* Decline if request was not valid */
     if (decline_status)
     {
@@ -496,7 +890,7 @@ handle_request (XDMCPServer *server, GSocket *socket, GSocketAddress *address, X
         response->Decline.authentication_name = g_steal_pointer (&authentication_name);
         response->Decline.authentication_data.data = g_steal_pointer (&authentication_data);
         response->Decline.authentication_data.length = authentication_data_length;
-        send_packet (socket, address, response);
+        send_packet (server, socket, address, response);
         xdmcp_packet_free (response);
         return;
     }
@@ -509,10 +903,6 @@ handle_request (XDMCPServer *server, GSocket *socket, GSocketAddress *address, X
     gsize session_authorization_data_length = 0;
     if (server->priv->key)
     {
-        /* Setup key */
-        guint8 key[8];
-        decode_key (server->priv->key, key);
-
         /* Generate a private session key */
         // FIXME: Pick a good DES key?
         guint8 session_key[8];
@@ -523,7 +913,7 @@ handle_request (XDMCPServer *server, GSocket *socket, GSocketAddress *address, X
         /* Encrypt the session key and send it to the server */
         authorization_data = g_malloc (8);
         authorization_data_length = 8;
-        XdmcpWrap (session_key, key, authorization_data, authorization_data_length);
+        XdmcpWrap (session_key, server->priv->decoded_key, authorization_data, authorization_data_length);
 
         /* Authorization data is the number received from the client followed by the private session key */
         authorization_name = g_strdup ("XDM-AUTHORIZATION-1");
@@ -582,7 +972,7 @@ handle_request (XDMCPServer *server, GSocket *socket, GSocketAddress *address, X
     response->Accept.authorization_name = g_steal_pointer (&authorization_name);
     response->Accept.authorization_data.data = g_steal_pointer (&authorization_data);
     response->Accept.authorization_data.length = authorization_data_length;
-    send_packet (socket, address, response);
+    send_packet (server, socket, address, response);
     xdmcp_packet_free (response);
 }
 
@@ -592,16 +982,21 @@ handle_manage (XDMCPServer *server, GSocket *socket, GSocketAddress *address, XD
     XDMCPSession *session = get_session (server, packet->Manage.session_id);
     if (!session)
     {
-        XDMCPPacket *response = xdmcp_packet_alloc (XDMCP_Refuse);
+        XDMCPPacket *response = xdmcp_packet_alloc_in_arena (&server->priv->arena, XDMCP_Refuse);
         response->Refuse.session_id = packet->Manage.session_id;
-        send_packet (socket, address, response);
-        xdmcp_packet_free (response);
+        send_packet (server, socket, address, response);
         return;
     }
 
-    /* Ignore duplicate requests */
+    /* Ignore duplicate requests, unless connecting to the display has since failed */
     if (session->priv->started)
     {
+        if (session->priv->failed)
+        {
+            send_failed (server, socket, address, session->priv->id, session->priv->display_number);
+            return;
+        }
+
         if (session->priv->display_number != packet->Manage.display_number ||
             strcmp (session->priv->display_class, packet->Manage.display_class) != 0)
             g_debug ("Ignoring duplicate Manage with different data");
@@ -614,108 +1009,234 @@ handle_manage (XDMCPServer *server, GSocket *socket, GSocketAddress *address, XD
         XDMCPPacket *response;
 
         g_debug ("Received Manage for display number %d, but Request was %d", packet->Manage.display_number, session->priv->display_number);
-        response = xdmcp_packet_alloc (XDMCP_Refuse);
+        response = xdmcp_packet_alloc_in_arena (&server->priv->arena, XDMCP_Refuse);
         response->Refuse.session_id = packet->Manage.session_id;
-        send_packet (socket, address, response);
-        xdmcp_packet_free (response);
+        send_packet (server, socket, address, response);
     }
 
     session->priv->display_class = g_strdup (packet->Manage.display_class);
 
+    /* Connecting to the display happens in the background, remember where to send Failed if it doesn't work */
+    g_clear_object (&session->priv->manage_socket);
+    session->priv->manage_socket = g_object_ref (socket);
+    g_clear_object (&session->priv->manage_address);
+    session->priv->manage_address = g_object_ref (address);
+
     gboolean result = FALSE;
     g_signal_emit (server, signals[NEW_SESSION], 0, session, &result);
     if (result)
     {
-        /* Cancel the inactive timer */
-        if (session->priv->inactive_timeout)
-            g_source_remove (session->priv->inactive_timeout);
-
         session->priv->started = TRUE;
-    }
-    else
-    {
-        XDMCPPacket *response;
+        session->priv->running = TRUE;
+        server->priv->n_unmanaged_sessions--;
 
-        response = xdmcp_packet_alloc (XDMCP_Failed);
-        response->Failed.session_id = packet->Manage.session_id;
-        response->Failed.status = g_strdup_printf ("Failed to connect to display :%d", packet->Manage.display_number);
-        send_packet (socket, address, response);
-        xdmcp_packet_free (response);
+        /* Start waiting for KeepAlive instead of Manage */
+        schedule_session (server, session);
     }
+    else
+        send_failed (server, socket, address, packet->Manage.session_id, packet->Manage.display_number);
 }
 
 static void
 handle_keep_alive (XDMCPServer *server, GSocket *socket, GSocketAddress *address, XDMCPPacket *packet)
 {
-    XDMCPPacket *response;
-    XDMCPSession *session;
-    gboolean alive = FALSE;
-
-    session = get_session (server, packet->KeepAlive.session_id);
-    if (session)
-        alive = TRUE; // FIXME: xdmcp_session_get_alive (session);
-
-    response = xdmcp_packet_alloc (XDMCP_Alive);
+    XDMCPSession *session = get_session (server, packet->KeepAlive.session_id);
+    gboolean alive = session && session->priv->started && session->priv->running &&
+                     session->priv->display_number == packet->KeepAlive.display_number;
+
+    if (alive)
+        schedule_session (server, session);
+    /* The terminal will start again when told its session has stopped, so the old one can go.
+     * A running session is left alone, a stray keep alive with the wrong display number must not end it */
+    else if (session && session->priv->started && !session->priv->running)
+        remove_session (server, session);
+
+    XDMCPPacket *response = xdmcp_packet_alloc_in_arena (&server->priv->arena, XDMCP_Alive);
     response->Alive.session_running = alive;
     response->Alive.session_id = alive ? packet->KeepAlive.session_id : 0;
-    send_packet (socket, address, response);
-    xdmcp_packet_free (response);
+    send_packet (server, socket, address, response);
 }
 
-static gboolean
-read_cb (GSocket *socket, GIOCondition condition, XDMCPServer *server)
+static guint
+source_address_hash (gconstpointer key)
 {
-    GSocketAddress *address;
-    gchar data[1024];
-    g_autoptr(GError) error = NULL;
-    gssize n_read;
+    const SourceAddress *source = key;
+    guint hash = source->family;
+    for (gsize i = 0; i < sizeof (source->address); i++)
+        hash = hash * 31 + source->address[i];
+
+    return hash;
+}
 
-    n_read = g_socket_receive_from (socket, &address, data, 1024, NULL, &error);
-    if (error)
-        g_warning ("Failed to read from XDMCP socket: %s", error->message);
+static gboolean
+source_address_equal (gconstpointer a, gconstpointer b)
+{
+    return memcmp (a, b, sizeof (SourceAddress)) == 0;
+}
 
-    if (n_read > 0)
+/* Token bucket allowing rate_limit Query and Request packets a minute from each address */
+static gboolean
+check_rate_limit (XDMCPServer *server, GSocketAddress *address)
+{
+    if (server->priv->rate_limit == 0)
+        return TRUE;
+
+    GInetAddress *inet_address = g_inet_socket_address_get_address (G_INET_SOCKET_ADDRESS (address));
+    SourceAddress source;
+    memset (&source, 0, sizeof (source));
+    source.family = g_inet_address_get_family (inet_address);
+    memcpy (source.address, g_inet_address_to_bytes (inet_address), MIN (g_inet_address_get_native_size (inet_address), sizeof (source.address)));
+
+    gint64 now = g_get_monotonic_time ();
+    RateLimit *limit = g_hash_table_lookup (server->priv->rate_limits, &source);
+    if (limit)
     {
-        XDMCPPacket *packet;
+        limit->tokens = MIN (limit->tokens + (now - limit->last_time) * server->priv->rate_limit / (60.0 * G_USEC_PER_SEC), server->priv->rate_limit);
+        limit->last_time = now;
+        g_queue_unlink (&server->priv->rate_limit_order, &limit->link);
+    }
+    else
+    {
+        /* Forget the address seen longest ago so the table can't grow without bound */
+        if (g_hash_table_size (server->priv->rate_limits) >= MAX_RATE_LIMITS)
+        {
+            RateLimit *oldest = server->priv->rate_limit_order.head->data;
+            g_queue_unlink (&server->priv->rate_limit_order, &oldest->link);
+            g_hash_table_remove (server->priv->rate_limits, &oldest->source);
+        }
+
+        limit = g_malloc0 (sizeof (RateLimit));
+        limit->source = source;
+        limit->tokens = server->priv->rate_limit;
+        limit->last_time = now;
+        limit->link.data = limit;
+        g_hash_table_insert (server->priv->rate_limits, &limit->source, limit);
+    }
+    g_queue_push_tail_link (&server->priv->rate_limit_order, &limit->link);
 
-        packet = xdmcp_packet_decode ((guint8 *)data, n_read);
-        if (packet)
+    if (limit->tokens < 1)
+    {
+        /* Only note when an address goes over the limit so a flood costs nothing to log */
+        if (!limit->throttled)
         {
-            g_autofree gchar *packet_string = NULL;
-            g_autofree gchar *address_string = NULL;
+            g_autofree gchar *address_string = socket_address_to_string (address);
+            g_debug ("Ignoring packets from %s, over rate limit", address_string);
+        }
+        limit->throttled = TRUE;
+        return FALSE;
+    }
+    limit->tokens--;
+    limit->throttled = FALSE;
 
-            packet_string = xdmcp_packet_tostring (packet);
-            address_string = socket_address_to_string (address);
-            g_debug ("Got %s from %s", packet_string, address_string);
+    return TRUE;
+}
 
-            switch (packet->opcode)
-            {
-            case XDMCP_BroadcastQuery:
-            case XDMCP_Query:
-            case XDMCP_IndirectQuery:
-                handle_query (server, socket, address, packet->Query.authentication_names);
-                break;
-            case XDMCP_ForwardQuery:
-                handle_forward_query (server, socket, address, packet);
-                break;
-            case XDMCP_Request:
-                handle_request (server, socket, address, packet);
-                break;
-            case XDMCP_Manage:
-                handle_manage (server, socket, address, packet);
-                break;
-            case XDMCP_KeepAlive:
-                handle_keep_alive (server, socket, address, packet);
-                break;
-            default:
-                g_warning ("Got unexpected XDMCP packet %d", packet->opcode);
-                break;
-            }
+static void
+handle_packet (XDMCPServer *server, GSocket *socket, GSocketAddress *address, const guint8 *data, gsize data_length)
+{
+    /* Everything allocated for the previous packet has been sent */
+    xdmcp_arena_reset (&server->priv->arena);
+
+    XDMCPPacket *packet = xdmcp_packet_decode_in_arena (&server->priv->arena, data, data_length);
+    if (!packet)
+    {
+        server->priv->n_packets_dropped++;
+        return;
+    }
 
-            xdmcp_packet_free (packet);
+    /* Ignore clients sending too many packets that cost us a response or a session */
+    switch (packet->opcode)
+    {
+    case XDMCP_BroadcastQuery:
+    case XDMCP_Query:
+    case XDMCP_IndirectQuery:
+    case XDMCP_ForwardQuery:
+    case XDMCP_Request:
+        if (!check_rate_limit (server, address))
+        {
+            server->priv->n_packets_throttled++;
+            return;
         }
+        break;
+    default:
+        break;
     }
 
+    g_autofree gchar *packet_string = xdmcp_packet_tostring (packet);
+    g_autofree gchar *address_string = socket_address_to_string (address);
+    g_debug ("Got %s from %s", packet_string, address_string);
+
+    switch (packet->opcode)
+    {
+    case XDMCP_BroadcastQuery:
+    case XDMCP_Query:
+    case XDMCP_IndirectQuery:
+        handle_query (server, socket, address, packet->Query.authentication_names);
+        break;
+    case XDMCP_ForwardQuery:
+        handle_forward_query (server, socket, address, packet);
+        break;
+    case XDMCP_Request:
+        handle_request (server, socket, address, packet);
+        break;
+    case XDMCP_Manage:
+        handle_manage (server, socket, address, packet);
+        break;
+    case XDMCP_KeepAlive:
+        handle_keep_alive (server, socket, address, packet);
+        break;
+    default:
+        g_warning ("Got unexpected XDMCP packet %d", packet->opcode);
+        break;
+    }
+}
+
+static gboolean
+read_cb (GSocket *socket, GIOCondition condition, XDMCPServer *server)
+{
+    /* Take up to a batch of packets each wakeup, if there are more the socket will still be readable */
+    GSocketAddress *addresses[XDMCP_BATCH_SIZE];
+    GInputVector vectors[XDMCP_BATCH_SIZE];
+    GInputMessage messages[XDMCP_BATCH_SIZE];
+    for (int i = 0; i < XDMCP_BATCH_SIZE; i++)
+    {
+        addresses[i] = NULL;
+        vectors[i].buffer = server->priv->receive_data + i * XDMCP_MAX_PACKET_SIZE;
+        vectors[i].size = XDMCP_MAX_PACKET_SIZE;
+        messages[i].address = &addresses[i];
+        messages[i].vectors = &vectors[i];
+        messages[i].num_vectors = 1;
+        messages[i].bytes_received = 0;
+        messages[i].flags = 0;
+        messages[i].control_messages = NULL;
+        messages[i].num_control_messages = NULL;
+    }
+
+    g_autoptr(GError) error = NULL;
+    gint n_messages = g_socket_receive_messages (socket, messages, XDMCP_BATCH_SIZE, 0, NULL, &error);
+    if (n_messages < 0)
+    {
+        if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK))
+            g_warning ("Failed to read from XDMCP socket: %s", error->message);
+        return TRUE;
+    }
+
+    server->priv->n_batches++;
+    server->priv->n_packets_received += n_messages;
+    if ((guint) n_messages > server->priv->max_batch_size)
+    {
+        server->priv->max_batch_size = n_messages;
+        g_debug ("Received %d XDMCP packets in one read", n_messages);
+    }
+
+    for (int i = 0; i < n_messages; i++)
+    {
+        if (messages[i].bytes_received > 0)
+            handle_packet (server, socket, addresses[i], vectors[i].buffer, messages[i].bytes_received);
+        g_clear_object (&addresses[i]);
+    }
+    flush_packets (server);
+
     return TRUE;
 }
 
@@ -729,6 +1250,7 @@ open_udp_socket (GSocketFamily family, guint port, const gchar *listen_address,
     socket = g_socket_new (family, G_SOCKET_TYPE_DATAGRAM, G_SOCKET_PROTOCOL_UDP, error);
     if (!socket)
         return NULL;
+    g_socket_set_blocking (socket, FALSE);
 
     if (listen_address)
     {
@@ -749,6 +1271,48 @@ open_udp_socket (GSocketFamily family, guint port, const gchar *listen_address,
     return g_steal_pointer (&socket);
 }
 
+guint64
+xdmcp_server_get_n_packets_received (XDMCPServer *server)
+{
+    g_return_val_if_fail (server != NULL, 0);
+    return server->priv->n_packets_received;
+}
+
+guint64
+xdmcp_server_get_n_batches (XDMCPServer *server)
+{
+    g_return_val_if_fail (server != NULL, 0);
+    return server->priv->n_batches;
+}
+
+guint64
+xdmcp_server_get_n_packets_dropped (XDMCPServer *server)
+{
+    g_return_val_if_fail (server != NULL, 0);
+    return server->priv->n_packets_dropped;
+}
+
+guint64
+xdmcp_server_get_n_packets_throttled (XDMCPServer *server)
+{
+    g_return_val_if_fail (server != NULL, 0);
+    return server->priv->n_packets_throttled;
+}
+
+guint64
+xdmcp_server_get_n_requests_rejected (XDMCPServer *server)
+{
+    g_return_val_if_fail (server != NULL, 0);
+    return server->priv->n_requests_rejected;
+}
+
+guint64
+xdmcp_server_get_n_sessions_expired (XDMCPServer *server)
+{
+    g_return_val_if_fail (server != NULL, 0);
+    return server->priv->n_sessions_expired;
+}
+
 gboolean
 xdmcp_server_start (XDMCPServer *server)
 {
@@ -793,6 +1357,24 @@ xdmcp_server_init (XDMCPServer *server)
     server->priv->hostname = g_strdup ("");
     server->priv->status = g_strdup ("");
     server->priv->sessions = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_object_unref);
+    server->priv->rate_limits = g_hash_table_new_full (source_address_hash, source_address_equal, NULL, g_free);
+    g_queue_init (&server->priv->rate_limit_order);
+
+    /* Shuffle the session IDs */
+    server->priv->free_ids = g_malloc (sizeof (guint16) * N_SESSION_IDS);
+    for (guint i = 0; i < N_SESSION_IDS; i++)
+    {
+        guint j = g_random_int_range (0, i + 1);
+        server->priv->free_ids[i] = server->priv->free_ids[j];
+        server->priv->free_ids[j] = i + 1;
+    }
+    server->priv->n_free_ids = N_SESSION_IDS;
+
+    for (guint i = 0; i < WHEEL_N_SLOTS; i++)
+        g_queue_init (&server->priv->wheel[i]);
+
+    server->priv->receive_data = g_malloc (XDMCP_BATCH_SIZE * XDMCP_MAX_PACKET_SIZE);
+    server->priv->send_data = g_malloc (XDMCP_BATCH_SIZE * XDMCP_MAX_PACKET_SIZE);
 }
 
 static void
@@ -800,13 +1382,30 @@ xdmcp_server_finalize (GObject *object)
 {
     XDMCPServer *self = XDMCP_SERVER (object);
 
+    if (self->priv->wheel_timeout)
+        g_source_remove (self->priv->wheel_timeout);
     g_clear_object (&self->priv->socket);
     g_clear_object (&self->priv->socket6);
     g_clear_pointer (&self->priv->listen_address, g_free);
     g_clear_pointer (&self->priv->hostname, g_free);
     g_clear_pointer (&self->priv->status, g_free);
     g_clear_pointer (&self->priv->key, g_free);
+    clear_query_responses (self);
+    GHashTableIter iter;
+    gpointer session;
+    g_hash_table_iter_init (&iter, self->priv->sessions);
+    while (g_hash_table_iter_next (&iter, NULL, &session))
+        g_signal_handlers_disconnect_by_func (session, session_connect_failed_cb, self);
     g_clear_pointer (&self->priv->sessions, g_hash_table_unref);
+    g_clear_pointer (&self->priv->free_ids, g_free);
+    /* Links are part of the entries so are freed with the table */
+    g_queue_init (&self->priv->rate_limit_order);
+    g_clear_pointer (&self->priv->rate_limits, g_hash_table_unref);
+    for (guint i = 0; i < self->priv->n_send_messages; i++)
+        g_clear_object (&self->priv->send_messages[i].address);
+    g_clear_pointer (&self->priv->receive_data, g_free);
+    g_clear_pointer (&self->priv->send_data, g_free);
+    xdmcp_arena_reset (&self->priv->arena);
 
     G_OBJECT_CLASS (xdmcp_server_parent_class)->finalize (object);
 }
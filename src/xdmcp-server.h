@@ -58,10 +58,28 @@ void xdmcp_server_set_status (XDMCPServer *server, const gchar *status);
 
 const gchar *xdmcp_server_get_status (XDMCPServer *server);
 
+void xdmcp_server_set_max_unmanaged_sessions (XDMCPServer *server, guint max_unmanaged_sessions);
+
+void xdmcp_server_set_rate_limit (XDMCPServer *server, guint rate_limit);
+
+void xdmcp_server_set_keep_alive_timeout (XDMCPServer *server, guint keep_alive_timeout);
+
 void xdmcp_server_set_key (XDMCPServer *server, const gchar *key);
 
 gboolean xdmcp_server_start (XDMCPServer *server);
 
+guint64 xdmcp_server_get_n_packets_received (XDMCPServer *server);
+
+guint64 xdmcp_server_get_n_batches (XDMCPServer *server);
+
+guint64 xdmcp_server_get_n_packets_dropped (XDMCPServer *server);
+
+guint64 xdmcp_server_get_n_packets_throttled (XDMCPServer *server);
+
+guint64 xdmcp_server_get_n_requests_rejected (XDMCPServer *server);
+
+guint64 xdmcp_server_get_n_sessions_expired (XDMCPServer *server);
+
 G_END_DECLS
 
 #endif /* XDMCP_SERVER_H_ */
@@ -25,15 +25,28 @@ struct XDMCPSessionPrivate
 
     GInetAddress *address;
 
-    guint inactive_timeout;
+    /* Time in seconds this session expires and its place in the server timer wheel */
+    gint64 expire_time;
+    GList wheel_link;
+    guint wheel_slot;
 
     XAuthority *authority;
 
     gboolean started;
 
+    /* TRUE while the seat for this session is running */
+    gboolean running;
+
     guint16 display_number;
 
     gchar *display_class;
+
+    /* Where the Manage came from, so the terminal can be told if connecting to it fails */
+    GSocket *manage_socket;
+    GSocketAddress *manage_address;
+
+    /* TRUE if connecting to the terminal's display failed */
+    gboolean failed;
 };
 
 #endif /* XDMCP_SESSION_PRIVATE_H_ */
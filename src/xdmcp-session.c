@@ -12,6 +12,13 @@
 #include "xdmcp-session.h"
 #include "xdmcp-session-private.h"
 
+enum {
+    EXPIRED,
+    CONNECT_FAILED,
+    LAST_SIGNAL
+};
+static guint signals[LAST_SIGNAL] = { 0 };
+
 G_DEFINE_TYPE (XDMCPSession, xdmcp_session, G_TYPE_OBJECT)
 
 XDMCPSession *
@@ -66,12 +73,27 @@ xdmcp_session_get_display_class (XDMCPSession *session)
     return session->priv->display_class;
 }
 
+void
+xdmcp_session_set_running (XDMCPSession *session, gboolean running)
+{
+    g_return_if_fail (session != NULL);
+    session->priv->running = running;
+}
+
+void
+xdmcp_session_connect_failed (XDMCPSession *session)
+{
+    g_return_if_fail (session != NULL);
+    g_signal_emit (session, signals[CONNECT_FAILED], 0);
+}
+
 static void
 xdmcp_session_init (XDMCPSession *session)
 {
     session->priv = G_TYPE_INSTANCE_GET_PRIVATE (session, XDMCP_SESSION_TYPE, XDMCPSessionPrivate);
     session->priv->manufacturer_display_id = g_strdup ("");
     session->priv->display_class = g_strdup ("");
+    session->priv->wheel_link.data = NULL;
 }
 
 static void
@@ -83,6 +105,8 @@ xdmcp_session_finalize (GObject *object)
     g_clear_object (&self->priv->address);
     g_clear_object (&self->priv->authority);
     g_clear_pointer (&self->priv->display_class, g_free);
+    g_clear_object (&self->priv->manage_socket);
+    g_clear_object (&self->priv->manage_address);
 
     G_OBJECT_CLASS (xdmcp_session_parent_class)->finalize (object);
 }
@@ -95,4 +119,21 @@ xdmcp_session_class_init (XDMCPSessionClass *klass)
     object_class->finalize = xdmcp_session_finalize;
 
     g_type_class_add_private (klass, sizeof (XDMCPSessionPrivate));
+
+    signals[EXPIRED] =
+        g_signal_new (XDMCP_SESSION_SIGNAL_EXPIRED,
+                      G_TYPE_FROM_CLASS (klass),
+                      G_SIGNAL_RUN_LAST,
+                      G_STRUCT_OFFSET (XDMCPSessionClass, expired),
+                      NULL, NULL,
+                      NULL,
+                      G_TYPE_NONE, 0);
+    signals[CONNECT_FAILED] =
+        g_signal_new (XDMCP_SESSION_SIGNAL_CONNECT_FAILED,
+                      G_TYPE_FROM_CLASS (klass),
+                      G_SIGNAL_RUN_LAST,
+                      G_STRUCT_OFFSET (XDMCPSessionClass, connect_failed),
+                      NULL, NULL,
+                      NULL,
+                      G_TYPE_NONE, 0);
 }
@@ -49,6 +49,9 @@ static int display_number = 0;
 /* VT being run on */
 static int vt_number = -1;
 
+/* File descriptor to write display number to when ready */
+static int display_fd = -1;
+
 /* X server */
 static XServer *xserver = NULL;
 
@@ -171,7 +174,10 @@ static void
 client_connected_cb (XServer *server, XClient *client)
 {
     status_notify ("%s ACCEPT-CONNECT", id);
-    x_client_send_success (client);
+
+    /* Simulate a server that accepts connections but never completes the setup */
+    if (!g_key_file_get_boolean (config, "test-xserver-config", "no-setup-reply", NULL))
+        x_client_send_success (client);
 }
 
 static void
@@ -220,6 +226,17 @@ request_cb (const gchar *name, GHashTable *params)
 
     else if (strcmp (name, "INDICATE-READY") == 0)
     {
+        if (display_fd >= 0)
+        {
+            status_notify ("%s INDICATE-READY", id);
+            g_autofree gchar *number = g_strdup_printf ("%d\n", display_number);
+            if (write (display_fd, number, strlen (number)) < 0)
+                g_printerr ("Failed to write display number: %s\n", strerror (errno));
+            close (display_fd);
+            display_fd = -1;
+            return;
+        }
+
         void *handler = signal (SIGUSR1, SIG_IGN);
         if (handler == SIG_IGN)
         {
@@ -447,6 +464,11 @@ main (int argc, char **argv)
         {
             /* Ignore VT args */
         }
+        else if (strcmp (arg, "-displayfd") == 0)
+        {
+            display_fd = atoi (argv[i+1]);
+            i++;
+        }
         else if (strcmp (arg, "-seat") == 0)
         {
             seat = argv[i+1];
@@ -486,6 +508,7 @@ main (int argc, char **argv)
                         "-broadcast             Broadcast for XDMCP\n"
                         "-port port-num         UDP port number to send messages to\n"
                         "-seat string           seat to run on\n"
+                        "-displayfd fd          file descriptor to write display number to when ready\n"
                         "-mir id                Mir ID to use\n"
                         "-mirSocket name        Mir socket to use\n"
                         "-version               show the server version\n"
@@ -518,6 +541,8 @@ main (int argc, char **argv)
         g_string_append (status_text, " NO-LISTEN-UNIX");
     if (seat != NULL)
         g_string_append_printf (status_text, " SEAT=%s", seat);
+    if (display_fd >= 0)
+        g_string_append (status_text, " DISPLAYFD");
     if (mir_id != NULL)
         g_string_append_printf (status_text, " MIR-ID=%s", mir_id);
     status_notify ("%s", status_text->str);
@@ -581,6 +606,7 @@ main (int argc, char **argv)
         return EXIT_FAILURE;
     }
 
+    x_server_set_listen_tcp (xserver, listen_tcp);
     if (!x_server_start (xserver))
         return EXIT_FAILURE;
 
@@ -5,6 +5,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stddef.h>
 #include <string.h>
 #include <errno.h>
 #include <sys/types.h>
@@ -229,6 +230,13 @@ open_wrapper (const char *func, const char *pathname, int flags, mode_t mode)
         return tty_fd;
     }
 
+    /* VT state is faked with ioctls, so don't let the daemon read the real active VT */
+    if (strcmp (pathname, "/sys/class/tty/tty0/active") == 0)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+
     g_autofree gchar *new_path = redirect_path (pathname);
     return _open (new_path, flags, mode);
 }
@@ -279,6 +287,25 @@ unlinkat (int dirfd, const char *pathname, int flags)
     return _unlinkat (dirfd, new_path, flags);
 }
 
+int
+unlink (const char *pathname)
+{
+    int (*_unlink) (const char *pathname) = dlsym (RTLD_NEXT, "unlink");
+
+    g_autofree gchar *new_path = redirect_path (pathname);
+    return _unlink (new_path);
+}
+
+int
+rename (const char *oldpath, const char *newpath)
+{
+    int (*_rename) (const char *oldpath, const char *newpath) = dlsym (RTLD_NEXT, "rename");
+
+    g_autofree gchar *new_oldpath = redirect_path (oldpath);
+    g_autofree gchar *new_newpath = redirect_path (newpath);
+    return _rename (new_oldpath, new_newpath);
+}
+
 int
 creat (const char *pathname, mode_t mode)
 {
@@ -542,6 +569,8 @@ bind (int sockfd, const struct sockaddr *addr, socklen_t addrlen)
 
 #include <ctype.h>
 
+#define PLYMOUTH_SOCKET_PATH "/org/freedesktop/plymouthd"
+
 int
 connect (int sockfd, const struct sockaddr *addr, socklen_t addrlen)
 {
@@ -564,6 +593,17 @@ connect (int sockfd, const struct sockaddr *addr, socklen_t addrlen)
             strncpy (temp_addr_un.sun_path, new_path, sizeof (temp_addr_un.sun_path) - 1);
             modified_addr = (struct sockaddr *) &temp_addr_un;
         }
+        /* Plymouth uses an abstract socket, use the one the test plymouthd listens on */
+        else if (addrlen == offsetof (struct sockaddr_un, sun_path) + 1 + strlen (PLYMOUTH_SOCKET_PATH) &&
+                 memcmp (path + 1, PLYMOUTH_SOCKET_PATH, strlen (PLYMOUTH_SOCKET_PATH)) == 0)
+        {
+            g_autofree gchar *new_path = g_build_filename (g_getenv ("LIGHTDM_TEST_ROOT"), "plymouthd.socket", NULL);
+            memset (&temp_addr_un, 0, sizeof (temp_addr_un));
+            temp_addr_un.sun_family = AF_UNIX;
+            strncpy (temp_addr_un.sun_path, new_path, sizeof (temp_addr_un.sun_path) - 1);
+            modified_addr = (struct sockaddr *) &temp_addr_un;
+            addrlen = sizeof (temp_addr_un);
+        }
         break;
     case AF_INET:
         port = ntohs (((const struct sockaddr_in *) addr)->sin_port);
@@ -1664,6 +1704,35 @@ xcb_connect_to_display_with_auth_info (const char *display, xcb_auth_info_t *aut
     return c;
 }
 
+xcb_connection_t *
+xcb_connect_to_fd (int fd, xcb_auth_info_t *auth_info)
+{
+    xcb_connection_t *c = malloc (sizeof (xcb_connection_t));
+    c->display = NULL;
+    c->error = 0;
+
+    g_autoptr(GError) error = NULL;
+    c->socket = g_socket_new_from_fd (fd, &error);
+    if (c->socket == NULL)
+    {
+        g_printerr ("%s\n", error->message);
+        c->error = XCB_CONN_ERROR;
+    }
+
+    // FIXME: Send auth info
+
+    /* Wait for the server to accept the connection, like the real setup round trip */
+    if (c->error == 0)
+    {
+        gchar reply[7];
+        if (g_socket_receive (c->socket, reply, sizeof (reply), NULL, NULL) != sizeof (reply) ||
+            memcmp (reply, "SUCCESS", sizeof (reply)) != 0)
+            c->error = XCB_CONN_ERROR;
+    }
+
+    return c;
+}
+
 xcb_connection_t *
 xcb_connect (const char *displayname, int *screenp)
 {
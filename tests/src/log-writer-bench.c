@@ -0,0 +1,69 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <log-writer.h>
+
+/* Measures the cost of a debug message to the daemon, as logged many times a second by a busy XDMCP server */
+
+static const gchar *message = "XDMCP: Got Request from 192.168.1.20:177";
+
+static gdouble
+time_sync_writes (int fd, GTimer *timer, guint n_iterations)
+{
+    gint64 start_time = g_get_monotonic_time ();
+    for (guint i = 0; i < n_iterations; i++)
+    {
+        g_autofree gchar *text = g_strdup_printf ("[%+.2fs] %s %s\n", g_timer_elapsed (timer, NULL), "DEBUG:", message);
+        if (write (fd, text, strlen (text)) < 0)
+            exit (EXIT_FAILURE);
+    }
+
+    return (gdouble) (g_get_monotonic_time () - start_time) / G_USEC_PER_SEC;
+}
+
+static gdouble
+time_buffered_writes (int fd, GTimer *timer, guint n_iterations)
+{
+    log_writer_start (fd, FALSE);
+
+    gint64 start_time = g_get_monotonic_time ();
+    for (guint i = 0; i < n_iterations; i++)
+        log_writer_log (g_timer_elapsed (timer, NULL), "DEBUG:", message);
+    gdouble time = (gdouble) (g_get_monotonic_time () - start_time) / G_USEC_PER_SEC;
+
+    log_writer_flush ();
+
+    return time;
+}
+
+int
+main (int argc, char **argv)
+{
+    guint n_iterations = argc > 1 ? atoi (argv[1]) : 1000000;
+
+    g_autofree gchar *path = g_build_filename (g_get_tmp_dir (), "lightdm-log-writer-bench.log", NULL);
+    int fd = open (path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0)
+    {
+        perror ("Failed to open log");
+        return EXIT_FAILURE;
+    }
+
+    g_autoptr(GTimer) timer = g_timer_new ();
+    gdouble sync_time = time_sync_writes (fd, timer, n_iterations);
+    gdouble buffered_time = time_buffered_writes (fd, timer, n_iterations);
+
+    close (fd);
+    g_unlink (path);
+
+    g_print ("%u log messages\n", n_iterations);
+    g_print ("sync: %.0f messages/s\n", n_iterations / sync_time);
+    g_print ("buffered: %.0f messages/s (%" G_GUINT64_FORMAT " dropped)\n", n_iterations / buffered_time, log_writer_get_n_dropped ());
+
+    return EXIT_SUCCESS;
+}
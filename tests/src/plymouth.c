@@ -1,12 +1,107 @@
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <glib.h>
 #include <glib-object.h>
+#include <glib-unix.h>
 
 #include "status.h"
 
 static GKeyFile *config;
 
+static GMainLoop *loop;
+
+static void
+request_cb (const gchar *name, GHashTable *params)
+{
+    if (!name)
+        g_main_loop_quit (loop);
+}
+
+static gboolean
+read_data (int fd, void *buffer, size_t count)
+{
+    size_t n_read = 0;
+    while (n_read < count)
+    {
+        ssize_t n = read (fd, (guint8 *) buffer + n_read, count - n_read);
+        if (n <= 0)
+            return FALSE;
+        n_read += n;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+client_cb (gint fd, GIOCondition condition, gpointer data)
+{
+    /* Requests are a command followed by a nul or \002, argument length and argument */
+    guint8 header[2];
+    if (!read_data (fd, header, sizeof (header)))
+    {
+        close (fd);
+        return G_SOURCE_REMOVE;
+    }
+    gchar argument[256] = { 0 };
+    if (header[1] == '\002')
+    {
+        guint8 length;
+        if (!read_data (fd, &length, sizeof (length)) || !read_data (fd, argument, length))
+        {
+            close (fd);
+            return G_SOURCE_REMOVE;
+        }
+    }
+
+    gboolean result = TRUE;
+    gboolean quit = FALSE;
+    switch (header[0])
+    {
+    case 'P':
+        result = g_key_file_get_boolean (config, "test-plymouth-config", "active", NULL);
+        status_notify ("PLYMOUTH PING ACTIVE=%s", result ? "TRUE" : "FALSE");
+        break;
+    case 'V':
+        result = g_key_file_get_boolean (config, "test-plymouth-config", "has-active-vt", NULL);
+        status_notify ("PLYMOUTH HAS-ACTIVE-VT=%s", result ? "TRUE" : "FALSE");
+        break;
+    case 'D':
+        status_notify ("PLYMOUTH DEACTIVATE");
+        break;
+    case 'Q':
+        status_notify ("PLYMOUTH QUIT RETAIN-SPLASH=%s", argument[0] ? "TRUE" : "FALSE");
+        quit = TRUE;
+        break;
+    default:
+        result = FALSE;
+        break;
+    }
+
+    /* Respond with ACK or NAK */
+    guint8 response = result ? '\006' : '\025';
+    if (write (fd, &response, sizeof (response)) != sizeof (response))
+        perror ("Failed to write response");
+
+    if (quit)
+        g_main_loop_quit (loop);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+connect_cb (gint fd, GIOCondition condition, gpointer data)
+{
+    int client_fd = accept (fd, NULL, NULL);
+    if (client_fd >= 0)
+        g_unix_fd_add (client_fd, G_IO_IN | G_IO_HUP, client_cb, NULL);
+
+    return G_SOURCE_CONTINUE;
+}
+
 int
 main (int argc, char **argv)
 {
@@ -14,46 +109,46 @@ main (int argc, char **argv)
     g_type_init ();
 #endif
 
-    status_connect (NULL, NULL);
-
     config = g_key_file_new ();
     g_key_file_load_from_file (config, g_build_filename (g_getenv ("LIGHTDM_TEST_ROOT"), "script", NULL), G_KEY_FILE_NONE, NULL);
 
     if (!g_key_file_get_boolean (config, "test-plymouth-config", "enabled", NULL))
-        return EXIT_FAILURE;
+        return EXIT_SUCCESS;
 
-    if (argc == 2 && strcmp (argv[1], "--ping") == 0)
+    /* Listen where the preloaded library redirects the Plymouth abstract socket to */
+    g_autofree gchar *socket_path = g_build_filename (g_getenv ("LIGHTDM_TEST_ROOT"), "plymouthd.socket", NULL);
+    struct sockaddr_un address;
+    memset (&address, 0, sizeof (address));
+    address.sun_family = AF_UNIX;
+    strncpy (address.sun_path, socket_path, sizeof (address.sun_path) - 1);
+    int listen_fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0 ||
+        bind (listen_fd, (struct sockaddr *) &address, sizeof (address)) < 0 ||
+        listen (listen_fd, 5) < 0)
     {
-        if (g_key_file_get_boolean (config, "test-plymouth-config", "active", NULL))
-        {
-            status_notify ("PLYMOUTH PING ACTIVE=TRUE");
-            return EXIT_SUCCESS;
-        }
-        else
-        {
-            status_notify ("PLYMOUTH PING ACTIVE=FALSE");
-            return EXIT_FAILURE;
-        }
+        perror ("Failed to listen on Plymouth socket");
+        return EXIT_FAILURE;
     }
-    if (argc == 2 && strcmp (argv[1], "--has-active-vt") == 0)
+
+    /* Run in the background once the socket is ready so the daemon can connect straight away */
+    pid_t pid = fork ();
+    if (pid < 0)
     {
-        if (g_key_file_get_boolean (config, "test-plymouth-config", "has-active-vt", NULL))
-        {
-            status_notify ("PLYMOUTH HAS-ACTIVE-VT=TRUE");
-            return EXIT_SUCCESS;
-        }
-        else
-        {
-            status_notify ("PLYMOUTH HAS-ACTIVE-VT=FALSE");
-            return EXIT_FAILURE;
-        }
+        perror ("Failed to fork");
+        return EXIT_FAILURE;
     }
-    if (argc == 2 && strcmp (argv[1], "deactivate") == 0)
-        status_notify ("PLYMOUTH DEACTIVATE");
-    if (argc == 2 && strcmp (argv[1], "quit") == 0)
-        status_notify ("PLYMOUTH QUIT RETAIN-SPLASH=FALSE");
-    if (argc == 3 && strcmp (argv[1], "quit") == 0 && strcmp (argv[2], "--retain-splash") == 0)
-        status_notify ("PLYMOUTH QUIT RETAIN-SPLASH=TRUE");
+    if (pid != 0)
+        return EXIT_SUCCESS;
+
+    loop = g_main_loop_new (NULL, FALSE);
+
+    status_connect (request_cb, "PLYMOUTH");
+
+    g_unix_fd_add (listen_fd, G_IO_IN, connect_cb, NULL);
+
+    g_main_loop_run (loop);
+
+    unlink (socket_path);
 
     return EXIT_SUCCESS;
 }
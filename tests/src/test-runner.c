@@ -421,6 +421,19 @@ handle_command (const gchar *command)
                                                g_getenv ("PATH"), g_getenv ("LD_PRELOAD"), g_getenv ("LD_LIBRARY_PATH"), g_getenv ("LIGHTDM_TEST_ROOT"), g_getenv ("DBUS_SESSION_BUS_ADDRESS"),
                                                command_line->str);
 
+        /* Start the Plymouth daemon for the daemon to connect to */
+        if (g_key_file_get_boolean (config, "test-plymouth-config", "enabled", NULL))
+        {
+            gchar *plymouthd_argv[] = { "plymouthd", NULL };
+            gint exit_status;
+            g_autoptr(GError) plymouthd_error = NULL;
+            if (!g_spawn_sync (NULL, plymouthd_argv, NULL, G_SPAWN_SEARCH_PATH, NULL, NULL, NULL, NULL, &exit_status, &plymouthd_error) || exit_status != 0)
+            {
+                g_warning ("Error launching plymouthd: %s", plymouthd_error ? plymouthd_error->message : "Failed to start");
+                quit (EXIT_FAILURE);
+            }
+        }
+
         gchar **lightdm_argv;
         g_autoptr(GError) error = NULL;
         if (!g_shell_parse_argv (command_line->str, NULL, &lightdm_argv, &error))
@@ -621,6 +634,57 @@ handle_command (const gchar *command)
 
         check_status (status->str);
     }
+    else if (strcmp (name, "LIST-OBJECTS") == 0)
+    {
+        g_autoptr(GError) error = NULL;
+        g_autoptr(GVariant) result = g_dbus_connection_call_sync (g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, NULL),
+                                                                  "org.freedesktop.DisplayManager",
+                                                                  "/org/freedesktop/DisplayManager",
+                                                                  "org.freedesktop.DBus.ObjectManager",
+                                                                  "GetManagedObjects",
+                                                                  NULL,
+                                                                  G_VARIANT_TYPE ("(a{oa{sa{sv}}})"),
+                                                                  G_DBUS_CALL_FLAGS_NONE,
+                                                                  G_MAXINT,
+                                                                  NULL,
+                                                                  &error);
+
+        g_autoptr(GString) status = g_string_new ("RUNNER LIST-OBJECTS");
+        if (result)
+        {
+            g_string_append (status, " OBJECTS=");
+
+            GVariantIter *iter;
+            g_variant_get (result, "(a{oa{sa{sv}}})", &iter);
+
+            /* Seats are listed by path, sessions by path and user */
+            const gchar *path;
+            GVariant *interfaces;
+            int i = 0;
+            while (g_variant_iter_loop (iter, "{&o@a{sa{sv}}}", &path, &interfaces))
+            {
+                if (i != 0)
+                    g_string_append (status, ",");
+                g_string_append (status, path);
+
+                g_autoptr(GVariant) properties = g_variant_lookup_value (interfaces, "org.freedesktop.DisplayManager.Session", G_VARIANT_TYPE ("a{sv}"));
+                const gchar *username;
+                if (properties && g_variant_lookup (properties, "UserName", "&s", &username))
+                    g_string_append_printf (status, ":%s", username);
+                i++;
+            }
+            g_variant_iter_free (iter);
+        }
+        else
+        {
+            if (g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_SERVICE_UNKNOWN))
+                g_string_append_printf (status, " ERROR=SERVICE_UNKNOWN");
+            else
+                g_string_append_printf (status, " ERROR=%s", error->message);
+        }
+
+        check_status (status->str);
+    }
     else if (strcmp (name, "SEAT-CAN-SWITCH") == 0)
     {
         g_autoptr(GError) error = NULL;
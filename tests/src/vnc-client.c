@@ -43,12 +43,19 @@ main (int argc, char **argv)
 
     gchar buffer[1024];
     gssize n_read = g_socket_receive (socket, buffer, 1023, NULL, &error);
-    if (n_read <= 0)
+    if (n_read < 0)
     {
         g_warning ("Unable to receive on VNC socket: %s", error->message);
         return EXIT_FAILURE;
     }
 
+    /* Server turned us away */
+    if (n_read == 0)
+    {
+        status_notify ("VNC-CLIENT DISCONNECTED");
+        return EXIT_SUCCESS;
+    }
+
     buffer[n_read] = '\0';
     if (g_str_has_suffix (buffer, "\n"))
         buffer[n_read-1] = '\0';
@@ -0,0 +1,77 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <x-authority.h>
+
+/* Measures updating a large Xauthority file, as found on shared hosts with many remote displays */
+
+static XAuthority *
+make_authority (guint16 family, guint32 address, guint number)
+{
+    guint8 a[4] = { address >> 24, (address >> 16) & 0xFF, (address >> 8) & 0xFF, address & 0xFF };
+    g_autofree gchar *n = g_strdup_printf ("%u", number);
+    return x_authority_new_cookie (family, a, sizeof (a), n);
+}
+
+static gdouble
+time_writes (XAuthWriteMode mode, XAuthority *auth, const gchar *filename, guint n_iterations)
+{
+    gint64 start_time = g_get_monotonic_time ();
+    for (guint i = 0; i < n_iterations; i++)
+    {
+        g_autoptr(GError) error = NULL;
+        if (!x_authority_write (auth, mode, filename, &error))
+        {
+            g_printerr ("%s\n", error->message);
+            exit (EXIT_FAILURE);
+        }
+    }
+
+    return (gdouble) (g_get_monotonic_time () - start_time) / n_iterations;
+}
+
+int
+main (int argc, char **argv)
+{
+    guint n_records = argc > 1 ? atoi (argv[1]) : 10000;
+    guint n_iterations = argc > 2 ? atoi (argv[2]) : 100;
+
+    g_autofree gchar *dir = g_dir_make_tmp ("x-authority-bench-XXXXXX", NULL);
+    if (!dir)
+    {
+        g_printerr ("Failed to make temporary directory\n");
+        return EXIT_FAILURE;
+    }
+    g_autofree gchar *filename = g_build_filename (dir, "Xauthority", NULL);
+
+    /* Fill the file with records for different remote displays */
+    gint64 start_time = g_get_monotonic_time ();
+    for (guint i = 0; i < n_records; i++)
+    {
+        g_autoptr(XAuthority) auth = make_authority (XAUTH_FAMILY_INTERNET, 0x0A000000 + i, i % 64);
+        x_authority_write (auth, XAUTH_WRITE_MODE_REPLACE, filename, NULL);
+    }
+    gdouble fill_time = (gdouble) (g_get_monotonic_time () - start_time) / G_USEC_PER_SEC;
+
+    GStatBuf file_stat;
+    g_stat (filename, &file_stat);
+    g_print ("%u records, %lld bytes, created in %.3fs\n", n_records, (long long) file_stat.st_size, fill_time);
+
+    /* Update a record in the middle, append a new record and remove it again */
+    g_autoptr(XAuthority) existing = make_authority (XAUTH_FAMILY_INTERNET, 0x0A000000 + n_records / 2, (n_records / 2) % 64);
+    g_print ("replace existing: %.1fus\n", time_writes (XAUTH_WRITE_MODE_REPLACE, existing, filename, n_iterations));
+
+    g_autoptr(XAuthority) new_auth = make_authority (XAUTH_FAMILY_LOCAL, 0, 0);
+    gdouble replace_time = time_writes (XAUTH_WRITE_MODE_REPLACE, new_auth, filename, 1);
+    gdouble remove_time = time_writes (XAUTH_WRITE_MODE_REMOVE, new_auth, filename, 1);
+    g_print ("append new: %.1fus\n", replace_time);
+    g_print ("remove: %.1fus\n", remove_time);
+
+    g_unlink (filename);
+    g_rmdir (dir);
+
+    return EXIT_SUCCESS;
+}
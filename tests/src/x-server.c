@@ -32,6 +32,9 @@ struct XServerPrivate
     gchar *socket_path;
     GSocket *socket;
     GIOChannel *channel;
+    gboolean listen_tcp;
+    GSocket *tcp_socket;
+    GIOChannel *tcp_channel;
     GHashTable *clients;
 };
 
@@ -127,13 +130,17 @@ client_read_cb (GIOChannel *channel, GIOCondition condition, gpointer data)
     return G_SOURCE_CONTINUE;
 }
 
-static gboolean
-socket_connect_cb (GIOChannel *channel, GIOCondition condition, gpointer data)
+void
+x_server_set_listen_tcp (XServer *server, gboolean listen_tcp)
 {
-    XServer *server = data;
+    server->priv->listen_tcp = listen_tcp;
+}
 
+static gboolean
+accept_client (XServer *server, GSocket *socket)
+{
     g_autoptr(GError) error = NULL;
-    g_autoptr(GSocket) data_socket = g_socket_accept (server->priv->socket, NULL, &error);
+    g_autoptr(GSocket) data_socket = g_socket_accept (socket, NULL, &error);
     if (error)
         g_warning ("Error accepting connection: %s", strerror (errno));
     if (!data_socket)
@@ -151,6 +158,20 @@ socket_connect_cb (GIOChannel *channel, GIOCondition condition, gpointer data)
     return TRUE;
 }
 
+static gboolean
+socket_connect_cb (GIOChannel *channel, GIOCondition condition, gpointer data)
+{
+    XServer *server = data;
+    return accept_client (server, server->priv->socket);
+}
+
+static gboolean
+tcp_socket_connect_cb (GIOChannel *channel, GIOCondition condition, gpointer data)
+{
+    XServer *server = data;
+    return accept_client (server, server->priv->tcp_socket);
+}
+
 gboolean
 x_server_start (XServer *server)
 {
@@ -169,6 +190,23 @@ x_server_start (XServer *server)
     server->priv->channel = g_io_channel_unix_new (g_socket_get_fd (server->priv->socket));
     g_io_add_watch (server->priv->channel, G_IO_IN, socket_connect_cb, server);
 
+    /* The port is redirected by the preloaded library so remote connections can find it */
+    if (server->priv->listen_tcp)
+    {
+        g_autoptr(GInetAddress) any_address = g_inet_address_new_any (G_SOCKET_FAMILY_IPV4);
+        g_autoptr(GSocketAddress) address = g_inet_socket_address_new (any_address, 6000 + server->priv->display_number);
+        server->priv->tcp_socket = g_socket_new (G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP, &error);
+        if (!server->priv->tcp_socket ||
+            !g_socket_bind (server->priv->tcp_socket, address, TRUE, &error) ||
+            !g_socket_listen (server->priv->tcp_socket, &error))
+        {
+            g_warning ("Error creating TCP X socket: %s", error->message);
+            return FALSE;
+        }
+        server->priv->tcp_channel = g_io_channel_unix_new (g_socket_get_fd (server->priv->tcp_socket));
+        g_io_add_watch (server->priv->tcp_channel, G_IO_IN, tcp_socket_connect_cb, server);
+    }
+
     return TRUE;
 }
 
@@ -46,6 +46,8 @@ GType x_server_get_type (void);
 
 XServer *x_server_new (gint display_number);
 
+void x_server_set_listen_tcp (XServer *server, gboolean listen_tcp);
+
 gboolean x_server_start (XServer *server);
 
 gsize x_server_get_n_clients (XServer *server);
@@ -0,0 +1,491 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "xdmcp-client.h"
+
+/* Simulates many XDMCP terminals logging into a display manager and records how long each response takes.
+ * Each terminal sends Query, Request, Manage then KeepAlives. The display manager connects back to each terminal's
+ * display, so terminals without an X server listening are reported as not running.
+ *
+ * With --x-server each terminal first starts "COMMAND :N -listen tcp" and waits for it to accept TCP connections.
+ * Use Xvfb against a real daemon. tests/src/X only completes the connection setup with a daemon started by the
+ * test runner (which preloads libsystem), so run the bench with that daemon's LIGHTDM_TEST_ROOT in the environment;
+ * otherwise a temporary directory is used for the X servers' lock files. */
+
+typedef enum
+{
+    PHASE_X_SERVER,
+    PHASE_QUERY,
+    PHASE_REQUEST,
+    PHASE_MANAGE,
+    PHASE_KEEP_ALIVE,
+    N_PHASES
+} Phase;
+
+static const gchar *phase_names[N_PHASES] = { "XServer", "Query", "Request", "Manage", "KeepAlive" };
+
+typedef struct
+{
+    XDMCPClient *client;
+    Phase phase;
+    guint16 display_number;
+    guint32 session_id;
+    guint n_keep_alives;
+    guint n_retries;
+    gint64 send_time;
+    guint timeout;
+    GSubprocess *x_server;
+    GSocketClient *x_probe;
+} Terminal;
+
+static gchar *host = NULL;
+static gint port = XDMCP_PORT;
+static gint n_terminals = 1000;
+static gint concurrency = 100;
+static gint n_keep_alives = 3;
+static gint response_timeout = 2000;
+static gint max_retries = 3;
+static gint display_number = 100;
+static gboolean broadcast = FALSE;
+static gchar *x_server_command = NULL;
+static gint x_server_timeout = 10000;
+
+/* Environment the X servers are run in */
+static GSubprocessLauncher *x_server_launcher = NULL;
+
+static GMainLoop *loop;
+
+/* Terminals started and finished */
+static guint n_started = 0;
+static guint n_finished = 0;
+
+/* Outcomes */
+static guint n_completed = 0;
+static guint n_unwilling = 0;
+static guint n_declined = 0;
+static guint n_failed = 0;
+static guint n_not_running = 0;
+static guint n_timed_out = 0;
+static guint n_x_server_failed = 0;
+
+/* Requests sent and the number that got no response */
+static guint64 n_sent = 0;
+static guint64 n_lost = 0;
+
+/* Microseconds taken to get a response in each phase */
+static GArray *latencies[N_PHASES];
+
+static void send_phase (Terminal *terminal);
+static void start_terminals (void);
+
+static gboolean
+unref_client_cb (gpointer data)
+{
+    g_object_unref (data);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+finish_terminal (Terminal *terminal)
+{
+    if (terminal->timeout)
+        g_source_remove (terminal->timeout);
+    terminal->timeout = 0;
+
+    if (terminal->x_probe)
+    {
+        /* Stops a probe in progress; its callback frees it */
+        g_object_set_data (G_OBJECT (terminal->x_probe), "terminal", NULL);
+        terminal->x_probe = NULL;
+    }
+    if (terminal->x_server)
+    {
+        g_subprocess_send_signal (terminal->x_server, SIGTERM);
+        g_clear_object (&terminal->x_server);
+    }
+
+    /* Called from the client's own signals, so free it once they have returned */
+    g_signal_handlers_disconnect_matched (terminal->client, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, terminal);
+    g_idle_add (unref_client_cb, terminal->client);
+    g_free (terminal);
+
+    n_finished++;
+    if (n_finished == (guint) n_terminals)
+        g_main_loop_quit (loop);
+    else
+        start_terminals ();
+}
+
+static gboolean
+got_response (Terminal *terminal, Phase phase)
+{
+    /* Ignore late replies to retries */
+    if (terminal->phase != phase)
+        return FALSE;
+
+    gint64 latency = g_get_monotonic_time () - terminal->send_time;
+    g_array_append_val (latencies[phase], latency);
+
+    if (terminal->timeout)
+        g_source_remove (terminal->timeout);
+    terminal->timeout = 0;
+    terminal->n_retries = 0;
+
+    return TRUE;
+}
+
+static void
+willing_cb (XDMCPClient *client, XDMCPWilling *message, Terminal *terminal)
+{
+    if (!got_response (terminal, PHASE_QUERY))
+        return;
+
+    terminal->phase = PHASE_REQUEST;
+    send_phase (terminal);
+}
+
+static void
+unwilling_cb (XDMCPClient *client, XDMCPUnwilling *message, Terminal *terminal)
+{
+    if (!got_response (terminal, PHASE_QUERY))
+        return;
+
+    n_unwilling++;
+    finish_terminal (terminal);
+}
+
+static void
+accept_cb (XDMCPClient *client, XDMCPAccept *message, Terminal *terminal)
+{
+    if (!got_response (terminal, PHASE_REQUEST))
+        return;
+
+    terminal->session_id = message->session_id;
+    terminal->phase = PHASE_MANAGE;
+    send_phase (terminal);
+}
+
+static void
+decline_cb (XDMCPClient *client, XDMCPDecline *message, Terminal *terminal)
+{
+    if (!got_response (terminal, PHASE_REQUEST))
+        return;
+
+    n_declined++;
+    finish_terminal (terminal);
+}
+
+static void
+failed_cb (XDMCPClient *client, XDMCPFailed *message, Terminal *terminal)
+{
+    if (!got_response (terminal, PHASE_MANAGE))
+        return;
+
+    n_failed++;
+    finish_terminal (terminal);
+}
+
+static void
+alive_cb (XDMCPClient *client, XDMCPAlive *message, Terminal *terminal)
+{
+    if (!got_response (terminal, terminal->phase == PHASE_MANAGE ? PHASE_MANAGE : PHASE_KEEP_ALIVE))
+        return;
+
+    if (!message->session_running)
+    {
+        n_not_running++;
+        finish_terminal (terminal);
+        return;
+    }
+
+    if (terminal->phase == PHASE_KEEP_ALIVE)
+        terminal->n_keep_alives++;
+    if (terminal->n_keep_alives >= (guint) n_keep_alives)
+    {
+        n_completed++;
+        finish_terminal (terminal);
+        return;
+    }
+
+    terminal->phase = PHASE_KEEP_ALIVE;
+    send_phase (terminal);
+}
+
+static gboolean
+timeout_cb (Terminal *terminal)
+{
+    terminal->timeout = 0;
+    n_lost++;
+
+    if (terminal->n_retries >= (guint) max_retries)
+    {
+        n_timed_out++;
+        finish_terminal (terminal);
+        return G_SOURCE_REMOVE;
+    }
+
+    terminal->n_retries++;
+    send_phase (terminal);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+send_phase (Terminal *terminal)
+{
+    gchar *authentication_names[] = { NULL };
+    gchar *authorization_names[] = { "MIT-MAGIC-COOKIE-1", NULL };
+
+    terminal->send_time = g_get_monotonic_time ();
+    switch (terminal->phase)
+    {
+    case PHASE_QUERY:
+        if (broadcast)
+            xdmcp_client_send_broadcast_query (terminal->client, authentication_names);
+        else
+            xdmcp_client_send_query (terminal->client, authentication_names);
+        break;
+    case PHASE_REQUEST:
+    {
+        GInetAddress *addresses[] = { xdmcp_client_get_local_address (terminal->client), NULL };
+        xdmcp_client_send_request (terminal->client, terminal->display_number, addresses, "", NULL, 0, authorization_names, "xdmcp-bench");
+        break;
+    }
+    case PHASE_MANAGE:
+        /* A successful Manage has no reply, so follow it with a KeepAlive to see when it has been handled */
+        xdmcp_client_send_manage (terminal->client, terminal->session_id, terminal->display_number, "xdmcp-bench");
+        xdmcp_client_send_keep_alive (terminal->client, terminal->display_number, terminal->session_id);
+        break;
+    case PHASE_KEEP_ALIVE:
+        xdmcp_client_send_keep_alive (terminal->client, terminal->display_number, terminal->session_id);
+        break;
+    case PHASE_X_SERVER:
+    case N_PHASES:
+        break;
+    }
+    n_sent++;
+
+    terminal->timeout = g_timeout_add (response_timeout, (GSourceFunc) timeout_cb, terminal);
+}
+
+static void probe_x_server (Terminal *terminal);
+
+static gboolean
+probe_x_server_cb (gpointer data)
+{
+    Terminal *terminal = data;
+    terminal->timeout = 0;
+    probe_x_server (terminal);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+x_probe_cb (GObject *object, GAsyncResult *result, gpointer data)
+{
+    GSocketClient *probe = G_SOCKET_CLIENT (object);
+    Terminal *terminal = g_object_get_data (G_OBJECT (probe), "terminal");
+
+    g_autoptr(GSocketConnection) connection = g_socket_client_connect_finish (probe, result, NULL);
+    g_object_unref (probe);
+
+    /* Terminal finished while connecting */
+    if (!terminal)
+        return;
+    terminal->x_probe = NULL;
+
+    gint64 elapsed = g_get_monotonic_time () - terminal->send_time;
+    if (connection)
+    {
+        g_array_append_val (latencies[PHASE_X_SERVER], elapsed);
+        terminal->phase = PHASE_QUERY;
+        send_phase (terminal);
+        return;
+    }
+
+    if (elapsed >= (gint64) x_server_timeout * 1000)
+    {
+        g_printerr ("X server :%d did not start listening\n", terminal->display_number);
+        n_x_server_failed++;
+        finish_terminal (terminal);
+        return;
+    }
+
+    /* Not listening yet, try again shortly */
+    terminal->timeout = g_timeout_add (10, probe_x_server_cb, terminal);
+}
+
+static void
+probe_x_server (Terminal *terminal)
+{
+    terminal->x_probe = g_socket_client_new ();
+    g_object_set_data (G_OBJECT (terminal->x_probe), "terminal", terminal);
+    g_socket_client_connect_to_host_async (terminal->x_probe, "127.0.0.1", 6000 + terminal->display_number, NULL, x_probe_cb, NULL);
+}
+
+static gboolean
+start_x_server (Terminal *terminal)
+{
+    g_autofree gchar *display = g_strdup_printf (":%d", terminal->display_number);
+    g_autoptr(GError) error = NULL;
+    terminal->x_server = g_subprocess_launcher_spawn (x_server_launcher, &error, x_server_command, display, "-listen", "tcp", NULL);
+    if (!terminal->x_server)
+    {
+        g_printerr ("Failed to start X server %s: %s\n", x_server_command, error->message);
+        return FALSE;
+    }
+
+    /* Wait for it to listen before logging in, the display manager connects back to it after Manage */
+    terminal->send_time = g_get_monotonic_time ();
+    probe_x_server (terminal);
+
+    return TRUE;
+}
+
+static void
+start_terminals (void)
+{
+    while (n_started < (guint) n_terminals && n_started - n_finished < (guint) concurrency)
+    {
+        Terminal *terminal = g_malloc0 (sizeof (Terminal));
+        terminal->display_number = display_number + n_started;
+        n_started++;
+
+        terminal->client = xdmcp_client_new ();
+        xdmcp_client_set_hostname (terminal->client, host);
+        xdmcp_client_set_port (terminal->client, port);
+        g_signal_connect (terminal->client, XDMCP_CLIENT_SIGNAL_WILLING, G_CALLBACK (willing_cb), terminal);
+        g_signal_connect (terminal->client, XDMCP_CLIENT_SIGNAL_UNWILLING, G_CALLBACK (unwilling_cb), terminal);
+        g_signal_connect (terminal->client, XDMCP_CLIENT_SIGNAL_ACCEPT, G_CALLBACK (accept_cb), terminal);
+        g_signal_connect (terminal->client, XDMCP_CLIENT_SIGNAL_DECLINE, G_CALLBACK (decline_cb), terminal);
+        g_signal_connect (terminal->client, XDMCP_CLIENT_SIGNAL_FAILED, G_CALLBACK (failed_cb), terminal);
+        g_signal_connect (terminal->client, XDMCP_CLIENT_SIGNAL_ALIVE, G_CALLBACK (alive_cb), terminal);
+        if (!xdmcp_client_start (terminal->client))
+        {
+            g_printerr ("Failed to start XDMCP client\n");
+            exit (EXIT_FAILURE);
+        }
+
+        if (x_server_command)
+        {
+            terminal->phase = PHASE_X_SERVER;
+            if (!start_x_server (terminal))
+            {
+                n_x_server_failed++;
+                finish_terminal (terminal);
+            }
+        }
+        else
+        {
+            terminal->phase = PHASE_QUERY;
+            send_phase (terminal);
+        }
+    }
+}
+
+static gint
+compare_latencies (gconstpointer a, gconstpointer b)
+{
+    gint64 latency_a = *((const gint64 *) a), latency_b = *((const gint64 *) b);
+    return latency_a < latency_b ? -1 : latency_a > latency_b ? 1 : 0;
+}
+
+static gdouble
+get_percentile (GArray *values, guint percentile)
+{
+    return g_array_index (values, gint64, (values->len - 1) * percentile / 100) / 1000.0;
+}
+
+int
+main (int argc, char **argv)
+{
+    GOptionEntry options[] =
+    {
+        { "host", 0, 0, G_OPTION_ARG_STRING, &host, "Host running the display manager", "HOST" },
+        { "port", 'p', 0, G_OPTION_ARG_INT, &port, "UDP port the display manager listens on", "PORT" },
+        { "terminals", 'n', 0, G_OPTION_ARG_INT, &n_terminals, "Number of terminals to simulate", "COUNT" },
+        { "concurrency", 'c', 0, G_OPTION_ARG_INT, &concurrency, "Number of terminals logging in at once", "COUNT" },
+        { "keep-alives", 'k', 0, G_OPTION_ARG_INT, &n_keep_alives, "Number of KeepAlives each terminal sends", "COUNT" },
+        { "timeout", 't', 0, G_OPTION_ARG_INT, &response_timeout, "Milliseconds to wait for a response before resending", "MS" },
+        { "retries", 'r', 0, G_OPTION_ARG_INT, &max_retries, "Number of times to resend before a terminal gives up", "COUNT" },
+        { "display", 'd', 0, G_OPTION_ARG_INT, &display_number, "Display number of the first terminal", "NUMBER" },
+        { "broadcast", 'b', 0, G_OPTION_ARG_NONE, &broadcast, "Send BroadcastQuery instead of Query", NULL },
+        { "x-server", 'x', 0, G_OPTION_ARG_FILENAME, &x_server_command, "Start an X server listening on TCP for each terminal", "COMMAND" },
+        { "x-server-timeout", 0, 0, G_OPTION_ARG_INT, &x_server_timeout, "Milliseconds to wait for an X server to listen", "MS" },
+        { NULL }
+    };
+    g_autoptr(GOptionContext) context = g_option_context_new ("- XDMCP load generator");
+    g_option_context_add_main_entries (context, options, NULL);
+    g_autoptr(GError) error = NULL;
+    if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+        g_printerr ("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+    if (!host)
+        host = g_strdup ("127.0.0.1");
+    if (n_terminals < 1 || concurrency < 1 || n_keep_alives < 0 || response_timeout < 1 || max_retries < 0 || x_server_timeout < 1)
+    {
+        g_printerr ("Invalid options\n");
+        return EXIT_FAILURE;
+    }
+
+    for (guint i = 0; i < N_PHASES; i++)
+        latencies[i] = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+    g_autofree gchar *test_root = NULL;
+    if (x_server_command)
+    {
+        x_server_launcher = g_subprocess_launcher_new (G_SUBPROCESS_FLAGS_STDOUT_SILENCE | G_SUBPROCESS_FLAGS_STDERR_SILENCE);
+
+        /* tests/src/X keeps its lock files under LIGHTDM_TEST_ROOT */
+        if (!g_getenv ("LIGHTDM_TEST_ROOT"))
+        {
+            test_root = g_dir_make_tmp ("xdmcp-bench-XXXXXX", &error);
+            if (!test_root)
+            {
+                g_printerr ("Failed to make directory for X servers: %s\n", error->message);
+                return EXIT_FAILURE;
+            }
+            g_autofree gchar *tmp_dir = g_build_filename (test_root, "tmp", NULL);
+            g_mkdir (tmp_dir, 0755);
+            g_subprocess_launcher_setenv (x_server_launcher, "LIGHTDM_TEST_ROOT", test_root, TRUE);
+        }
+    }
+
+    loop = g_main_loop_new (NULL, FALSE);
+    gint64 start_time = g_get_monotonic_time ();
+    start_terminals ();
+    g_main_loop_run (loop);
+    gdouble run_time = (gdouble) (g_get_monotonic_time () - start_time) / G_USEC_PER_SEC;
+
+    g_print ("%d terminals to %s:%d in %.2fs, %d at a time\n", n_terminals, host, port, run_time, concurrency);
+    g_print ("completed: %u (%.1f sessions/s)\n", n_completed, n_completed / run_time);
+    g_print ("unwilling: %u, declined: %u, failed: %u, not running: %u, timed out: %u, X server failed: %u\n", n_unwilling, n_declined, n_failed, n_not_running, n_timed_out, n_x_server_failed);
+    g_print ("requests: %" G_GUINT64_FORMAT " sent, %" G_GUINT64_FORMAT " lost (%.2f%%)\n", n_sent, n_lost, n_sent > 0 ? 100.0 * n_lost / n_sent : 0.0);
+    g_print ("%-10s %8s %10s %10s %10s %10s\n", "phase", "count", "p50 ms", "p90 ms", "p99 ms", "max ms");
+    for (guint i = 0; i < N_PHASES; i++)
+    {
+        if (latencies[i]->len == 0)
+        {
+            g_print ("%-10s %8u\n", phase_names[i], 0);
+            continue;
+        }
+
+        g_array_sort (latencies[i], compare_latencies);
+        g_print ("%-10s %8u %10.3f %10.3f %10.3f %10.3f\n", phase_names[i], latencies[i]->len,
+                 get_percentile (latencies[i], 50), get_percentile (latencies[i], 90), get_percentile (latencies[i], 99), get_percentile (latencies[i], 100));
+    }
+
+    if (test_root)
+    {
+        g_autofree gchar *command = g_strdup_printf ("rm -rf %s", test_root);
+        if (system (command))
+            perror ("Failed to delete X server directory");
+    }
+
+    return n_timed_out > 0 || n_x_server_failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
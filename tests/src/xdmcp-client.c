@@ -36,6 +36,7 @@ struct XDMCPClientPrivate
     gchar *host;
     gint port;
     GSocket *socket;
+    guint socket_watch;
     gchar *authentication_names;
     gchar *authorization_name;
     gint authorization_data_length;
@@ -296,7 +297,8 @@ xdmcp_client_start (XDMCPClient *client)
             continue;
         }
 
-        g_io_add_watch (g_io_channel_unix_new (g_socket_get_fd (client->priv->socket)), G_IO_IN, xdmcp_data_cb, client);
+        g_autoptr(GIOChannel) channel = g_io_channel_unix_new (g_socket_get_fd (client->priv->socket));
+        client->priv->socket_watch = g_io_add_watch (channel, G_IO_IN, xdmcp_data_cb, client);
 
         return TRUE;
     }
@@ -459,10 +461,14 @@ static void
 xdmcp_client_finalize (GObject *object)
 {
     XDMCPClient *client = (XDMCPClient *) object;
+    if (client->priv->socket_watch)
+        g_source_remove (client->priv->socket_watch);
     g_clear_pointer (&client->priv->host, g_free);
     g_clear_object (&client->priv->socket);
     g_clear_pointer (&client->priv->authorization_name, g_free);
     g_clear_pointer (&client->priv->authorization_data, g_free);
+
+    G_OBJECT_CLASS (xdmcp_client_parent_class)->finalize (object);
 }
 
 static void
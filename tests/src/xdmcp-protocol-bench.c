@@ -0,0 +1,93 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+
+#include <xdmcp-protocol.h>
+
+/* Measures handling a Query and encoding the Willing response, as an XDMCP server does for every chooser on the network */
+
+static const gchar *hostname = "lightdm-bench";
+static const gchar *status = "Linux 5.10";
+
+static gsize
+make_query (guint8 *data, gsize length)
+{
+    gchar *names[] = { "XDM-AUTHENTICATION-1", "MIT-MAGIC-COOKIE-1", NULL };
+    XDMCPPacket *query = xdmcp_packet_alloc (XDMCP_Query);
+    query->Query.authentication_names = g_strdupv (names);
+    gssize n_written = xdmcp_packet_encode (query, data, length);
+    xdmcp_packet_free (query);
+
+    return n_written;
+}
+
+static gboolean
+handle_with_heap (const guint8 *query_data, gsize query_length, guint8 *response_data, gsize response_length)
+{
+    XDMCPPacket *query = xdmcp_packet_decode (query_data, query_length);
+    if (!query)
+        return FALSE;
+
+    XDMCPPacket *response = xdmcp_packet_alloc (XDMCP_Willing);
+    response->Willing.authentication_name = g_strdup ("");
+    response->Willing.hostname = g_strdup (hostname);
+    response->Willing.status = g_strdup (status);
+    gssize n_written = xdmcp_packet_encode (response, response_data, response_length);
+
+    xdmcp_packet_free (response);
+    xdmcp_packet_free (query);
+
+    return n_written > 0;
+}
+
+static gboolean
+handle_with_arena (XDMCPArena *arena, const guint8 *query_data, gsize query_length, guint8 *response_data, gsize response_length)
+{
+    xdmcp_arena_reset (arena);
+
+    XDMCPPacket *query = xdmcp_packet_decode_in_arena (arena, query_data, query_length);
+    if (!query)
+        return FALSE;
+
+    XDMCPPacket *response = xdmcp_packet_alloc_in_arena (arena, XDMCP_Willing);
+    response->Willing.authentication_name = (gchar *) "";
+    response->Willing.hostname = (gchar *) hostname;
+    response->Willing.status = (gchar *) status;
+
+    return xdmcp_packet_encode (response, response_data, response_length) > 0;
+}
+
+int
+main (int argc, char **argv)
+{
+    guint n_iterations = argc > 1 ? atoi (argv[1]) : 1000000;
+
+    guint8 query_data[1024];
+    gsize query_length = make_query (query_data, sizeof (query_data));
+    guint8 response_data[1024];
+
+    gint64 start_time = g_get_monotonic_time ();
+    for (guint i = 0; i < n_iterations; i++)
+    {
+        if (!handle_with_heap (query_data, query_length, response_data, sizeof (response_data)))
+            return EXIT_FAILURE;
+    }
+    gdouble heap_time = (gdouble) (g_get_monotonic_time () - start_time) / G_USEC_PER_SEC;
+
+    static XDMCPArena arena;
+    start_time = g_get_monotonic_time ();
+    for (guint i = 0; i < n_iterations; i++)
+    {
+        if (!handle_with_arena (&arena, query_data, query_length, response_data, sizeof (response_data)))
+            return EXIT_FAILURE;
+    }
+    gdouble arena_time = (gdouble) (g_get_monotonic_time () - start_time) / G_USEC_PER_SEC;
+    xdmcp_arena_reset (&arena);
+
+    g_print ("%u Query/Willing round trips\n", n_iterations);
+    g_print ("heap: %.0f packets/s\n", n_iterations / heap_time);
+    g_print ("arena: %.0f packets/s\n", n_iterations / arena_time);
+
+    return EXIT_SUCCESS;
+}